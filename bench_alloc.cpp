@@ -0,0 +1,110 @@
+// Allocation counts for parse-and-discard work: make bench
+//
+// Counts calls to the global operator new and delete (aligned overloads
+// included) while parsing a sum of products and clearing it, on default
+// and on arena pools. Also reports the wall time per parse and per clear.
+#include "edag.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+static size_t news = 0, deletes = 0;
+
+static void* counted(size_t n, size_t align) {
+	++news;
+	void *p = align ? std::aligned_alloc(align, (n + align - 1) / align * align)
+					: std::malloc(n ? n : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+static void release(void *p) {
+	if (p)
+		++deletes;
+
+	std::free(p);
+}
+
+void* operator new(size_t n) { return counted(n, 0); }
+void* operator new[](size_t n) { return counted(n, 0); }
+void* operator new(size_t n, std::align_val_t a) { return counted(n, (size_t) a); }
+void* operator new[](size_t n, std::align_val_t a) { return counted(n, (size_t) a); }
+
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+void operator delete(void *p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { release(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { release(p); }
+
+// 3*x1*y2 + 4*x2*y3*z + ...: terms distinct, factors shared
+static std::string workload(int terms) {
+	std::string s;
+
+	for (int k = 0; k < terms; ++k) {
+		if (k)
+			s += " + ";
+
+		s += std::to_string(k + 3) + "*x" + std::to_string(k % 17) + "*y" + std::to_string(k % 13);
+
+		if (k % 3 == 0)
+			s += "*sin(z" + std::to_string(k % 5) + ")";
+	}
+
+	return s;
+}
+
+static void run(const std::string &label, bool arena, const std::string &text, int reps) {
+	size_t parse_news = 0, clear_deletes = 0, nodes = 0;
+	double parse_s = 0, clear_s = 0;
+
+	for (int r = 0; r < reps; ++r) {
+		eDAG t;
+		t.set_arena(arena);
+
+		size_t n0 = news;
+		auto start = std::chrono::steady_clock::now();
+		t.parse(text);
+		auto mid = std::chrono::steady_clock::now();
+		parse_news += news - n0;
+		nodes = t.size();
+
+		size_t d0 = deletes;
+		auto mid2 = std::chrono::steady_clock::now();
+		t.clear();
+		auto end = std::chrono::steady_clock::now();
+		clear_deletes += deletes - d0;
+
+		parse_s += std::chrono::duration<double>(mid - start).count();
+		clear_s += std::chrono::duration<double>(end - mid2).count();
+	}
+
+	std::cout << label << ": " << nodes << " nodes, "
+			  << parse_news / reps << " new per parse, "
+			  << clear_deletes / reps << " delete per clear, "
+			  << parse_s / reps * 1e3 << " ms parse, "
+			  << clear_s / reps * 1e3 << " ms clear" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	int reps = (argc > 1) ? std::atoi(argv[1]) : 50;
+	std::string text = workload(200);
+
+	// interning the operator and function names once, outside the counts
+	{
+		eDAG warm;
+		warm.parse(text);
+	}
+
+	run("default", 0, text, reps);
+	run("arena  ", 1, text, reps);
+
+	return 0;
+}
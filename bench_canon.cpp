@@ -0,0 +1,44 @@
+// canonicalize on deep shared inputs: make bench-canon [LEVELS=n]
+//
+// a_k = a_{k-1} / y - a_{k-1}: 2n + 2 nodes, a tree of 2^n, built through
+// parse's let bindings. Times canonicalize at n = LEVELS / 100, LEVELS / 10
+// and LEVELS (10^5 by default), so the per-node cost can be compared across
+// two factors of ten.
+#include "edag.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static std::string shared(size_t levels) {
+	std::string s = "let a0 = x in ";
+
+	for (size_t k = 1; k < levels; ++k) {
+		std::string p = "a" + std::to_string(k - 1);
+		s += "let a" + std::to_string(k) + " = " + p + " / y - " + p + " in ";
+	}
+
+	std::string p = "a" + std::to_string(levels - 1);
+	return s + p + " / y - " + p;
+}
+
+int main(int argc, char **argv) {
+	size_t levels = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+	for (size_t n : { levels / 100, levels / 10, levels }) {
+		if (n < 2)
+			continue;
+
+		eDAG t;
+		t.parse(shared(n));
+
+		auto start = std::chrono::steady_clock::now();
+		eDAG c = t.canonicalize();
+		std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+		std::cout << "n = " << n << ", " << t.size() << " nodes: canonicalize "
+				  << took.count() * 1e3 << " ms, "
+				  << took.count() / t.size() * 1e9 << " ns per node" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+// JIT against eDAG::eval: make bench-jit [POINTS=n]
+//
+// Compiles a 25-node expression with sin, tan, log, exp, sqrt, pow and pi
+// into a fresh cache directory, then loads it again from the cache. Checks
+// the JIT against eval() at 1000 points and reports the time per point of
+// eval(), the scalar entry and the batch entry. Also times JIT::source on
+// sin(cos(...(x))) chains, whose code generation should grow linearly.
+#include "edag.hpp"
+#include "jit.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string calls(size_t depth) {
+	std::string s;
+
+	for (size_t k = 0; k < depth; ++k)
+		s += (k % 2) ? "cos(" : "sin(";
+
+	s += "x";
+	s.append(depth, ')');
+	return s;
+}
+
+int main(int argc, char **argv) {
+	size_t points = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 200000;
+	const std::string text = "sin(x) * tan(y / 3) + log(x^2 + 1) - exp(-y) * sqrt(x * x + y * y) + pi * x^3";
+
+	eDAG t;
+	t.parse(text);
+
+	std::string dir = (std::filesystem::temp_directory_path() /
+					   ("cas-bench-jit-" + std::to_string(::getpid()))).string();
+	std::filesystem::create_directories(dir);
+
+	auto start = std::chrono::steady_clock::now();
+	JIT fresh(t, dir);
+	double compile_s = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	JIT f(t, dir);
+	double load_s = seconds_since(start);
+
+	std::cout << t.size() << " nodes: compile " << compile_s * 1e3 << " ms, cached load "
+			  << load_s * 1e3 << " ms" << std::endl;
+
+	// points in columns, as the batch entry takes them
+	std::vector<double> cols(2 * points), out(points);
+
+	for (size_t i = 0; i < points; ++i) {
+		cols[i] = 0.5 + (double) (i % 1000) / 250;
+		cols[points + i] = -1.0 + (double) (i % 777) / 200;
+	}
+
+	size_t n_eval = std::min<size_t>(points, 1000);
+	double max_diff = 0, eval_s = 0;
+
+	for (size_t i = 0; i < n_eval; ++i) {
+		std::unordered_map<std::string, std::variant<int64_t, Rational, double>> at = {
+			{ "x", cols[i] }, { "y", cols[points + i] }
+		};
+		double x[2] = { cols[i], cols[points + i] };
+
+		start = std::chrono::steady_clock::now();
+		double want = variant_to_double(t.eval(at));
+		eval_s += seconds_since(start);
+
+		max_diff = std::max(max_diff, std::abs(f(x) - want));
+	}
+
+	start = std::chrono::steady_clock::now();
+	double sum = 0;
+
+	for (size_t i = 0; i < points; ++i) {
+		double x[2] = { cols[i], cols[points + i] };
+		sum += f(x);
+	}
+
+	double scalar_s = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	f(cols.data(), points, out.data());
+	double batch_s = seconds_since(start);
+
+	// the scalar and batch entries run the same kernel, in the same order
+	double batch_sum = 0;
+
+	for (double v : out)
+		batch_sum += v;
+
+	std::cout << "max |jit - eval| over " << n_eval << " points: " << max_diff << std::endl
+			  << "eval   " << eval_s / n_eval * 1e9 << " ns per point" << std::endl
+			  << "scalar " << scalar_s / points * 1e9 << " ns per point" << std::endl
+			  << "batch  " << batch_s / points * 1e9 << " ns per point" << std::endl;
+
+	for (size_t depth : { 2000, 4000, 8000, 16000 }) {
+		eDAG c;
+		c.parse(calls(depth));
+
+		start = std::chrono::steady_clock::now();
+		std::string src = JIT::source(c);
+		std::cout << "JIT::source, depth " << depth << ": " << seconds_since(start) * 1e3 << " ms" << std::endl;
+	}
+
+	std::filesystem::remove_all(dir);
+	return (max_diff == 0 && sum == batch_sum) ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+// Printing 10^6-node DAGs: make bench-print [NODES=n]
+//
+// Times to_string and to_latex, plain and with let bindings, on an unshared
+// (...)+1 / (...)*y chain, and the let forms alone on a Fibonacci-shared
+// DAG, t_k = t_{k-1} - t_{k-2}, whose expanded tree overflows 2^64. The
+// let text of each is parsed back and must give the same fingerprint.
+#include "edag.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+static void timed(const std::string &what, const std::function<size_t()> &f) {
+	auto start = std::chrono::steady_clock::now();
+	size_t bytes = f();
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+	std::cout << "  " << what << ": " << took.count() << " s";
+
+	if (bytes)
+		std::cout << ", " << bytes / 1e6 << " MB";
+
+	std::cout << std::endl;
+}
+
+static void round_trip(const eDAG &t) {
+	std::string text;
+	eDAG back;
+
+	timed("to_string(1)", [&] { text = t.to_string(1); return text.size(); });
+	timed("to_latex(1)", [&] { return t.to_latex(1).size(); });
+	timed("parse of the let text", [&] { back.parse(text); return (size_t) 0; });
+
+	bool ok = back.fingerprint() == t.fingerprint();
+
+	if (!ok)
+		++failures;
+
+	std::cout << (ok ? "  ok    " : "  FAIL  ") << "same fingerprint after parse" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	size_t nodes = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+	{
+		// ((((x+1)*y+1)*y+1)...), one new node per level
+		size_t depth = nodes;
+		std::string s;
+		s.append(depth, '(');
+		s += "x";
+
+		for (size_t k = 0; k < depth; ++k)
+			s += (k % 2) ? "*y)" : "+1)";
+
+		eDAG t;
+		t.parse(s);
+
+		std::cout << "chain, " << t.size() << " nodes" << std::endl;
+		timed("to_string", [&] { return t.to_string().size(); });
+		timed("to_latex", [&] { return t.to_latex().size(); });
+		round_trip(t);
+	}
+
+	{
+		std::string s = "let t1 = x - y in let t2 = y - t1 in ";
+
+		for (size_t k = 3; k < nodes; ++k)
+			s += "let t" + std::to_string(k) + " = t" + std::to_string(k - 1) + " - t" + std::to_string(k - 2) + " in ";
+
+		s += "t" + std::to_string(nodes - 1) + " - t" + std::to_string(nodes - 2);
+
+		eDAG t;
+		t.parse(s);
+
+		std::cout << "Fibonacci-shared, " << t.size() << " nodes, tree size "
+				  << t.metrics().tree_size << std::endl;
+		round_trip(t);
+	}
+
+	return failures ? 1 : 0;
+}
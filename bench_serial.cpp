@@ -0,0 +1,88 @@
+// deserialize against parsing the printed text: make bench-serial [REPS=n]
+//
+// For a 200-term sum of products and for a small DAG whose plain text
+// expands to tens of kilobytes, reports the size of the binary record and of
+// the text, and the time per load of deserialize(), of parse() of the plain
+// text and of parse() of the let text.
+#include "edag.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+static double per_run(int reps, const std::function<void()> &f) {
+	auto start = std::chrono::steady_clock::now();
+
+	for (int r = 0; r < reps; ++r)
+		f();
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / reps;
+}
+
+static void run(const std::string &label, const eDAG &t, int reps) {
+	std::string data = t.serialize(), text = t.to_string(), let = t.to_string(1);
+	int failures = 0;
+
+	double load = per_run(reps, [&] {
+		eDAG u;
+		u.deserialize(data);
+		failures += u.fingerprint() != t.fingerprint();
+	});
+	double plain = per_run(reps, [&] {
+		eDAG u;
+		u.parse(text);
+	});
+	double bound = per_run(reps, [&] {
+		eDAG u;
+		u.parse(let);
+	});
+
+	std::cout << label << ", " << t.size() << " nodes" << (failures ? ", ROUND TRIP FAILED" : "") << std::endl
+			  << "  binary    " << data.size() << " B, deserialize " << load * 1e3 << " ms" << std::endl
+			  << "  text      " << text.size() << " B, parse " << plain * 1e3 << " ms ("
+			  << plain / load << "x)" << std::endl
+			  << "  let text  " << let.size() << " B, parse " << bound * 1e3 << " ms ("
+			  << bound / load << "x)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	int reps = (argc > 1) ? std::atoi(argv[1]) : 20;
+
+	{
+		// 3*x1*y2 + 4*x2*y3*z + ...: terms distinct, factors shared
+		std::string s;
+
+		for (int k = 0; k < 200; ++k) {
+			if (k)
+				s += " + ";
+
+			s += std::to_string(k + 3) + "*x" + std::to_string(k % 17) + "*y" + std::to_string(k % 13);
+
+			if (k % 3 == 0)
+				s += "*sin(z" + std::to_string(k % 5) + ")";
+		}
+
+		eDAG t;
+		t.parse(s);
+		run("200-term sum", t, reps);
+	}
+
+	{
+		// t_k = sin(t_{k-1}) * t_{k-1} - x: each level doubles the text
+		std::string s = "let t0 = x + y in ";
+
+		for (int k = 1; k < 12; ++k) {
+			std::string p = "t" + std::to_string(k - 1);
+			s += "let t" + std::to_string(k) + " = sin(" + p + ") * " + p + " - x in ";
+		}
+
+		s += "t11 / y";
+
+		eDAG t;
+		t.parse(s);
+		run("shared DAG", t, reps);
+	}
+
+	return 0;
+}
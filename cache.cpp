@@ -0,0 +1,244 @@
+#include "cache.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// part of every key: bump it when a pass changes its results, so old
+// entries stop matching
+static const char CACHE_VERSION = 2;
+
+static std::shared_ptr<eCache> cache_installed;
+
+eCache::eCache(const std::string &dir, uint64_t max_bytes) : dir(dir), max_bytes(max_bytes) {
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+
+	if (!fs::is_directory(dir, ec)) {
+		throw std::runtime_error("cache: can't create directory " + dir);
+	}
+
+	this->evict();
+}
+
+void eCache::install(const std::shared_ptr<eCache> &c) {
+	std::atomic_store(&cache_installed, c);
+}
+
+std::shared_ptr<eCache> eCache::installed() {
+	return std::atomic_load(&cache_installed);
+}
+
+std::string eCache::key(const eDAG &expr, const std::string &op, const std::string &arg) {
+	std::string material = op;
+
+	material += '\0';
+	material += arg;
+	material += '\0';
+	material += expr.fold ? '1' : '0';
+	material += CACHE_VERSION;
+
+	char buf[18];
+	std::snprintf(buf, sizeof(buf), "-%016llx", (unsigned long long) utils::fnv1a(material.data(), material.size()));
+
+	return expr.fingerprint().to_string() + buf;
+}
+
+std::string eCache::path(const std::string &key) const {
+	return (fs::path(this->dir) / (key + ".casb")).string();
+}
+
+bool eCache::get(const std::string &key, eDAG &out) {
+	std::string p = this->path(key);
+	std::ifstream in(p, std::ios::binary);
+
+	if (!in) {
+		this->misses++;
+		return 0;
+	}
+
+	std::ostringstream data;
+	data << in.rdbuf();
+	in.close();
+
+	eDAG result = out;
+
+	try {
+		result.deserialize(data.str());
+	} catch (const std::runtime_error &) {
+		// torn or corrupt: drop it, the caller recomputes
+		std::error_code ec;
+		fs::remove(p, ec);
+		this->misses++;
+		return 0;
+	}
+
+	// the modification time is the recency evict() goes by
+	std::error_code ec;
+	fs::last_write_time(p, fs::file_time_type::clock::now(), ec);
+
+	out = result;
+	this->hits++;
+
+	return 1;
+}
+
+void eCache::put(const std::string &key, const eDAG &result) {
+	std::string data = result.serialize();
+	std::string p = this->path(key);
+	std::string tmp = (fs::path(this->dir) / ("." + key + "." + std::to_string(::getpid()) + "." +
+						std::to_string(this->next_tmp++) + ".tmp")).string();
+
+	{
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		out.write(data.data(), data.size());
+
+		if (!out) {
+			out.close();
+			std::remove(tmp.c_str());
+			return;
+		}
+	}
+
+	if (std::rename(tmp.c_str(), p.c_str()) != 0) {
+		std::remove(tmp.c_str());
+		return;
+	}
+
+	this->stores++;
+
+	if ((this->used += data.size()) > this->max_bytes)
+		this->evict();
+}
+
+eDAG eCache::through(const eDAG &expr,
+					 const std::string &op,
+					 const std::string &arg,
+					 const std::function<eDAG()> &f) {
+	std::string k = key(expr, op, arg);
+
+	// a hit is read onto a copy, so it detaches like computed results do
+	eDAG out = expr;
+
+	if (this->get(k, out))
+		return out;
+
+	out = f();
+	this->put(k, out);
+
+	return out;
+}
+
+void eCache::evict() {
+	std::lock_guard<std::mutex> lock(this->evicting);
+
+	struct Entry {
+		fs::file_time_type time;
+		uint64_t size;
+		fs::path path;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	std::error_code ec;
+
+	for (fs::directory_iterator it(this->dir, ec), end; !ec && it != end; it.increment(ec)) {
+		const fs::path &p = it->path();
+
+		if (p.extension() != ".casb" || p.filename().string()[0] == '.')
+			continue;
+
+		std::error_code fe;
+		uint64_t size = fs::file_size(p, fe);
+		auto time = fs::last_write_time(p, fe);
+
+		// removed by another process meanwhile
+		if (fe)
+			continue;
+
+		entries.push_back({ time, size, p });
+		total += size;
+	}
+
+	if (total > this->max_bytes) {
+		std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+			return a.time < b.time;
+		});
+
+		uint64_t target = this->max_bytes / 4 * 3;
+
+		for (const auto &e : entries) {
+			if (total <= target)
+				break;
+
+			std::error_code re;
+
+			if (fs::remove(e.path, re))
+				this->evictions++;
+
+			total -= e.size;
+		}
+	}
+
+	this->used = total;
+}
+
+CacheStats eCache::stats() const {
+	CacheStats s;
+
+	s.hits = this->hits;
+	s.misses = this->misses;
+	s.stores = this->stores;
+	s.evictions = this->evictions;
+
+	return s;
+}
+
+void eCache::reset_stats() {
+	this->hits = 0;
+	this->misses = 0;
+	this->stores = 0;
+	this->evictions = 0;
+}
+
+uint64_t eCache::bytes() const {
+	return this->used;
+}
+
+const std::string& eCache::directory() const {
+	return this->dir;
+}
+
+eDAG eDAG::derivative(const std::string &var) const {
+	auto c = eCache::installed();
+
+	if (!c)
+		return this->differentiate(var);
+
+	return c->through(*this, "derivative", var, [&] { return this->differentiate(var); });
+}
+
+eDAG eDAG::simplify() const {
+	auto c = eCache::installed();
+
+	if (!c)
+		return this->simplified();
+
+	return c->through(*this, "simplify", "", [&] { return this->simplified(); });
+}
+
+eDAG eDAG::canonicalize() const {
+	auto c = eCache::installed();
+
+	if (!c)
+		return this->canonical();
+
+	return c->through(*this, "canonicalize", "", [&] { return this->canonical(); });
+}
@@ -0,0 +1,78 @@
+// Persistent result cache for eDAG passes
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+struct CacheStats {
+	size_t hits = 0;
+	size_t misses = 0;
+	// results written, and files removed to stay under the size bound
+	size_t stores = 0;
+	size_t evictions = 0;
+};
+
+// Content-addressed store of pass results in a local directory, one file
+// per result in the serialize() format. The key is the input's
+// fingerprint and a hash of the pass name, its argument and the folding
+// flag, so equal expressions hit whatever pool, process or operand order
+// of + and * built them. Files are written under a private name and
+// renamed into place, so processes can share a directory. When the
+// directory grows past max_bytes the least recently used results are
+// removed; reading a result touches it.
+//
+// Once installed, eDAG::derivative, simplify and canonicalize consult the
+// cache before computing. Cache failures (unreadable, corrupt or
+// unwritable files) count as misses and never reach the caller.
+class eCache {
+	public:
+		// results in dir, created if missing
+		explicit eCache(const std::string &dir, uint64_t max_bytes = 256ull << 20);
+
+		// serve eDAG passes from c; nullptr turns caching off
+		static void install(const std::shared_ptr<eCache> &c);
+		static std::shared_ptr<eCache> installed();
+
+		// file name of the result of op(expr, arg): the fingerprint of expr
+		// and 16 hex digits for the rest
+		static std::string key(const eDAG &expr, const std::string &op, const std::string &arg);
+
+		// false on a miss, leaving out as it was
+		bool get(const std::string &key, eDAG &out);
+		void put(const std::string &key, const eDAG &result);
+
+		// op(expr, arg) from the cache, or from f, storing it
+		eDAG through(const eDAG &expr,
+					 const std::string &op,
+					 const std::string &arg,
+					 const std::function<eDAG()> &f);
+
+		CacheStats stats() const;
+		void reset_stats();
+
+		// bytes of results in the directory, as last counted
+		uint64_t bytes() const;
+		const std::string& directory() const;
+	private:
+		std::string dir;
+		uint64_t max_bytes;
+		std::atomic<uint64_t> used{ 0 };
+		std::atomic<size_t> hits{ 0 }, misses{ 0 }, stores{ 0 }, evictions{ 0 };
+		std::atomic<uint64_t> next_tmp{ 0 };
+		std::mutex evicting;
+
+		std::string path(const std::string &key) const;
+		// recount the directory and drop the oldest results until it is
+		// under 3/4 of max_bytes, so a full cache isn't rescanned on every
+		// put
+		void evict();
+};
+
+#include "cache.cpp"
+
+#endif
@@ -0,0 +1,1329 @@
+// Regression checks: make check
+#include "edag.hpp"
+#include "incremental.hpp"
+#include "interval.hpp"
+#include "codegen.hpp"
+#include "jit.hpp"
+#include "store.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what) {
+	if (!ok) {
+		++failures;
+		std::cout << "FAIL: " << what << std::endl;
+	}
+}
+
+static std::string simplified(const std::string &expr) {
+	eDAG t;
+	t.parse(expr);
+	return t.simplify().to_string();
+}
+
+static void check_rewrite() {
+	const std::pair<const char*, const char*> cases[] = {
+		{ "x + 0", "x" },
+		{ "x + y + 0", "x + y" },
+		{ "0 + x + y", "x + y" },
+		{ "x + 0 + y", "x + y" },
+		{ "x * y * 1", "x * y" },
+		{ "2 * x * 0", "0" },
+		{ "x * 0 * y * z", "0" },
+		{ "a + b + sin(0) + c", "a + b + c" },
+		{ "x * y * z", "x * y * z" },
+	};
+
+	for (const auto &[in, want] : cases) {
+		std::string got = simplified(in);
+		check(got == want, std::string("simplify(") + in + ") = " + got + ", want " + want);
+	}
+}
+
+static void check_rewrite_nary() {
+	Rewriter r;
+	r.add_rule("x*y + x*z", "x*(y+z)");
+	r.add_rule("x + x", "2*x");
+	r.add_rule("x + y + 0", "x + y");
+
+	const std::pair<const char*, const char*> cases[] = {
+		{ "a + b*c + q + b*d", "a + b * (c + d) + q" },
+		{ "y + a + b + a", "y + 2 * a + b" },
+		{ "u + 0 + v + w", "u + v + w" },
+		{ "a*b + c*d + e", "a * b + c * d + e" },
+	};
+
+	for (const auto &[in, want] : cases) {
+		eDAG t;
+		t.parse(in);
+		std::string got = r.rewrite(t).to_string();
+		check(got == want, std::string("rewrite(") + in + ") = " + got + ", want " + want);
+	}
+}
+
+static void check_fold() {
+	const std::pair<const char*, const char*> cases[] = {
+		{ "2 + 3*4", "14" },
+		{ "1/3 + 1/6", "1/2" },
+		{ "(1/2)^2", "1/4" },
+		{ "2^10", "1024" },
+		// decimals parse exactly, so they fold like fractions
+		{ "0.5 + 0.5", "1" },
+		{ "0.1 + 0.2", "3/10" },
+		{ "x*1 + 0", "x" },
+		{ "x - x", "0" },
+		{ "0 - x", "-x" },
+		{ "-(-x)", "x" },
+		// overflow: left unfolded rather than wrapped
+		{ "9223372036854775807 + 1", "9223372036854775807 + 1" },
+		{ "9223372036854775807 * 2 + x", "9223372036854775807 * 2 + x" },
+	};
+
+	for (const auto &[in, want] : cases) {
+		eDAG t;
+		t.set_folding(1);
+		std::string got;
+
+		try {
+			t.parse(in);
+			got = t.to_string();
+		} catch (const std::exception &e) {
+			got = e.what();
+		}
+
+		check(got == want, std::string("fold(") + in + ") = " + got + ", want " + want);
+	}
+
+	eDAG t;
+	t.parse("0.5");
+	auto v = t.eval();
+	check(std::holds_alternative<Rational>(v) && std::get<Rational>(v) == Rational(1, 2), "0.5 parses as 1/2");
+}
+
+static bool equivalent(const std::string &a, const std::string &b) {
+	eDAG ta, tb;
+	ta.parse(a);
+	tb.parse(b);
+	return eDAG::equivalent(ta, tb);
+}
+
+static void check_equivalent() {
+	const std::pair<const char*, const char*> same[] = {
+		{ "(x+1)^2", "x^2 + 2*x + 1" },
+		{ "sin(x)^2 + cos(x)^2", "1" },
+		{ "sqrt(x^2)", "abs(x)" },
+		{ "sin(2*x)", "2*sin(x)*cos(x)" },
+		{ "exp(x + y)", "exp(x) * exp(y)" },
+	};
+
+	const std::pair<const char*, const char*> different[] = {
+		{ "abs(x)", "x" },
+		{ "sqrt(x^2)", "x" },
+		{ "log(x^2)", "2*log(x)" },
+		{ "sin(x)/10000000000", "0" },
+		{ "exp(x)/10000000000 + 1", "1" },
+		{ "x + 1", "x" },
+	};
+
+	for (const auto &[a, b] : same)
+		check(equivalent(a, b), std::string("equivalent(") + a + ", " + b + ")");
+
+	for (const auto &[a, b] : different)
+		check(!equivalent(a, b), std::string("!equivalent(") + a + ", " + b + ")");
+}
+
+static Fingerprint fingerprint(const std::string &expr) {
+	eDAG t;
+	t.parse(expr);
+	return t.fingerprint();
+}
+
+static void check_fingerprint() {
+	const std::pair<const char*, const char*> same[] = {
+		{ "a + b", "b + a" },
+		{ "a * b * c", "c * a * b" },
+		{ "y + sin(a*b)", "sin(b*a) + y" },
+		// 1.0 parses exactly, as 1
+		{ "x + 1", "x + 1.0" },
+	};
+
+	const std::pair<const char*, const char*> different[] = {
+		{ "a - b", "b - a" },
+		{ "a / b", "b / a" },
+		{ "a ^ b", "b ^ a" },
+		{ "a + b", "a * b" },
+		// too many digits for an exact decimal: the constant is a double
+		{ "0.5", "0.50000000000000000000" },
+		{ "x * 0.5", "x * 0.50000000000000000000" },
+	};
+
+	for (const auto &[a, b] : same)
+		check(fingerprint(a) == fingerprint(b), std::string("fingerprint(") + a + ") == fingerprint(" + b + ")");
+
+	for (const auto &[a, b] : different)
+		check(fingerprint(a) != fingerprint(b), std::string("fingerprint(") + a + ") != fingerprint(" + b + ")");
+
+	// the same structure in another pool, after other nodes, so with other
+	// node ids
+	eDAG t(ePool::create());
+	t.parse("q + r + s");
+	t.parse("x*y + z");
+	check(t.fingerprint() == fingerprint("z + y*x"), "fingerprint independent of node ids");
+}
+
+static void check_substitute() {
+	eDAG t;
+	t.parse("sin(x)*x + y");
+
+	const std::pair<std::unordered_map<std::string, std::string>, const char*> cases[] = {
+		{ { { "x", "a + 1" } }, "sin(a + 1) * (a + 1) + y" },
+		// simultaneous, not one after the other
+		{ { { "x", "y" }, { "y", "x" } }, "sin(y) * y + x" },
+		{ { { "q", "1" } }, "sin(x) * x + y" },
+	};
+
+	for (const auto &[subs, want] : cases) {
+		std::string got = t.substitute(subs).to_string();
+		check(got == want, "substitute into sin(x)*x + y = " + got + ", want " + want);
+	}
+
+	check(t.to_string() == "sin(x) * x + y", "substitute leaves its input alone: " + t.to_string());
+
+	double v = variant_to_double(t.substitute({ { "x", "2" }, { "y", "3" } }).eval());
+	check(v == std::sin(2.0) * 2 + 3, "substitute numbers then eval: " + std::to_string(v));
+
+	// the replacement is interned under the folding setting of the input
+	eDAG f;
+	f.set_folding(1);
+	f.parse("x*3 + y");
+	check(f.substitute({ { "x", "2" } }).to_string() == "6 + y",
+		  "substitute with folding: " + f.substitute({ { "x", "2" } }).to_string());
+
+	bool threw = 0;
+
+	try {
+		t.substitute({ { "x", "1 +" } });
+	} catch (const std::runtime_error &) {
+		threw = 1;
+	}
+
+	check(threw, "substitute of an unparsable replacement throws");
+}
+
+static void check_free_vars() {
+	auto join = [](const std::vector<std::string> &vs) {
+		std::string s;
+
+		for (const auto &v : vs)
+			s += (s.empty() ? "" : " ") + v;
+
+		return s;
+	};
+
+	eDAG t;
+	t.parse("sin(y)*x + 2");
+	check(t.depends_on("x") && t.depends_on("y") && !t.depends_on("z"), "depends_on in sin(y)*x + 2");
+	check(join(t.free_vars()) == "y x", "free_vars(sin(y)*x + 2) = " + join(t.free_vars()));
+
+	eDAG s = t.substitute({ { "x", "2*z" } });
+	check(!s.depends_on("x") && s.depends_on("z"), "depends_on after substituting x");
+	check(join(s.free_vars()) == "y z", "free_vars after substituting x = " + join(s.free_vars()));
+
+	// past the first 64 variables of a pool, sets are no longer one word
+	auto p = ePool::create();
+	eDAG wide(p);
+	std::string sum = "v0";
+
+	for (int k = 1; k < 70; ++k)
+		sum += " + v" + std::to_string(k);
+
+	wide.parse(sum);
+
+	eDAG part(p);
+	part.parse("v68 * v1");
+
+	check(wide.depends_on("v69") && part.depends_on("v68") && !part.depends_on("v2"),
+		  "depends_on past 64 variables");
+	check(wide.depends_on(part.get_root(), "v68") && !wide.depends_on(part.get_root(), "v69"),
+		  "depends_on by node id");
+	check(join(part.free_vars()) == "v1 v68", "free_vars in pool order = " + join(part.free_vars()));
+	check(wide.free_vars().size() == 70, "free_vars of 70 variables");
+
+	// get_var_ids reads the same cached sets
+	auto ids = part.get_var_ids();
+	std::vector<uint32_t> want = { Symbols::find("v1"), Symbols::find("v68") };
+	std::sort(want.begin(), want.end());
+
+	check(ids == want, "get_var_ids(v68 * v1)");
+	ids = wide.get_var_ids();
+	check(ids.size() == 70 && std::is_sorted(ids.begin(), ids.end()), "get_var_ids of 70 variables, ascending");
+	check(s.get_var_ids().size() == 2 && t.get_var_ids().size() == 2, "get_var_ids after substitute");
+
+	eDAG c;
+	c.parse("2 + 3");
+	check(c.free_vars().empty() && !c.depends_on("x"), "no free variables in 2 + 3");
+}
+
+static void check_metrics() {
+	eDAG t;
+	t.parse("(x + y) * (x + y)");
+	eMetrics m = t.metrics();
+
+	// x, y, the sum and the product; the tree repeats the sum
+	check(m.dag_size == 4 && m.tree_size == 7 && m.depth == 2,
+		  "metrics((x + y) * (x + y)): dag " + std::to_string(m.dag_size) + ", tree " +
+		  std::to_string(m.tree_size) + ", depth " + std::to_string(m.depth));
+	check(m.ops[OPType::ADD] == 1 && m.ops[OPType::MULTIPLY] == 1 && m.ops.size() == 2,
+		  "metrics counts distinct op nodes per op");
+	// two leaves, two operands for each operator
+	check(m.cost == 6, "metrics cost of (x + y) * (x + y): " + std::to_string(m.cost));
+
+	t.parse("sin(x)*x + y");
+	m = t.metrics();
+	check(m.dag_size == 5 && m.tree_size == 6 && m.depth == 3 && m.cost == 26,
+		  "metrics(sin(x)*x + y): cost " + std::to_string(m.cost));
+
+	// t_k = sin(t_k-1) + t_k-1 doubles the tree 70 times over
+	std::string text = "let t1 = x + x in ";
+
+	for (int k = 2; k <= 70; ++k)
+		text += "let t" + std::to_string(k) + " = sin(t" + std::to_string(k - 1) + ") + t" + std::to_string(k - 1) + " in ";
+
+	text += "t70";
+	t.parse(text);
+	m = t.metrics();
+
+	check(m.dag_size == 140 && m.depth == 139, "metrics of a doubling chain: dag " + std::to_string(m.dag_size));
+	check(m.tree_size == UINT64_MAX, "metrics tree_size saturates at UINT64_MAX");
+}
+
+static void check_incremental() {
+	eDAG t;
+	t.parse("(x*y)^(0-1)");
+
+	IncrementalEval inc(t, { { "x", 0.0 }, { "y", 1.0 } });
+	inc.value();
+	inc.set("y", -1.0);
+
+	auto got = inc.value();
+	auto want = t.eval({ { "x", 0.0 }, { "y", -1.0 } });
+
+	check(std::holds_alternative<double>(got) &&
+		  std::get<double>(got) == -INFINITY &&
+		  got == want,
+		  "incremental (x*y)^(0-1) follows the sign of a zero product");
+}
+
+// whether the compiler accepts src, without writing anything
+static bool compiles(const std::string &src, bool c) {
+	std::string cmd = c ? "cc -fsyntax-only -x c - 2>/dev/null"
+						: "c++ -fsyntax-only -x c++ - 2>/dev/null";
+	FILE *p = ::popen(cmd.c_str(), "w");
+
+	if (!p)
+		return 0;
+
+	std::fputs(src.c_str(), p);
+	return ::pclose(p) == 0;
+}
+
+static void check_codegen() {
+	const char *cases[] = {
+		"pow * x^(1/3)",
+		"double + 1",
+		"NAN + x",
+		"M_PI + x",
+		"t0 * sin(n) + i / out",
+	};
+
+	for (const char *expr : cases) {
+		eDAG t;
+		t.parse(expr);
+
+		for (bool c : { true, false }) {
+			CodeGen::Options opt;
+			opt.c = c;
+			opt.array_loop = 1;
+
+			check(compiles(CodeGen::generate(t, opt), c),
+				  std::string("codegen(") + expr + (c ? ") compiles as C" : ") compiles as C++"));
+		}
+	}
+}
+
+static void check_jit() {
+	std::string dir = (std::filesystem::temp_directory_path() /
+					   ("cas-check 'jit' " + std::to_string(::getpid()))).string();
+
+	try {
+		eDAG t;
+		t.parse("pow * x^(1/3) + NAN");
+
+		JIT f(t, dir);
+		check(f({ { "pow", 2.0 }, { "x", 8.0 }, { "NAN", 1.0 } }) == 5.0,
+			  "jit of pow * x^(1/3) + NAN in a directory with quotes");
+	} catch (const std::exception &e) {
+		check(0, std::string("jit in a directory with quotes: ") + e.what());
+	}
+
+	// threads compiling the same new expression at once
+	eDAG t;
+	t.parse("x * y + sin(x) / 7");
+
+	std::vector<std::thread> threads;
+	std::vector<int> ok(8, 0);
+
+	for (size_t k = 0; k < ok.size(); ++k) {
+		threads.emplace_back([&, k] {
+			try {
+				JIT f(t, dir);
+				ok[k] = f({ { "x", 0.0 }, { "y", 3.0 } }) == 0.0;
+			} catch (const std::exception &) {
+			}
+		});
+	}
+
+	for (auto &th : threads)
+		th.join();
+
+	for (size_t k = 0; k < ok.size(); ++k)
+		check(ok[k], "jit thread " + std::to_string(k) + " of " + std::to_string(ok.size()));
+
+	std::filesystem::remove_all(dir);
+}
+
+// the enclosure of expr over [lo, hi] holds its value at 201 points, those
+// where it is defined
+static bool encloses(const std::string &expr, double lo, double hi) {
+	eDAG t;
+	t.parse(expr);
+	Interval r = IntervalEval(t)({ { "x", Interval(lo, hi) } });
+
+	for (int k = 0; k <= 200; ++k) {
+		double x = lo + (hi - lo) * k / 200, v;
+
+		try {
+			v = variant_to_double(t.eval({ { "x", x } }));
+		} catch (const std::runtime_error &) {
+			continue;
+		}
+
+		if (!std::isnan(v) && !r.contains(v))
+			return false;
+	}
+
+	return true;
+}
+
+static void check_interval() {
+	const std::tuple<const char*, double, double> sampled[] = {
+		{ "sin(x)", 0, 3 },
+		{ "cos(x)", -1, 4 },
+		{ "tan(x)", 1, 2 },
+		{ "x^2", -2, 3 },
+		{ "x^3", -2, 3 },
+		{ "1/x", -1, 1 },
+		{ "sin(x)*cos(x) + x^2/(x + 3)", -2, 2 },
+	};
+
+	for (const auto &[expr, lo, hi] : sampled)
+		check(encloses(expr, lo, hi), std::string("interval of ") + expr + " over [" + std::to_string(lo) + ", " +
+			  std::to_string(hi) + "] holds its samples");
+
+	// extrema inside the interval, not only the endpoints
+	Interval r = IntervalEval::sin(Interval(0, 3));
+	check(r.hi >= 1 && r.hi < 1.001 && r.lo <= 0, "sin([0, 3]) reaches 1 at pi/2");
+
+	r = IntervalEval::cos(Interval(3, 3.5));
+	check(r.lo <= -1 && r.lo > -1.001, "cos([3, 3.5]) reaches -1 at pi");
+
+	r = IntervalEval::cos(Interval(-1, 1));
+	check(r.hi >= 1 && r.hi < 1.001, "cos([-1, 1]) reaches 1 at 0");
+
+	// across the pole at pi/2, tan takes every value
+	r = IntervalEval::tan(Interval(1, 2));
+	check(std::isinf(r.lo) && std::isinf(r.hi), "tan([1, 2]) is entire");
+
+	r = IntervalEval::tan(Interval(0, 1));
+	check(std::isfinite(r.lo) && std::isfinite(r.hi) && r.contains(std::tan(1.0)), "tan([0, 1]) is finite");
+
+	// even powers of an interval around 0 start at 0, odd ones don't
+	r = IntervalEval::pow(Interval(-2, 3), Interval(2));
+	check(r.lo == 0 && r.contains(9), "[-2, 3]^2 is [0, 9]");
+
+	r = IntervalEval::pow(Interval(-2, 3), Interval(3));
+	check(r.contains(-8) && r.contains(27) && r.lo > -8.001, "[-2, 3]^3 is [-8, 27]");
+
+	// division by an interval containing 0
+	r = IntervalEval::div(Interval(1, 2), Interval(-1, 1));
+	check(std::isinf(r.lo) && std::isinf(r.hi), "[1, 2] / [-1, 1] is entire");
+
+	r = IntervalEval::div(Interval(1, 2), Interval(0, 1));
+	check(r.lo <= 1 && r.lo > 0.999 && std::isinf(r.hi), "[1, 2] / [0, 1] is [1, inf]");
+
+	check(IntervalEval::div(Interval(1, 2), Interval(0, 0)).is_empty(), "[1, 2] / [0, 0] is empty");
+	check(IntervalEval::log(Interval(-2, -1)).is_empty(), "log([-2, -1]) is empty");
+}
+
+static void check_store() {
+	std::string path = (std::filesystem::temp_directory_path() /
+						("cas-check-store." + std::to_string(::getpid()))).string();
+	std::vector<eDAG> exprs(3);
+	exprs[0].parse("x + 1");
+	exprs[1].parse("q * 2");
+	exprs[2].parse("sin(x)");
+
+	eStore::write(path, exprs);
+
+	uint32_t n;
+
+	{
+		eStore st(path);
+		n = st.root(2);
+		check(st.verify(), "store verify on a written store");
+
+		try {
+			check(st.eval(0, { { "x", 1.0 } }) == 2.0, "store eval(0) with only x bound");
+		} catch (const std::exception &e) {
+			check(0, std::string("store eval(0) with only x bound: ") + e.what());
+		}
+
+		bool threw = 0;
+
+		try {
+			st.eval(1, { { "x", 1.0 } });
+		} catch (const std::runtime_error &) {
+			threw = 1;
+		}
+
+		check(threw, "store eval(1) without q throws");
+	}
+
+	// turn sin(x) into a POWER with one operand
+	std::string data;
+	{
+		std::ifstream in(path, std::ios::binary);
+		data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	// record x + 1 as one node: verify catches it, eval throws rather
+	// than probing a table sized for one node
+	uint64_t root_off;
+	std::memcpy(&root_off, data.data() + 128, sizeof(root_off));
+
+	{
+		std::string bad = data;
+		uint32_t size = 1;
+		std::memcpy(&bad[root_off + offsetof(eStore::Root, size)], &size, sizeof(size));
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out << bad;
+	}
+
+	{
+		eStore st(path);
+		check(!st.verify(), "store verify rejects a wrong DAG size");
+
+		bool threw = 0;
+
+		try {
+			st.eval(0, { { "x", 1.0 } });
+		} catch (const std::runtime_error &) {
+			threw = 1;
+		}
+
+		check(threw, "store eval with a wrong DAG size throws");
+	}
+
+	uint64_t node_off;
+	std::memcpy(&node_off, data.data() + 80, sizeof(node_off));
+
+	data[node_off + n * sizeof(eStore::Node) + 1] = (char) OPType::POWER;
+
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out << data;
+	}
+
+	check(!eStore(path).verify(), "store verify rejects POWER with one operand");
+	std::filesystem::remove(path);
+}
+
+static void check_cache() {
+	namespace fs = std::filesystem;
+
+	std::string dir = (fs::temp_directory_path() / ("cas-check-cache." + std::to_string(::getpid()))).string();
+	fs::remove_all(dir);
+
+	{
+		eCache c(dir);
+		eDAG t;
+		t.parse("x*x + 2*x*1");
+		int computed = 0;
+
+		auto simplify = [&] {
+			++computed;
+			return t.simplify();
+		};
+
+		eDAG first = c.through(t, "check", "", simplify);
+		eDAG second = c.through(t, "check", "", simplify);
+		CacheStats st = c.stats();
+
+		check(computed == 1, "cache computes a result once, computed " + std::to_string(computed));
+		check(st.misses == 1 && st.hits == 1 && st.stores == 1,
+			  "cache stats after a miss and a hit: " + std::to_string(st.misses) + " misses, " +
+			  std::to_string(st.hits) + " hits, " + std::to_string(st.stores) + " stores");
+		check(first.fingerprint() == second.fingerprint(), "cache hit returns the stored result");
+
+		// a torn file is a miss, and is recomputed
+		std::string path = (fs::path(dir) / (eCache::key(t, "check", "") + ".casb")).string();
+		std::string data;
+		{
+			std::ifstream in(path, std::ios::binary);
+			data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+		{
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			out << data.substr(0, data.size() / 2);
+		}
+
+		c.reset_stats();
+		eDAG third = c.through(t, "check", "", simplify);
+		st = c.stats();
+
+		check(st.misses == 1 && st.hits == 0 && computed == 2, "cache counts a corrupt file as a miss");
+		check(third.fingerprint() == first.fingerprint(), "cache recomputes over a corrupt file");
+	}
+
+	fs::remove_all(dir);
+
+	// four results of one size in room for three and a half: the fourth
+	// evicts down to 3/4 of that, the two least recently used
+	std::vector<eDAG> t(4);
+	std::vector<std::string> keys;
+
+	for (size_t k = 0; k < t.size(); ++k) {
+		t[k].parse("x" + std::to_string(k) + " + 1");
+		keys.push_back(eCache::key(t[k], "check", ""));
+	}
+
+	uint64_t size = t[0].serialize().size();
+
+	{
+		eCache c(dir, size * 7 / 2);
+		auto now = fs::file_time_type::clock::now();
+
+		for (size_t k = 0; k < 3; ++k) {
+			c.put(keys[k], t[k]);
+			fs::last_write_time(fs::path(dir) / (keys[k] + ".casb"), now - std::chrono::seconds(300 - 100 * k));
+		}
+
+		// touch the oldest
+		eDAG out;
+		check(c.get(keys[0], out), "cache get before eviction");
+
+		c.put(keys[3], t[3]);
+
+		bool kept[4];
+
+		for (size_t k = 0; k < 4; ++k)
+			kept[k] = fs::exists(fs::path(dir) / (keys[k] + ".casb"));
+
+		check(kept[0] && !kept[1] && !kept[2] && kept[3], "cache evicts the least recently used results");
+		check(c.stats().evictions == 2, "cache evictions: " + std::to_string(c.stats().evictions));
+		check(c.bytes() <= size * 7 / 2 / 4 * 3, "cache under 3/4 of max_bytes after eviction");
+	}
+
+	fs::remove_all(dir);
+}
+
+static void check_pool() {
+	auto p = ePool::create();
+
+	// nodes only a dropped eDAG reached are freed, shared ones stay
+	eDAG a(p);
+	a.parse("x + y");
+
+	{
+		eDAG b(p);
+		b.parse("(x + y) * z");
+	}
+
+	size_t before = p->size();
+	size_t freed = p->collect();
+
+	check(freed == 2 && p->size() == before - 2, "collect frees z and the product, freed " + std::to_string(freed));
+	check(a.to_string() == "x + y", "collect keeps the nodes of live eDAGs: " + a.to_string());
+
+	// threads interning at once: equal expressions get one node id
+	std::vector<std::unique_ptr<eDAG>> es;
+	std::vector<std::string> shared(8), own(8);
+
+	for (size_t k = 0; k < shared.size(); ++k)
+		es.push_back(std::make_unique<eDAG>(p));
+
+	std::vector<std::thread> threads;
+
+	for (size_t k = 0; k < shared.size(); ++k) {
+		threads.emplace_back([&, k] {
+			eDAG &t = *es[k];
+			t.parse("sin(a*b) + c");
+			shared[k] = t.get_root();
+			t.parse("w" + std::to_string(k) + " + sin(a*b)");
+			own[k] = t.get_root();
+		});
+	}
+
+	for (auto &th : threads)
+		th.join();
+
+	bool same = 1;
+
+	for (size_t k = 1; k < shared.size(); ++k)
+		same = same && shared[k] == shared[0] && own[k] != own[0];
+
+	check(same, "threads interning sin(a*b) + c get one node id");
+
+	// the first roots are gone: x, y and x + y stay, then a, b, a*b and
+	// sin(a*b), then w_k and w_k + sin(a*b) per thread
+	p->collect();
+	check(p->size() == 3 + 4 + 2 * shared.size(), "pool size after concurrent interning: " + std::to_string(p->size()));
+}
+
+static void check_symbols() {
+	eDAG t;
+	t.parse("x + 1");
+	size_t before = Symbols::size();
+	size_t literals = Literals::size();
+
+	for (int k = 0; k < 1000; ++k) {
+		eDAG c;
+		c.set_arena(k % 2);
+		c.parse("x * " + std::to_string(k) + ".25 + " + std::to_string(k * 7919));
+	}
+
+	check(Symbols::size() == before, "constants are not interned in Symbols");
+	check(Literals::size() == literals, "literal text is freed with its nodes");
+
+	eDAG c;
+	c.parse("3.14 * x");
+	eDAG back;
+	back.deserialize(c.serialize());
+	check(back.to_string() == c.to_string(), "constant text survives serialize: " + back.to_string());
+
+	size_t old = Symbols::limit();
+	Symbols::set_limit(Symbols::size());
+	bool threw = 0;
+
+	try {
+		eDAG v;
+		v.parse("a_name_not_seen_before + 1");
+	} catch (const std::runtime_error &) {
+		threw = 1;
+	}
+
+	Symbols::set_limit(old);
+	check(threw, "a new name past the symbol limit throws");
+}
+
+// copies share the pool; passes on a copy intern only what they change
+static void check_copy() {
+	std::string text = "sin(x)";
+
+	for (int k = 1; k < 300; ++k)
+		text += " + " + std::to_string(k) + " * cos(x" + std::to_string(k) + ")";
+
+	eDAG a;
+	a.parse(text);
+	std::string root = a.get_root(), printed = a.to_string();
+	size_t size = a.size(), pooled = a.get_pool()->size();
+
+	eDAG c = a;
+	check(c.get_pool().get() == a.get_pool().get(), "a copy shares the pool");
+	check(a.get_pool()->size() == pooled, "copying interns nothing");
+
+	c.add_var("fresh");
+	eDAG d = c.substitute({ { "x", "y + 1" } });
+
+	check(d.get_pool().get() == a.get_pool().get(), "substitute on a copy stays in the pool");
+	check(a.get_pool()->size() - pooled < 10, "substitute interns only the changed path: " + std::to_string(a.get_pool()->size() - pooled));
+	check(a.get_root() == root && a.size() == size && a.to_string() == printed, "nodes added through a copy leave the original as it was");
+	check(d.to_string().find("sin(y + 1)") != std::string::npos, "substitute on a copy: " + d.to_string().substr(0, 40));
+
+	pooled = a.get_pool()->size();
+	eDAG e = a.simplify_exact();
+
+	check(e.get_pool().get() == a.get_pool().get(), "simplify_exact stays in the pool");
+	check(a.get_pool()->size() - pooled < size / 10, "simplify_exact does not copy the expression: " + std::to_string(a.get_pool()->size() - pooled));
+	check(a.get_root() == root && a.to_string() == printed, "simplify_exact leaves its source as it was");
+}
+
+static void check_arena() {
+	std::shared_ptr<eNode> keep, child;
+	std::string text;
+
+	{
+		eDAG t;
+		t.set_arena(1);
+		t.parse("x + y * 2");
+		check(t.uses_arena(), "parse keeps an arena pool");
+
+		auto v = t.eval({{"x", int64_t(1)}, {"y", int64_t(3)}});
+		check(std::get<int64_t>(v) == 7, "eval on an arena pool");
+
+		keep = t.get_node(t.get_root());
+		child = t.get_node(t.get_pool()->children(t.get_root())[1]);
+		text = t.to_string();
+	}
+
+	// the eDAG and its pool are gone, the handles keep the arena
+	check(keep->type == NodeType::OPERATION && keep->op == OPType::ADD, "root node outlives its arena pool");
+	check(child->to_string() == "*", "child node outlives its arena pool: " + child->to_string());
+	check(text == "x + y * 2", "arena parse prints: " + text);
+}
+
+// how deserialize took data: 0 loaded, 1 runtime_error, 2 anything else
+static int load(const std::string &data) {
+	try {
+		eDAG t;
+		t.deserialize(data);
+		return 0;
+	} catch (const std::runtime_error &) {
+		return 1;
+	} catch (...) {
+		return 2;
+	}
+}
+
+// data with its checksum recomputed, so the payload itself is what is read
+static std::string resealed(std::string data) {
+	size_t pos = 5;
+
+	while ((uint8_t) data[pos++] & 0x80) {}
+
+	uint64_t sum = utils::fnv1a(data.data() + pos + 8, data.size() - pos - 8);
+
+	for (int k = 0; k < 8; ++k)
+		data[pos + k] = (char) (sum >> (8 * k));
+
+	return data;
+}
+
+static void check_serialize() {
+	const char *cases[] = {
+		// INT, RAT from a decimal and from a division, shared operands
+		"3*x + 0.5*y - (x + y)*(x + y) / 7",
+		// DBL: too many digits for an int64 rational
+		"x * 0.1234567190123456789 + 2.71828182845904523536",
+		// BIG: denominators past 32 bits
+		"x + 0.0000000001234 - 123456.0000000001",
+		// every unary operator, and a negative power
+		"-sin(x) + cos(-x) * tan(x) - log(abs(x)) / exp(sqrt(x)) + x^-2",
+		// one leaf
+		"x",
+		"42",
+		// names that need the symbol table
+		"alpha_1 * beta + alpha_1 ^ gamma",
+	};
+
+	for (const char *expr : cases) {
+		eDAG t;
+		t.parse(expr);
+
+		std::string data = t.serialize();
+		eDAG back;
+		back.deserialize(data);
+
+		check(back.fingerprint() == t.fingerprint(), std::string("serialize round trip keeps the fingerprint: ") + expr);
+		check(back.to_string() == t.to_string(), std::string("serialize round trip keeps the text: ") + expr + " -> " + back.to_string());
+		check(back.size() == t.size(), std::string("serialize round trip keeps shared nodes shared: ") + expr);
+
+		// the stream overload reads one record and leaves the next
+		std::stringstream two(data + data);
+		eDAG a, b;
+		a.deserialize(two);
+		b.deserialize(two);
+		check(a.fingerprint() == t.fingerprint() && b.fingerprint() == t.fingerprint(),
+			  std::string("two records back to back: ") + expr);
+	}
+
+	eDAG t;
+	t.parse("-sin(x)^2 + 0.5 * (x + y) * (x + y) - 0.0000000001234 * 2.71828182845904523536");
+	std::string data = t.serialize();
+
+	for (size_t n = 0; n < data.size(); ++n)
+		check(load(data.substr(0, n)) == 1, "truncated to " + std::to_string(n) + " bytes throws runtime_error");
+
+	check(load(data + "x") == 1, "trailing bytes throw runtime_error");
+
+	// any flipped bit fails the header, the size or the checksum
+	for (size_t j = 0; j < data.size(); ++j) {
+		for (int bit = 0; bit < 8; ++bit) {
+			std::string bad = data;
+			bad[j] ^= (char) (1 << bit);
+			check(load(bad) == 1, "bit " + std::to_string(bit) + " of byte " + std::to_string(j) + " flipped throws runtime_error");
+		}
+	}
+
+	// with the checksum fixed up, a corrupt payload either loads or throws
+	// runtime_error, never anything else
+	for (size_t j = 0; j < data.size(); ++j) {
+		for (int v : { 0x00, 0x01, 0x7f, 0x80, 0xff }) {
+			std::string bad = data;
+			bad[j] = (char) v;
+
+			if (j >= 5 + 1 + 8)
+				bad = resealed(bad);
+
+			check(load(bad) != 2, "byte " + std::to_string(j) + " set to " + std::to_string(v) + " loads or throws runtime_error");
+		}
+	}
+}
+
+// canonicalize does not depend on the order the input was written in, also
+// for doubles that agree to six decimals
+static void check_canonical() {
+	const std::vector<std::vector<const char*>> groups = {
+		{ "a*b + c - sin(a + b)", "c + b*a - sin(b + a)", "(c + a*b) - sin(b + a)" },
+		{ "sin(0.1234567190123456789) + sin(0.1234567290123456789) + x",
+		  "x + sin(0.1234567290123456789) + sin(0.1234567190123456789)",
+		  "sin(0.1234567290123456789) + x + sin(0.1234567190123456789)" },
+		{ "(x - y) / (x - y)^2 + (y - x) * z", "z * (y - x) + (x - y) / (x - y)^2" },
+	};
+
+	for (const auto &group : groups) {
+		eDAG first;
+		first.parse(group[0]);
+		std::string want = first.canonicalize().to_string();
+
+		for (const char *expr : group) {
+			eDAG t;
+			t.parse(expr);
+			std::string got = t.canonicalize().to_string();
+			check(got == want, std::string("canonicalize(") + expr + ") = " + got + ", want " + want);
+		}
+	}
+
+	// distinct doubles stay distinct constants
+	eDAG t;
+	t.parse("0.1234567190123456789 - 0.1234567290123456789");
+	check(t.size() == 3, "two doubles equal to six decimals are two nodes");
+}
+
+// printed text, plain and with let bindings, parses back to the same
+// expression
+static void check_print() {
+	const char *cases[] = {
+		"(x + y) * (x + y) - sin(x + y)",
+		"-(a - b) / (a - b)^(1/2)",
+		"2^3^2 + (2^3)^2",
+		"-x^2 + (-x)^2",
+		"a - (b - c) - (a - b) * (a - b)",
+		"t1 * (t1 + 1) * (t1 + 1)",
+		"exp(log(x) / 2) + 0.5 * exp(log(x) / 2)",
+		"x / (y / z) + abs(x / (y / z))",
+	};
+
+	for (const char *expr : cases) {
+		eDAG t;
+		t.parse(expr);
+
+		for (bool let : { false, true }) {
+			std::string text = t.to_string(let);
+			eDAG back;
+			back.parse(text);
+			check(back.fingerprint() == t.fingerprint(),
+				  std::string("parse(to_string(") + expr + ", " + (let ? "let" : "plain") + ")) = " + text);
+		}
+	}
+
+	eDAG t;
+	t.parse("(x + y) * (x + y)");
+	check(t.to_string(1) == "let t1 = x + y in t1 * t1", "let binding: " + t.to_string(1));
+	check(t.to_latex(1) == "\\mathrm{let}\\ t_{1} = x + y\\ \\mathrm{in}\\ t_{1} \\cdot t_{1}",
+		  "let binding in LaTeX: " + t.to_latex(1));
+
+	// let and in are keywords only inside a binding, else plain variables
+	const std::pair<const char*, const char*> names[] = {
+		{ "let + 1", "let + 1" },
+		{ "in * 2", "in * 2" },
+		{ "let * in", "let * in" },
+		{ "sin(let) + in", "sin(let) + in" },
+		{ "let t = in + 1 in t * let", "(in + 1) * let" },
+		{ "let in = x in in + 1", "x + 1" },
+	};
+
+	for (const auto &[text, want] : names) {
+		std::string got;
+
+		try {
+			eDAG v;
+			v.parse(text);
+			got = v.to_string();
+		} catch (const std::runtime_error &e) {
+			got = e.what();
+		}
+
+		check(got == want, std::string("parse(") + text + ") = " + got + ", want " + want);
+	}
+
+	eDAG both;
+	both.parse("(let + in) * (let + in)");
+	eDAG again;
+	again.parse(both.to_string(1));
+	check(again.to_string() == both.to_string(), "let binding of let + in parses back: " + both.to_string(1));
+}
+
+static void check_number() {
+	auto threw = [](const std::function<Number()> &f, const std::string &what) {
+		try {
+			f();
+		} catch (const std::runtime_error &e) {
+			return std::string(e.what()) == what;
+		}
+
+		return false;
+	};
+
+	Number min(INT64_MIN), max(INT64_MAX);
+
+	check(threw([&] { return -min; }, "NEGATE overflow."), "-INT64_MIN throws NEGATE overflow");
+	check(threw([&] { return max + Number(1); }, "ADD overflow."), "INT64_MAX + 1 throws ADD overflow");
+	check(threw([&] { return min - Number(1); }, "SUB overflow."), "INT64_MIN - 1 throws SUB overflow");
+	check((-max).as_int() == -INT64_MAX, "-INT64_MAX");
+
+	// integer results stay INT, whatever the operands
+	check((Number(2) + Number(3)).kind() == Number::Kind::INT, "2 + 3 is an INT");
+	check((Number(2) - Number(3)).kind() == Number::Kind::INT, "2 - 3 is an INT");
+	check((Number(2) * Number(3)).kind() == Number::Kind::INT, "2 * 3 is an INT");
+	check((Number(6) / Number(3)).kind() == Number::Kind::INT, "6 / 3 is an INT");
+	check((Number(Rational(1, 2)) + Number(Rational(1, 2))).kind() == Number::Kind::INT, "1/2 + 1/2 is an INT");
+	check((Number(1) / Number(2)).kind() == Number::Kind::RAT, "1 / 2 is a RAT");
+
+	// b * d overflows but the lcm of the denominators doesn't, as in Rational
+	Number p(Rational(1, 4000000007)), q(Rational(3, 4000000007));
+	check((p + p).to_rational().pair() == Rational(2, 4000000007).pair(), "1/4000000007 + 1/4000000007");
+	check((q - p).to_rational().pair() == Rational(2, 4000000007).pair(), "3/4000000007 - 1/4000000007");
+	check(threw([&] { return Number(Rational(1, 4000000007)) + Number(Rational(1, 4000000009)); }, "MUL overflow."),
+		  "1/4000000007 + 1/4000000009 still throws MUL overflow");
+
+	eDAG big;
+	big.parse("1/4000000007 + 1/4000000007 + x");
+	auto sum = big.eval({ { "x", int64_t(1) } });
+	check(std::holds_alternative<Rational>(sum) && std::get<Rational>(sum).pair() == Rational(4000000009, 4000000007).pair(),
+		  "eval(1/4000000007 + 1/4000000007 + x)");
+
+	eDAG t;
+	t.parse("x + y + 1");
+	auto v = t.eval({ { "x", int64_t(2) }, { "y", int64_t(3) } });
+	check(std::holds_alternative<int64_t>(v) && std::get<int64_t>(v) == 6, "eval(x + y + 1) over ints is an int64_t");
+}
+
+// Products whose box is small next to the number of term pairs go through
+// Kronecker substitution (mul_dense), the rest through the heap (mul_heap).
+static void check_poly_mul() {
+	std::mt19937 rng(7);
+
+	auto random_poly = [&](const std::vector<std::string> &vars, int terms, uint32_t deg) {
+		Polynomial p;
+
+		for (int t = 0; t < terms; ++t) {
+			int64_t c = (int64_t) (rng() % 19) - 9;
+			Polynomial m = Polynomial::constant(Rational(c ? c : 1, 1));
+
+			for (const auto &v : vars)
+				m = m * Polynomial::variable(v).pow(rng() % (deg + 1));
+
+			p = p + m;
+		}
+
+		return p;
+	};
+
+	// one term of a times b at a time, summed with +: no row merging
+	auto schoolbook = [](const Polynomial &a, const Polynomial &b) {
+		Polynomial r;
+
+		for (size_t t = 0; t < a.size(); ++t) {
+			Polynomial m = Polynomial::constant(a.coeff(t));
+			auto e = a.exponents(t);
+
+			for (size_t k = 0; k < e.size(); ++k)
+				m = m * Polynomial::variable(a.variables()[k]).pow(e[k]);
+
+			r = r + m * b;
+		}
+
+		return r;
+	};
+
+	// a factor of z^(2^20) makes the box too large for the dense path
+	Polynomial pad = Polynomial::variable("z").pow(1 << 20);
+
+	for (int round = 0; round < 20; ++round) {
+		Polynomial a = random_poly({ "x", "y" }, 20, 6), b = random_poly({ "x", "y" }, 20, 6);
+		Polynomial dense = a * b;
+		Polynomial heap = a * (b + pad) - a * pad;
+
+		check(dense == heap, "dense and heap products agree, round " + std::to_string(round));
+		check(dense == schoolbook(a, b), "dense product matches term by term, round " + std::to_string(round));
+
+		Polynomial c = random_poly({ "x", "y", "w" }, 8, 40), d = random_poly({ "x", "y", "w" }, 8, 40);
+		check(c * d == schoolbook(c, d), "sparse heap product matches term by term, round " + std::to_string(round));
+
+		std::unordered_map<std::string, Rational> at = {
+			{ "x", Rational((int64_t) (rng() % 5) - 2, 3) },
+			{ "y", Rational((int64_t) (rng() % 5) - 2, 5) },
+			{ "w", Rational(1, 2) },
+		};
+
+		check((a * b).evaluate(at).pair() == (a.evaluate(at) * b.evaluate(at)).pair(), "dense product evaluates as the factors");
+	}
+
+	// 10 variables of degree < 256 take two words
+	Polynomial sum = Polynomial::constant(Rational(1, 1));
+
+	for (int k = 0; k < 10; ++k)
+		sum = sum + Polynomial::variable("v" + std::to_string(k));
+
+	Polynomial sq = sum * sum;
+	std::unordered_map<std::string, Rational> ones;
+
+	for (int k = 0; k < 10; ++k)
+		ones.emplace("v" + std::to_string(k), Rational(1, 1));
+
+	check(sq.size() == 66, "(1 + v0 + ... + v9)^2 has 66 terms: " + std::to_string(sq.size()));
+	check(sq.evaluate(ones).pair() == Rational(121, 1).pair(), "(1 + v0 + ... + v9)^2 at ones is 121");
+	check(sq == schoolbook(sum, sum), "two-word product matches term by term");
+
+	// degree 600 needs 16-bit fields, so 5 variables take two words
+	Polynomial a = Polynomial::variable("a"), rest;
+
+	for (const char *v : { "b", "c", "d", "e" })
+		rest = rest + Polynomial::variable(v);
+
+	Polynomial high = a.pow(300);
+	check((high + rest) * (high - rest) == a.pow(600) - rest * rest, "(a^300 + r)(a^300 - r) with 16-bit fields");
+
+	// and degree 80000 needs 32-bit ones
+	Polynomial x = Polynomial::variable("x"), one = Polynomial::constant(Rational(1, 1));
+	Polynomial p = (x.pow(40000) + one) * (x.pow(40000) - one);
+	check(p == x.pow(80000) - one && p.degree("x") == 80000, "(x^40000 + 1)(x^40000 - 1) with 32-bit fields");
+
+	// eDAG -> expand -> eDAG keeps the value and the polynomial
+	for (const char *text : { "(x + 1) * (x - 1) * (y + 2)", "(x - y)^3 - 2 * (x + y) * x", "(x + 1/2)^2 * (y - 1/3)" }) {
+		eDAG t;
+		t.parse(text);
+		eDAG e = Polynomial::expand(t);
+
+		check(Polynomial::from_edag(e) == Polynomial::from_edag(t), std::string("expand keeps the polynomial of ") + text);
+		check(eDAG::equivalent(t, e), std::string("expand keeps the value of ") + text + ": " + e.to_string());
+	}
+
+	eDAG mixed;
+	mixed.parse("sin(x) + (x + 1)^2");
+	check(Polynomial::expand(mixed).to_string() == "sin(x) + x^2 + 2 * x + 1", "expand keeps non-polynomial parts: " + Polynomial::expand(mixed).to_string());
+
+	// int64 coefficients: 2^32 squared does not fit
+	bool threw = 0;
+
+	try {
+		eDAG big;
+		big.parse("(x + 4294967296)^2");
+		Polynomial::expand(big);
+	} catch (const std::runtime_error &e) {
+		threw = std::string(e.what()) == "polynomial coefficient overflow.";
+	}
+
+	check(threw, "expanding past int64 coefficients throws polynomial coefficient overflow");
+}
+
+static void check_gcd() {
+	Polynomial x = Polynomial::variable("x");
+
+	auto gcd = [](const Polynomial &a, const Polynomial &b) {
+		std::ostringstream out;
+
+		try {
+			out << Polynomial::gcd(a, b);
+		} catch (const std::exception &e) {
+			out << e.what();
+		}
+
+		return out.str();
+	};
+
+	// non-monic: the gcd is made monic
+	Polynomial p = x * Rational(2, 1) + Polynomial::constant(Rational(3, 1));
+	std::string got = gcd(p * (x - Polynomial::constant(Rational(1, 1))), p * x);
+	check(got == "1*x + 3/2", "gcd((2x+3)(x-1), (2x+3)x) = " + got);
+
+	// 999999999989/1000000007 needs a modulus of 2^71, three primes
+	p = x * Rational(1000000007, 1) + Polynomial::constant(Rational(999999999989LL, 1));
+	got = gcd(p * (x + Polynomial::constant(Rational(1, 1))), p * (x - Polynomial::constant(Rational(2, 1))));
+	check(got == "1*x + 999999999989/1000000007", "gcd over three primes = " + got);
+
+	// numerator and denominator near 2^63 need a modulus of 2^127, five primes
+	p = x * Rational(9223372036854775749LL, 1) + Polynomial::constant(Rational(9223372036854775783LL, 1));
+	got = gcd(p * x, p);
+	check(got == "1*x + 9223372036854775783/9223372036854775749", "gcd with 63-bit coefficients = " + got);
+
+	got = gcd(x + Polynomial::constant(Rational(1, 1)), x - Polynomial::constant(Rational(1, 1)));
+	check(got == "1", "gcd(x+1, x-1) = " + got);
+}
+
+static void check_factor_rationals() {
+	const std::pair<const char*, const char*> cases[] = {
+		{ "(x^2 - 1)/(x - 1)", "x + 1" },
+		{ "(2*x^2 - 2)/(4*x - 4)", "1/2 * x + 1/2" },
+		{ "(x^2 + 3*x + 2)/(x^2 + 4*x + 3)", "(x + 2) / (x + 3)" },
+		{ "(x + 1)/(x + 2)", "(x + 1) / (x + 2)" },
+		// multivariate: left as written
+		{ "(x*y)/x", "x * y / x" },
+	};
+
+	for (const auto &[in, want] : cases) {
+		eDAG t;
+		t.parse(in);
+		std::string got = t.factor_rationals().to_string();
+		check(got == want, std::string("factor_rationals(") + in + ") = " + got + ", want " + want);
+	}
+
+	// n quotients nested in their numerators: each operand is classified
+	// once, so 4x the depth should take about 4x as long; 16x is quadratic.
+	// Best of three runs, to keep timer noise out.
+	auto seconds = [](int n) {
+		std::string text = "x";
+
+		for (int k = 1; k <= n; ++k)
+			text = "(" + text + " + " + std::to_string(k % 7 + 1) + ")/(x + " + std::to_string(k % 5 + 1) + ")";
+
+		eDAG t;
+		t.parse(text);
+		double best = 1e9;
+
+		for (int r = 0; r < 3; ++r) {
+			auto start = std::chrono::steady_clock::now();
+			t.factor_rationals();
+			std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+			best = std::min(best, took.count());
+		}
+
+		return best;
+	};
+
+	double small = seconds(200), large = seconds(800);
+
+	check(large < 10 * std::max(small, 1e-3),
+		  "factor_rationals linear in nested quotients: " + std::to_string(small) + " s at depth 200, " +
+		  std::to_string(large) + " s at depth 800");
+}
+
+static void check_like_terms() {
+	eDAG t;
+	t.parse("2*x + 3*x");
+	check(t.combine_like_terms().to_string() == "5 * x",
+		  "combine_like_terms(2*x + 3*x) = " + t.combine_like_terms().to_string());
+
+	// exponents that overflow int64 are left as written, not wrapped
+	eDAG big;
+	big.parse("x^9223372036854775807 * x^9223372036854775807 + y");
+
+	try {
+		std::string r = big.combine_like_terms().to_string();
+		check(r.find("x^-2") == std::string::npos && r.find("x ^ -2") == std::string::npos,
+			  "combine_like_terms keeps overflowing exponents: " + r);
+	} catch (const std::exception &e) {
+		check(0, std::string("combine_like_terms with overflowing exponents: ") + e.what());
+	}
+
+	// a flat sum of 2^k products of up to k variables, (1+a)(1+b)... expanded,
+	// built through Polynomial since parsing one is quadratic. 8x the terms
+	// should take about 8x as long, times the longer products; 64x is
+	// quadratic. Best of three runs, to keep timer noise out.
+	auto seconds = [](int k, bool &same) {
+		Polynomial p = Polynomial::constant(Rational(1, 1));
+
+		for (int j = 0; j < k; ++j)
+			p = p * (Polynomial::variable(std::string(1, 'a' + j)) + Polynomial::constant(Rational(1, 1)));
+
+		eDAG t = p.to_edag();
+		double best = 1e9;
+
+		for (int r = 0; r < 3; ++r) {
+			auto start = std::chrono::steady_clock::now();
+			eDAG c = t.combine_like_terms();
+			std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+			best = std::min(best, took.count());
+			same = (Polynomial::from_edag(c) == p);
+		}
+
+		return best;
+	};
+
+	bool same_small = 0, same_large = 0;
+	double small = seconds(10, same_small), large = seconds(13, same_large);
+
+	check(same_small && same_large, "combine_like_terms keeps a sum without like terms");
+	check(large < 40 * std::max(small, 1e-3),
+		  "combine_like_terms linear in the sum: " + std::to_string(small) + " s for 2^10 terms, " +
+		  std::to_string(large) + " s for 2^13");
+}
+
+int main() {
+	check_rewrite();
+	check_rewrite_nary();
+	check_fold();
+	check_equivalent();
+	check_fingerprint();
+	check_substitute();
+	check_free_vars();
+	check_metrics();
+	check_incremental();
+	check_codegen();
+	check_jit();
+	check_interval();
+	check_store();
+	check_cache();
+	check_pool();
+	check_symbols();
+	check_arena();
+	check_copy();
+	check_print();
+	check_canonical();
+	check_serialize();
+	check_number();
+	check_poly_mul();
+	check_gcd();
+	check_factor_rationals();
+	check_like_terms();
+
+	if (failures) {
+		std::cout << failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}
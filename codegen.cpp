@@ -0,0 +1,424 @@
+#include "codegen.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+// operand levels, lowest binds loosest: a + b, a * b, -a, atoms and calls
+enum : int { SUM = 1, PRODUCT = 2, UNARY = 3, ATOM = 4 };
+
+// longest operand text inlined into its parent
+static const size_t max_inline = 256;
+
+CodeGen::CodeGen(const eDAG &dag, const Options &opt) : dag(dag), opt(opt) {
+	if (dag.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	// parameters are v_<name> and temporaries t<k>, so they never clash
+	this->tmp_prefix = "t";
+
+	for (const auto &v : parameters(dag)) {
+		if (parameter_name(v) == opt.name) {
+			throw std::runtime_error("codegen: parameter {" + opt.name + "} has the function's name.");
+		}
+	}
+}
+
+bool CodeGen::is_builtin(const std::string &name) {
+	return (name == "pi" || name == "PI" || name == "e" || name == "tau" || name == "TAU");
+}
+
+// text that reads back as exactly v
+std::string CodeGen::number(double v) {
+	if (std::isnan(v))
+		return "NAN";
+
+	if (std::isinf(v))
+		return v < 0 ? "-HUGE_VAL" : "HUGE_VAL";
+
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.17g", v);
+	std::string s = buf;
+
+	if (s.find_first_of(".e") == std::string::npos)
+		s += ".0";
+
+	return s;
+}
+
+std::string CodeGen::literal(const Number &v) {
+	if (v.is_exact()) {
+		Rational r = v.to_rational();
+
+		// int64 -> double rounds like the decimal literal does
+		if (r.denominator() == 1)
+			return std::to_string(r.numerator()) + ".0";
+
+		return "(" + std::to_string(r.numerator()) + ".0 / " + std::to_string(r.denominator()) + ".0)";
+	}
+
+	return number(v.to_double());
+}
+
+std::string CodeGen::fn(const char *name) const {
+	return (this->opt.c ? "" : "std::") + std::string(name);
+}
+
+std::string CodeGen::temp(const std::string &value) {
+	std::string t = this->tmp_prefix + std::to_string(this->next++);
+	this->body += "\tconst double " + t + " = " + value + ";\n";
+	return t;
+}
+
+std::string CodeGen::atom(const std::string &id) {
+	if (this->level.at(id) < ATOM) {
+		this->expr[id] = this->temp(this->expr[id]);
+		this->level[id] = ATOM;
+	}
+
+	return this->expr[id];
+}
+
+// value of a subtree of constants, such as the -2 and 1/2 in x^-2 and
+// x^(1/2), which the parser keeps as operators. Exact parts stay exact, as
+// in eval(). The children were emitted first, so their values are in consts.
+bool CodeGen::fold(const std::string &id, Number &v) const {
+	auto node = this->dag.pool->node(id);
+
+	if (node->type == NodeType::CONSTANT) {
+		v = node->value;
+		return 1;
+	}
+
+	if (!node->is_op())
+		return 0;
+
+	std::vector<Number> a;
+
+	for (const auto &c : this->dag.pool->children(id)) {
+		auto it = this->consts.find(c);
+
+		if (it == this->consts.end())
+			return 0;
+
+		a.push_back(it->second);
+	}
+
+	try {
+		switch (node->op) {
+			case OPType::ADD:
+				v = a[0];
+				for (size_t k = 1; k < a.size(); ++k)
+					v = v + a[k];
+				return 1;
+			case OPType::SUBTRACT:
+				v = a[0] - a[1];
+				return 1;
+			case OPType::MULTIPLY:
+				v = a[0];
+				for (size_t k = 1; k < a.size(); ++k)
+					v = v * a[k];
+				return 1;
+			case OPType::DIVIDE:
+				if (a[1].is_zero())
+					return 0;
+
+				v = a[0] / a[1];
+				return 1;
+			case OPType::NEGATE:
+				v = -a[0];
+				return 1;
+			default:
+				return 0;
+		}
+	} catch (const std::runtime_error &) {
+		// overflow: leave it to the generated code
+		return 0;
+	}
+}
+
+bool CodeGen::constant(const std::string &id, Number &v) const {
+	auto it = this->consts.find(id);
+
+	if (it == this->consts.end())
+		return 0;
+
+	v = it->second;
+	return 1;
+}
+
+bool CodeGen::small_int(const std::string &id, int64_t &n) const {
+	Number v;
+
+	if (!this->constant(id, v) || !v.is_exact())
+		return 0;
+
+	Rational r = v.to_rational();
+
+	if (r.denominator() != 1 || r.numerator() < -64 || r.numerator() > 64)
+		return 0;
+
+	n = r.numerator();
+	return 1;
+}
+
+bool CodeGen::is_half(const std::string &id) const {
+	Number v;
+
+	return this->constant(id, v) && v.is_exact() && v.to_rational() == Rational(1, 2);
+}
+
+std::string CodeGen::square(const std::string &a) {
+	auto it = this->squares.find(a);
+
+	if (it != this->squares.end())
+		return it->second;
+
+	return this->squares[a] = this->temp(a + " * " + a);
+}
+
+// base^n by squaring: the squares become temporaries
+std::string CodeGen::power(const std::string &base, int64_t n) {
+	uint64_t m = (n < 0) ? -(uint64_t) n : (uint64_t) n;
+
+	if (m == 0)
+		return "1.0";
+
+	std::string b = this->atom(base);
+	std::vector<std::string> terms;
+
+	if (m == 1) {
+		terms.push_back(b);
+	} else if (m <= 3) {
+		terms.push_back(this->square(b));
+
+		if (m == 3)
+			terms.push_back(b);
+	} else {
+		std::string cur = b;
+
+		while (m) {
+			if (m & 1)
+				terms.push_back(cur);
+
+			m >>= 1;
+
+			if (m)
+				cur = this->square(cur);
+		}
+	}
+
+	std::string e = terms[0];
+
+	for (size_t j = 1; j < terms.size(); ++j)
+		e += " * " + terms[j];
+
+	if (n > 0)
+		return e;
+
+	return "1.0 / " + (terms.size() > 1 ? "(" + e + ")" : e);
+}
+
+void CodeGen::emit(const std::string &id) {
+	const auto &node = this->dag.pool->node(id);
+
+	if (node->type == NodeType::VARIABLE) {
+		const std::string &s = node->symbol();
+
+		if (!is_builtin(s))
+			this->expr[id] = parameter_name(s);
+		else if (s == "pi" || s == "PI")
+			this->expr[id] = number(M_PI);
+		else if (s == "e")
+			this->expr[id] = number(std::exp(1));
+		else
+			this->expr[id] = number(2 * M_PI);
+
+		this->level[id] = ATOM;
+		return;
+	}
+
+	// constants, and operators over constants only
+	Number v;
+
+	if (this->fold(id, v)) {
+		this->consts[id] = v;
+		this->expr[id] = literal(v);
+		this->level[id] = (this->expr[id][0] == '-') ? UNARY : ATOM;
+		return;
+	}
+
+	if (!node->is_op()) {
+		throw std::runtime_error("codegen: unsupported node: " + node->symbol());
+	}
+
+	const auto &kids = this->dag.pool->children(id);
+
+	// operand k of an operator at level lv; operands after the first need
+	// a tighter level so the evaluation order matches eval()
+	auto arg = [&](size_t k, int lv) {
+		const std::string &c = kids[k];
+		bool wrap = (k == 0) ? this->level.at(c) < lv : this->level.at(c) <= lv;
+		return wrap ? "(" + this->expr.at(c) + ")" : this->expr.at(c);
+	};
+
+	auto join = [&](const char *sep, int lv) {
+		std::string s = arg(0, lv);
+
+		for (size_t k = 1; k < kids.size(); ++k)
+			s += sep + arg(k, lv);
+
+		return s;
+	};
+
+	auto call = [&](const char *name) {
+		return this->fn(name) + "(" + this->expr.at(kids[0]) + ")";
+	};
+
+	std::string e;
+	int lv = ATOM;
+	int64_t n;
+
+	switch (node->op) {
+		case OPType::ADD:
+			e = join(" + ", SUM);
+			lv = SUM;
+			break;
+		case OPType::SUBTRACT:
+			e = join(" - ", SUM);
+			lv = SUM;
+			break;
+		case OPType::MULTIPLY:
+			e = join(" * ", PRODUCT);
+			lv = PRODUCT;
+			break;
+		case OPType::DIVIDE: {
+			double r = this->constant(kids[1], v) ? 1 / v.to_double() : 0;
+
+			if (this->opt.strength_reduce && r != 0 && std::isfinite(r)) {
+				e = arg(0, PRODUCT) + " * " + number(r);
+			} else {
+				e = join(" / ", PRODUCT);
+			}
+			lv = PRODUCT;
+			break;
+		}
+		case OPType::POWER:
+			if (this->opt.strength_reduce && this->small_int(kids[1], n)) {
+				e = this->power(kids[0], n);
+				lv = (e.find(' ') == std::string::npos) ? ATOM : PRODUCT;
+			} else if (this->opt.strength_reduce && this->is_half(kids[1])) {
+				e = call("sqrt");
+			} else {
+				e = this->fn("pow") + "(" + this->expr.at(kids[0]) + ", " + this->expr.at(kids[1]) + ")";
+			}
+			break;
+		case OPType::NEGATE:
+			e = "-" + arg(0, ATOM);
+			lv = UNARY;
+			break;
+		case OPType::SIN: e = call("sin"); break;
+		case OPType::COS: e = call("cos"); break;
+		case OPType::TAN: e = call("tan"); break;
+		case OPType::LOG: e = call("log"); break;
+		case OPType::EXP: e = call("exp"); break;
+		case OPType::SQRT: e = call("sqrt"); break;
+		case OPType::ABS: e = call("fabs"); break;
+		default:
+			throw std::runtime_error("codegen: unsupported op: " + node->symbol());
+	}
+
+	// shared: compute once, unless it is already a name or a literal. Long
+	// inlined operands go to a temporary too, so a deep chain such as
+	// sin(sin(...(x))) costs linear text rather than copying each level.
+	if ((this->uses[id] > 1 || e.size() > max_inline) && e.find_first_of(" (") != std::string::npos) {
+		e = this->temp(e);
+		lv = ATOM;
+	}
+
+	this->expr[id] = e;
+	this->level[id] = lv;
+}
+
+std::vector<std::string> CodeGen::parameters(const eDAG &dag) {
+	std::vector<std::string> vars;
+
+	for (const auto &v : dag.get_vars()) {
+		if (!is_builtin(v))
+			vars.push_back(v);
+	}
+
+	std::sort(vars.begin(), vars.end());
+	vars.erase(std::unique(vars.begin(), vars.end()), vars.end());
+
+	return vars;
+}
+
+std::string CodeGen::parameter_name(const std::string &var) {
+	return "v_" + var;
+}
+
+std::string CodeGen::generate(const eDAG &dag, const Options &opt) {
+	CodeGen g(dag, opt);
+	std::vector<std::string> order = dag.post_order(dag.root);
+
+	for (const auto &id : order) {
+		auto kids = dag.pool->find_children(id);
+
+		if (kids) {
+			for (const auto &c : *kids)
+				g.uses[c]++;
+		}
+	}
+
+	for (const auto &id : order)
+		g.emit(id);
+
+	std::vector<std::string> vars = parameters(dag);
+	std::string size_t_name = opt.c ? "size_t" : "std::size_t";
+	std::string restrict = opt.c ? "restrict" : "__restrict";
+	std::string lead = opt.c ? "" : "inline ";
+
+	std::ostringstream out;
+
+	if (opt.c)
+		out << "#include <math.h>\n#include <stddef.h>\n\n";
+	else
+		out << "#include <cmath>\n#include <cstddef>\n\n";
+
+	out << lead << "double " << opt.name << "(";
+
+	for (size_t k = 0; k < vars.size(); ++k)
+		out << (k ? ", " : "") << "double " << parameter_name(vars[k]);
+
+	if (vars.empty() && opt.c)
+		out << "void";
+
+	out << ") {\n" << g.body << "\treturn " << g.expr.at(dag.root) << ";\n}\n";
+
+	if (opt.array_loop) {
+		std::string n = g.tmp_prefix + "n", i = g.tmp_prefix + "i", res = g.tmp_prefix + "out";
+
+		out << "\n" << lead << "void " << opt.name << "_n(" << size_t_name << " " << n;
+
+		for (const auto &v : vars)
+			out << ", const double *" << restrict << " " << parameter_name(v);
+
+		out << ", double *" << restrict << " " << res << ") {\n"
+			<< "\tfor (" << size_t_name << " " << i << " = 0; " << i << " < " << n << "; ++" << i << ")\n"
+			<< "\t\t" << res << "[" << i << "] = " << opt.name << "(";
+
+		for (size_t k = 0; k < vars.size(); ++k)
+			out << (k ? ", " : "") << parameter_name(vars[k]) << "[" << i << "]";
+
+		out << ");\n}\n";
+	}
+
+	return out.str();
+}
+
+std::string CodeGen::generate(const eDAG &dag) {
+	return generate(dag, Options());
+}
@@ -0,0 +1,90 @@
+// Standalone C/C++ code generation from eDAG
+#ifndef CODEGEN_HPP
+#define CODEGEN_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Emits a self-contained function computing the expression in doubles. The
+// DAG is hash-consed, so every node used more than once becomes one const
+// temporary and common subexpressions are computed once; single-use nodes
+// are inlined into their parent. Parameters are the variables in sorted
+// order, named v_<name> so that no variable can clash with a C keyword, a
+// libm function or a <math.h> macro; pi, e and tau are constants, as in
+// eval().
+class CodeGen {
+	public:
+		struct Options {
+			// function name; the array loop is name + "_n"
+			std::string name = "f";
+
+			// C instead of C++: <math.h>, no std::, no inline
+			bool c = 0;
+
+			// integer powers to multiplication chains, x^(1/2) to sqrt,
+			// division by a constant to multiplication by its reciprocal.
+			// Results may then differ from eval() in the last bit.
+			bool strength_reduce = 1;
+
+			// also emit name_n(n, x, y, ..., out) computing out[i] from
+			// x[i], y[i], ... over restrict-qualified arrays, in a plain
+			// loop the compiler can vectorize
+			bool array_loop = 0;
+		};
+
+		// whole translation unit: includes and the function(s)
+		static std::string generate(const eDAG &dag, const Options &opt);
+		static std::string generate(const eDAG &dag);
+
+		// variables in the parameter order of the generated function
+		static std::vector<std::string> parameters(const eDAG &dag);
+
+		// name of var's parameter in the generated code
+		static std::string parameter_name(const std::string &var);
+
+	private:
+		const eDAG &dag;
+		const Options &opt;
+
+		std::unordered_map<std::string, size_t> uses;
+		// node id -> C operand, for nodes already emitted
+		std::unordered_map<std::string, std::string> expr;
+		// binding level of expr, to parenthesize it inside another operator
+		std::unordered_map<std::string, int> level;
+		// node id -> value, for constants and operators over constants only
+		std::unordered_map<std::string, Number> consts;
+
+		// operand -> temporary holding its square, shared by all powers
+		std::unordered_map<std::string, std::string> squares;
+
+		std::string body;
+		std::string tmp_prefix;
+		size_t next = 0;
+
+		CodeGen(const eDAG &dag, const Options &opt);
+
+		static bool is_builtin(const std::string &name);
+		static std::string number(double v);
+		static std::string literal(const Number &v);
+		std::string fn(const char *name) const;
+
+		std::string temp(const std::string &value);
+		// keep id's value in a temporary, so using it again costs nothing
+		std::string atom(const std::string &id);
+
+		// value of id from its children's, once per node in post-order
+		bool fold(const std::string &id, Number &v) const;
+		bool constant(const std::string &id, Number &v) const;
+		bool small_int(const std::string &id, int64_t &n) const;
+		bool is_half(const std::string &id) const;
+		std::string square(const std::string &a);
+		std::string power(const std::string &base, int64_t n);
+
+		void emit(const std::string &id);
+};
+
+#include "codegen.cpp"
+
+#endif
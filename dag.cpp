@@ -6,31 +6,81 @@
 #include <stack>
 #include <algorithm>
 #include <stdexcept>
+#include <memory_resource>
 
+template <typename T>
+DAG<T>::DAG(std::pmr::memory_resource *mr) : adj(mr), radj(mr), nodes(mr) {}
+
+// iterative DFS from node; a neighbor still in visiting is a back edge
 template <typename T>
 bool DAG<T>::has_cycle_helper(const T& node,
 							  std::unordered_set<T> &visiting,
 							  std::unordered_set<T> &visited) const {
-	if (visiting.find(node) != visiting.end())
-		return 1;
+	using iter = typename std::pmr::unordered_set<T>::const_iterator;
 
-	if (visited.find(node) != visited.end())
-		return 0;
+	static const std::pmr::unordered_set<T> none;
+
+	auto range = [&](const T& n) -> std::pair<iter, iter> {
+		auto it = adj.find(n);
+
+		if (it == adj.end())
+			return { none.end(), none.end() };
+
+		return { it->second.begin(), it->second.end() };
+	};
+
+	std::vector<std::pair<T, std::pair<iter, iter>>> work;
 
 	visiting.insert(node);
+	work.push_back({ node, range(node) });
 
-	auto it = adj.find(node);
+	while (!work.empty()) {
+		auto &top = work.back();
 
-	if (it == adj.end())
-		return 0;
+		if (top.second.first == top.second.second) {
+			visiting.erase(top.first);
+			visited.insert(top.first);
+			work.pop_back();
+			continue;
+		}
 
-	for (const T& neighbor : it->second) {
-		if (this->has_cycle_helper(neighbor, visiting, visited))
+		const T& next = *top.second.first++;
+
+		if (visiting.find(next) != visiting.end())
 			return 1;
+
+		if (visited.find(next) != visited.end())
+			continue;
+
+		visiting.insert(next);
+		work.push_back({ next, range(next) });
 	}
 
-	visiting.erase(node);
-	visited.insert(node);
+	return 0;
+}
+
+template <typename T>
+bool DAG<T>::reaches(const T& src, const T& dest) const {
+	std::unordered_set<T> seen = { src };
+	std::vector<T> work = { src };
+
+	while (!work.empty()) {
+		T node = work.back();
+		work.pop_back();
+
+		if (node == dest)
+			return 1;
+
+		auto it = adj.find(node);
+
+		if (it == adj.end())
+			continue;
+
+		for (const T& neighbor : it->second) {
+			if (seen.insert(neighbor).second)
+				work.push_back(neighbor);
+		}
+	}
 
 	return 0;
 }
@@ -50,12 +100,23 @@ bool DAG<T>::has_cycle() const {
 	return 0;
 }
 
+template <typename T>
+void DAG<T>::reserve(size_t n) {
+	nodes.reserve(n);
+	adj.reserve(n);
+	radj.reserve(n);
+}
+
 template <typename T>
 void DAG<T>::add_node(const T& node) {
 	nodes.insert(node);
 
 	if (adj.find(node) == adj.end()) {
-		adj[node] = std::unordered_set<T>();
+		adj[node];
+	}
+
+	if (radj.find(node) == radj.end()) {
+		radj[node];
 	}
 }
 
@@ -64,12 +125,46 @@ void DAG<T>::remove_node(const T& node) {
 	if (nodes.find(node) == nodes.end())
 		return;
 
-	for (auto &p : adj) {
-		p.second.erase(node);
+	for (const T& pred : radj[node]) {
+		adj[pred].erase(node);
+	}
+
+	for (const T& succ : adj[node]) {
+		radj[succ].erase(node);
 	}
 
 	nodes.erase(node);
 	adj.erase(node);
+	radj.erase(node);
+}
+
+template <typename T>
+void DAG<T>::remove_nodes(const std::unordered_set<T>& drop) {
+	for (const T& node : drop) {
+		auto it = radj.find(node);
+
+		if (it != radj.end()) {
+			for (const T& pred : it->second) {
+				if (drop.find(pred) == drop.end())
+					adj[pred].erase(node);
+			}
+		}
+
+		it = adj.find(node);
+
+		if (it != adj.end()) {
+			for (const T& succ : it->second) {
+				if (drop.find(succ) == drop.end())
+					radj[succ].erase(node);
+			}
+		}
+	}
+
+	for (const T& node : drop) {
+		nodes.erase(node);
+		adj.erase(node);
+		radj.erase(node);
+	}
 }
 
 template <typename T>
@@ -84,11 +179,12 @@ void DAG<T>::add_edge(const T& src, const T& dest) {
 	if (!dest_e)
 		this->add_node(dest);
 
-	adj[src].insert(dest);
-
-	if (this->has_cycle()) {
-		adj[src].erase(dest);
+	if (adj[src].find(dest) != adj[src].end())
+		return;
 
+	// the new edge closes a cycle iff src is already reachable from dest,
+	// which is impossible while src has no predecessors (a fresh parent)
+	if (src == dest || (!radj[src].empty() && this->reaches(dest, src))) {
 		if (!src_e)
 			this->remove_node(src);
 
@@ -97,6 +193,9 @@ void DAG<T>::add_edge(const T& src, const T& dest) {
 
 		throw std::invalid_argument("Adding edge creates a cycle in the DAG");
 	}
+
+	adj[src].insert(dest);
+	radj[dest].insert(src);
 }
 
 template <typename T>
@@ -104,6 +203,10 @@ void DAG<T>::remove_edge(const T& src, const T& dest) {
 	if (adj.find(src) != adj.end()) {
 		adj[src].erase(dest);
 	}
+
+	if (radj.find(dest) != radj.end()) {
+		radj[dest].erase(src);
+	}
 }
 
 template <typename T>
@@ -148,10 +251,10 @@ template <typename T>
 std::vector<T> DAG<T>::get_predecessors(const T& node) const {
 	std::vector<T> pred;
 
-	for (const auto &p : adj) {
-		if (p.second.find(node) != p.second.end()) {
-			pred.push_back(p.first);
-		}
+	auto it = radj.find(node);
+
+	if (it != radj.end()) {
+		pred.assign(it->second.begin(), it->second.end());
 	}
 
 	return pred;
@@ -163,37 +266,32 @@ std::vector<T> DAG<T>::topological_sort() const {
 	std::vector<T> L = {};
 	std::stack<T> S = {};
 
-	for (T node : nodes) {
-		if (!this->get_indegree(node)) {
+	// remaining indegree of every node
+	std::unordered_map<T, size_t> in;
+
+	for (const T& node : nodes) {
+		size_t d = this->get_indegree(node);
+
+		if (!d) {
 			S.push(node);
+		} else {
+			in[node] = d;
 		}
 	}
 
-	// copy of edges
-	std::unordered_map<T, std::unordered_set<T>> new_adj = adj;
-
 	while (!S.empty()) {
 		T top = S.top();
 		S.pop();
 		L.push_back(top);
 
-		auto it = new_adj.find(top);
+		auto it = adj.find(top);
 
-		if (it == new_adj.end()) {
+		if (it == adj.end()) {
 			continue;
 		}
 
-		for (T n : it->second) {
-			int in_n = 0;
-			for (const auto &p : new_adj) {
-				if (p.second.find(n) != p.second.end()) {
-					in_n++;
-				}
-			}
-
-			new_adj[top].erase(n);
-
-			if (!in_n)
+		for (const T& n : it->second) {
+			if (!--in[n])
 				S.push(n);
 		}
 	}
@@ -215,19 +313,17 @@ template <typename T>
 void DAG<T>::clear() {
 	nodes.clear();
 	adj.clear();
+	radj.clear();
 }
 
 template <typename T>
 int DAG<T>::get_indegree(const T& node) const {
-	int in = 0;
+	auto it = radj.find(node);
 
-	for (const auto &p : adj) {
-		if (p.second.find(node) != p.second.end()) {
-			++in;
-		}
-	}
+	if (it == radj.end())
+		return 0;
 
-	return in;
+	return it->second.size();
 }
 
 template <typename T>
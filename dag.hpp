@@ -9,13 +9,19 @@
 #include <stack>
 #include <algorithm>
 #include <stdexcept>
+#include <memory_resource>
 
 
 template <typename T>
 class DAG {
 	private:
-		std::unordered_map<T, std::unordered_set<T>> adj;
-		std::unordered_set<T> nodes;
+		std::pmr::unordered_map<T, std::pmr::unordered_set<T>> adj;
+		// reverse edges, kept in sync with adj
+		std::pmr::unordered_map<T, std::pmr::unordered_set<T>> radj;
+		std::pmr::unordered_set<T> nodes;
+
+		// is there a path from src to dest
+		bool reaches(const T& src, const T& dest) const;
 
 		// visited: set of nodes we've visited
 		// rec: recursive stack
@@ -25,14 +31,23 @@ class DAG {
 	public:
 		DAG() = default;
 
+		// allocate adjacency from mr, e.g. an arena
+		explicit DAG(std::pmr::memory_resource *mr);
+
 		~DAG() = default;
 
 		bool has_cycle() const;
 
+		// room for n nodes in total, to skip rehashing while building
+		void reserve(size_t n);
+
 		void add_node(const T& node);
 
 		void remove_node(const T& node);
 
+		// remove a batch of nodes and their edges in one pass
+		void remove_nodes(const std::unordered_set<T>& drop);
+
 		void add_edge(const T& src, const T& dest);
 
 		void remove_edge(const T& src, const T& dest);
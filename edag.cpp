@@ -1,9 +1,15 @@
 #include "edag.hpp"
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <stack>
 #include <queue>
 #include <numbers>
+#include <tuple>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <random>
 
 // Helper function to convert variant to double for arithmetic
 double variant_to_double(const std::variant<int64_t, Rational, double>& v) {
@@ -40,37 +46,62 @@ Rational variant_to_rational(const std::variant<int64_t, Rational, double>& v) {
 
 eNode::eNode(NodeType t,
 			 const std::string &sym,
-			 std::variant<int64_t, Rational, double> val,
+			 const Number &val,
 			 OPType op,
 			 int prec,
 			 bool unary) : type(t),
-						   symbol(sym),
 						   value(val),
 						   op(op),
 						   precedence(prec),
-						   is_unary(unary) {}
+						   is_unary(unary),
+						   sym_id(t == NodeType::CONSTANT ? Symbols::none : Symbols::intern(sym)),
+						   sym_name(t == NodeType::CONSTANT ? Literals::acquire(sym) : &Symbols::name(sym_id)) {}
+
+eNode::eNode(const eNode &other) : type(other.type),
+								   value(other.value),
+								   op(other.op),
+								   precedence(other.precedence),
+								   is_unary(other.is_unary),
+								   vars(other.vars),
+								   fp(other.fp),
+								   sym_id(other.sym_id),
+								   sym_name(other.type == NodeType::CONSTANT ? Literals::acquire(*other.sym_name)
+																			: other.sym_name) {}
+
+eNode::~eNode() {
+	if (type == NodeType::CONSTANT)
+		Literals::release(sym_name);
+}
+
+const std::string& eNode::symbol() const {
+	return *sym_name;
+}
+
+uint32_t eNode::symbol_id() const {
+	return sym_id;
+}
 
 std::string eNode::to_string() const {
 	switch (type) {
 		case NodeType::VARIABLE:
-			return symbol;
+			return *sym_name;
 		case NodeType::CONSTANT:
-			if (std::holds_alternative<Rational>(value)) {
-				Rational r = std::get<Rational>(value);
+			if (value.is_rational()) {
+				Rational r = value.to_rational();
 				if (r.denominator() == 1) {
 					return std::to_string(r.numerator());
 				} else {
 					return std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
 				}
-			} else if (std::holds_alternative<int64_t>(value)) {
-				return std::to_string(std::get<int64_t>(value));
+			} else if (value.is_int()) {
+				return std::to_string(value.as_int());
 			} else {
-				return std::to_string(std::get<double>(value));
+				return std::to_string(value.to_double());
 			}
 		case NodeType::OPERATION:
-			return symbol;
+			return *sym_name;
 		case NodeType::FUNCTION:
-			return symbol + "()";
+			return *sym_name + "()";
 		default:
 			return "UNKNOWN";
 	}
@@ -80,24 +111,30 @@ std::variant<int64_t, Rational, double> eNode::eval(const std::unordered_map<std
 	switch (type) {
 		case NodeType::VARIABLE:
 			{
+				static const uint32_t pi = Symbols::intern("pi"),
+									  PI = Symbols::intern("PI"),
+									  e = Symbols::intern("e"),
+									  tau = Symbols::intern("tau"),
+									  TAU = Symbols::intern("TAU");
+
 				// Check for built-in constants
-				if (symbol == "pi" || symbol == "PI") {
+				if (sym_id == pi || sym_id == PI) {
 					return M_PI;
-				} else if (symbol == "e") {
+				} else if (sym_id == e) {
 					return std::exp(1);
-				} else if (symbol == "tau" || symbol == "TAU") {
+				} else if (sym_id == tau || sym_id == TAU) {
 					return 2 * M_PI;
 				}
 
-				auto it = var.find(symbol);
+				auto it = var.find(*sym_name);
 				if (it != var.end()) {
 					return it->second;
 				}
 
-				throw std::runtime_error("var: {" + symbol + "} not found in evaluation context.");
+				throw std::runtime_error("var: {" + *sym_name + "} not found in evaluation context.");
 			}
 		case NodeType::CONSTANT:
-			return value;
+			return value.to_variant();
 		case NodeType::OPERATION:
 		case NodeType::FUNCTION:
 			throw std::runtime_error("can't evaluate op node without operands.");
@@ -106,6 +143,93 @@ std::variant<int64_t, Rational, double> eNode::eval(const std::unordered_map<std
 	}
 }
 
+VarSet VarSet::of(uint32_t slot) {
+	VarSet s;
+
+	if (slot < 64)
+		s.bits = uint64_t(1) << slot;
+	else
+		s.rest = std::make_shared<const std::vector<uint32_t>>(1, slot);
+
+	return s;
+}
+
+void VarSet::merge(const VarSet &other) {
+	this->bits |= other.bits;
+
+	if (!other.rest || other.rest == this->rest)
+		return;
+
+	if (!this->rest) {
+		this->rest = other.rest;
+		return;
+	}
+
+	std::vector<uint32_t> out;
+	out.reserve(this->rest->size() + other.rest->size());
+	std::set_union(this->rest->begin(), this->rest->end(),
+				   other.rest->begin(), other.rest->end(),
+				   std::back_inserter(out));
+
+	// keep sharing when one side already holds the union
+	if (out.size() == other.rest->size())
+		this->rest = other.rest;
+	else if (out.size() != this->rest->size())
+		this->rest = std::make_shared<const std::vector<uint32_t>>(std::move(out));
+}
+
+bool VarSet::contains(uint32_t slot) const {
+	if (slot < 64)
+		return (this->bits >> slot) & 1;
+
+	return this->rest && std::binary_search(this->rest->begin(), this->rest->end(), slot);
+}
+
+bool VarSet::intersects(const VarSet &other) const {
+	if (this->bits & other.bits)
+		return 1;
+
+	if (!this->rest || !other.rest)
+		return 0;
+
+	if (this->rest == other.rest)
+		return !this->rest->empty();
+
+	auto a = this->rest->begin(), b = other.rest->begin();
+
+	while (a != this->rest->end() && b != other.rest->end()) {
+		if (*a == *b)
+			return 1;
+
+		if (*a < *b)
+			++a;
+		else
+			++b;
+	}
+
+	return 0;
+}
+
+bool VarSet::empty() const {
+	return this->bits == 0 && (!this->rest || this->rest->empty());
+}
+
+size_t VarSet::size() const {
+	return __builtin_popcountll(this->bits) + (this->rest ? this->rest->size() : 0);
+}
+
+std::vector<uint32_t> VarSet::slots() const {
+	std::vector<uint32_t> out;
+
+	for (uint64_t b = this->bits; b; b &= b - 1)
+		out.push_back(__builtin_ctzll(b));
+
+	if (this->rest)
+		out.insert(out.end(), this->rest->begin(), this->rest->end());
+
+	return out;
+}
+
 bool eNode::is_leaf() const {
 	return type == NodeType::VARIABLE || type == NodeType::CONSTANT;
 }
@@ -257,46 +381,422 @@ std::shared_ptr<eNode> eDAG::create_node(const std::string &token) {
 	}
 }
 
+ePool::ePool(size_t arena_bytes)
+	: arena(arena_bytes ? std::make_shared<std::pmr::monotonic_buffer_resource>(arena_bytes) : nullptr),
+	  mr(arena ? arena.get() : std::pmr::new_delete_resource()),
+	  graph(mr),
+	  nodes(mr),
+	  orderedc(mr),
+	  leaf_intern(mr),
+	  op_intern(mr),
+	  var_slots(mr),
+	  slot_syms(mr) {}
+
+std::shared_ptr<ePool> ePool::create() {
+	auto p = std::make_shared<ePool>();
+	p->concurrent = 1;
+	return p;
+}
+
+std::shared_ptr<ePool> ePool::create_arena(size_t initial_bytes) {
+	return std::make_shared<ePool>(initial_bytes ? initial_bytes : 1);
+}
+
+const std::shared_ptr<ePool>& ePool::global() {
+	static const std::shared_ptr<ePool> p = ePool::create();
+	return p;
+}
+
+std::shared_lock<std::shared_mutex> ePool::read() const {
+	if (!this->concurrent)
+		return std::shared_lock<std::shared_mutex>(this->mutex, std::defer_lock);
+
+	return std::shared_lock<std::shared_mutex>(this->mutex);
+}
+
+std::unique_lock<std::shared_mutex> ePool::write() {
+	if (!this->concurrent)
+		return std::unique_lock<std::shared_mutex>(this->mutex, std::defer_lock);
+
+	return std::unique_lock<std::shared_mutex>(this->mutex);
+}
+
+std::shared_ptr<eNode> ePool::node(const std::string &id) const {
+	auto lock = this->read();
+	return nodes.at(id);
+}
+
+std::shared_ptr<eNode> ePool::find(const std::string &id) const {
+	auto lock = this->read();
+	auto it = nodes.find(id);
+
+	return (it != nodes.end()) ? it->second : nullptr;
+}
+
+// child lists are never modified after interning, so the reference stays
+// valid after the lock is released
+const std::pmr::vector<std::string>& ePool::children(const std::string &id) const {
+	auto lock = this->read();
+	return orderedc.at(id);
+}
+
+const std::pmr::vector<std::string>* ePool::find_children(const std::string &id) const {
+	auto lock = this->read();
+	auto it = orderedc.find(id);
+
+	return (it != orderedc.end()) ? &it->second : nullptr;
+}
+
+std::vector<std::string> ePool::parents(const std::string &id) const {
+	auto lock = this->read();
+	return graph.get_predecessors(id);
+}
+
+std::string ePool::find_leaf(const std::pmr::string &key) const {
+	auto lock = this->read();
+	auto it = leaf_intern.find(key);
+
+	return (it != leaf_intern.end()) ? it->second : "";
+}
+
+std::string ePool::find_op(const std::pmr::string &key) const {
+	auto lock = this->read();
+	auto it = op_intern.find(key);
+
+	return (it != op_intern.end()) ? it->second : "";
+}
+
+size_t ePool::size() const {
+	auto lock = this->read();
+	return nodes.size();
+}
+
+void ePool::reserve(size_t n) {
+	auto lock = this->write();
+
+	n += nodes.size();
+	nodes.reserve(n);
+	graph.reserve(n);
+	orderedc.reserve(n);
+	leaf_intern.reserve(n);
+	op_intern.reserve(n);
+}
+
+uint32_t ePool::var_slot(uint32_t sym) {
+	auto it = var_slots.find(sym);
+
+	if (it != var_slots.end())
+		return it->second;
+
+	uint32_t slot = (uint32_t) slot_syms.size();
+	slot_syms.push_back(sym);
+	var_slots.emplace(sym, slot);
+
+	return slot;
+}
+
+uint32_t ePool::find_var(uint32_t sym) const {
+	auto lock = this->read();
+	auto it = var_slots.find(sym);
+
+	return (it != var_slots.end()) ? it->second : Symbols::none;
+}
+
+void ePool::attach(const eDAG *view) {
+	std::lock_guard<std::mutex> lock(views_mutex);
+	views.insert(view);
+}
+
+void ePool::detach(const eDAG *view) {
+	std::lock_guard<std::mutex> lock(views_mutex);
+	views.erase(view);
+}
+
+size_t ePool::collect() {
+	std::vector<std::string> work;
+
+	{
+		std::lock_guard<std::mutex> lock(views_mutex);
+
+		for (const auto *v : views) {
+			std::string r = v->get_root();
+
+			if (!r.empty())
+				work.push_back(r);
+		}
+	}
+
+	auto lock = this->write();
+	std::unordered_set<std::string> keep;
+
+	while (!work.empty()) {
+		std::string id = work.back();
+		work.pop_back();
+
+		if (!keep.insert(id).second)
+			continue;
+
+		auto it = orderedc.find(id);
+
+		if (it != orderedc.end())
+			work.insert(work.end(), it->second.begin(), it->second.end());
+	}
+
+	if (keep.size() == nodes.size())
+		return 0;
+
+	std::unordered_set<std::string> drop;
+
+	for (const auto &p : nodes) {
+		if (keep.find(p.first) == keep.end())
+			drop.insert(p.first);
+	}
+
+	this->erase(drop);
+
+	return drop.size();
+}
+
+void ePool::erase(const std::unordered_set<std::string> &drop) {
+	for (const auto &id : drop) {
+		nodes.erase(id);
+		orderedc.erase(id);
+	}
+
+	graph.remove_nodes(drop);
+
+	for (auto *table : { &leaf_intern, &op_intern }) {
+		for (auto it = table->begin(); it != table->end();) {
+			if (drop.find(it->second) != drop.end()) {
+				it = table->erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+eDAG::eDAG() {
+	pool->attach(this);
+}
+
+eDAG::eDAG(const std::shared_ptr<ePool> &p) : pool(p), scoped(1) {
+	pool->attach(this);
+}
+
+eDAG::eDAG(const eDAG &other) : pool(other.pool),
+								root(other.root),
+								fold(other.fold),
+								scoped(other.scoped),
+								arena(other.arena) {
+	pool->attach(this);
+}
+
+eDAG& eDAG::operator=(const eDAG &other) {
+	if (this != &other) {
+		this->set_pool(other.pool);
+		this->root = other.root;
+		this->fold = other.fold;
+		this->scoped = other.scoped;
+		this->arena = other.arena;
+	}
+
+	return *this;
+}
+
+eDAG::~eDAG() {
+	pool->detach(this);
+}
+
+void eDAG::set_pool(const std::shared_ptr<ePool> &p) {
+	if (p == pool)
+		return;
+
+	pool->detach(this);
+	pool = p;
+	pool->attach(this);
+}
+
+std::shared_ptr<ePool> eDAG::fresh_pool() const {
+	if (this->arena)
+		return ePool::create_arena();
+
+	return std::make_shared<ePool>();
+}
+
 std::string eDAG::generate_id() {
-	static int counter = 0;
+	// shared pools intern from several threads
+	static std::atomic<uint64_t> counter{0};
 	return "node_" + std::to_string(++counter);
 }
 
-std::string eDAG::intern_leaf(NodeType t,
-							  const std::string &sym,
-							  std::variant<int64_t, Rational, double> val) {
-	std::string key;
+bool Fingerprint::operator==(const Fingerprint &other) const {
+	return (this->hi == other.hi && this->lo == other.lo);
+}
+
+bool Fingerprint::operator!=(const Fingerprint &other) const {
+	return !(*this == other);
+}
+
+bool Fingerprint::operator<(const Fingerprint &other) const {
+	return (this->hi != other.hi) ? this->hi < other.hi : this->lo < other.lo;
+}
+
+std::string Fingerprint::to_string() const {
+	char buf[33];
+	std::snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long) this->hi, (unsigned long long) this->lo);
+	return buf;
+}
+
+size_t Fingerprint::Hash::operator()(const Fingerprint &f) const {
+	return (size_t) (f.lo ^ (f.hi * 0x9E3779B97F4A7C15ULL));
+}
+
+// 64x64 -> 128 multiply folded to 64 bits, the mixing step of wyhash
+static uint64_t fp_mum(uint64_t a, uint64_t b) {
+	unsigned __int128 r = (unsigned __int128) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+// one word into both lanes; each lane depends on the whole state
+static void fp_absorb(Fingerprint &h, uint64_t w) {
+	uint64_t a = h.lo ^ w, b = h.hi;
+
+	h.lo = fp_mum(a ^ 0xa0761d6478bd642fULL, b ^ 0xe7037ed1a0b428dbULL);
+	h.hi = fp_mum(a ^ 0x8ebc6af09c88c6e3ULL, b ^ h.lo ^ 0x589965cc75374cc3ULL);
+}
+
+static void fp_absorb(Fingerprint &h, const std::string &s) {
+	fp_absorb(h, s.size());
+
+	for (size_t j = 0; j < s.size(); j += 8) {
+		uint64_t w = 0;
+		std::memcpy(&w, s.data() + j, std::min<size_t>(8, s.size() - j));
+		fp_absorb(h, w);
+	}
+}
+
+// the first word tells leaves and operators apart; constants hash their
+// value, like make_leaf_key, so 1.5 and 3/2 are the same constant
+Fingerprint eDAG::leaf_fingerprint(NodeType t, const std::string &sym, const Number &val) {
+	Fingerprint h;
+
 	if (t == NodeType::VARIABLE) {
-		key = "var:" + sym;
+		fp_absorb(h, 1);
+		fp_absorb(h, sym);
+	} else if (val.is_exact()) {
+		Rational r = val.to_rational();
+
+		fp_absorb(h, 2);
+		fp_absorb(h, (uint64_t) r.numerator());
+		fp_absorb(h, (uint64_t) r.denominator());
 	} else {
-		// Create key based on variant type
-		if (std::holds_alternative<Rational>(val)) {
-			Rational r = std::get<Rational>(val);
-			key = "const:" + std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
-		} else if (std::holds_alternative<int64_t>(val)) {
-			key = "const:" + std::to_string(std::get<int64_t>(val));
-		} else {
-			key = "const:" + std::to_string(std::get<double>(val));
-		}
+		// -0.0 is 0.0
+		double d = val.to_double() + 0.0;
+		uint64_t bits;
+		std::memcpy(&bits, &d, sizeof(d));
+
+		fp_absorb(h, 3);
+		fp_absorb(h, bits);
 	}
 
-	auto it = leaf_intern.find(key);
+	return h;
+}
 
-	if (it != leaf_intern.end())
-		return it->second;
+// from the children's fingerprints, in operand order; those of + and * are
+// sorted first, so any order of them gives the same result. Ops without an
+// OPType hash their symbol.
+Fingerprint eDAG::op_fingerprint(OPType op,
+								 const std::string &sym,
+								 std::vector<Fingerprint> &fps) const {
+	if (this->is_comm(op))
+		std::sort(fps.begin(), fps.end());
+
+	Fingerprint h;
+	fp_absorb(h, 4 + (uint64_t) op);
+
+	if (op == OPType::UNKNOWN)
+		fp_absorb(h, sym);
+
+	fp_absorb(h, fps.size());
+
+	for (const auto &f : fps) {
+		fp_absorb(h, f.hi);
+		fp_absorb(h, f.lo);
+	}
+
+	return h;
+}
+
+// 17 significant digits: distinct doubles give distinct text, which
+// std::to_string's six decimals do not
+static std::string double_key(double d) {
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.17g", d);
+	return buf;
+}
+
+// keys are built in the pool's memory, so arena pools keep them there too
+std::pmr::string eDAG::make_leaf_key(NodeType t,
+									 const std::string &sym,
+									 const Number &val) const {
+	std::pmr::string key(pool->mr);
+
+	if (t == NodeType::VARIABLE) {
+		key = "var:";
+		key += sym;
+		return key;
+	}
+
+	// Create key based on variant type
+	key = "const:";
+
+	if (val.is_rational()) {
+		Rational r = val.to_rational();
+		key += std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
+	} else if (val.is_int()) {
+		key += std::to_string(val.as_int());
+	} else {
+		key += double_key(val.to_double());
+	}
+
+	return key;
+}
+
+std::string eDAG::intern_leaf(NodeType t,
+							  const std::string &sym,
+							  const Number &val) {
+	std::pmr::string key = this->make_leaf_key(t, sym, val);
+	std::string found = pool->find_leaf(key);
+
+	if (!found.empty())
+		return found;
 
 	std::string id = generate_id();
 	std::shared_ptr<eNode> node;
 
 	if (t == NodeType::VARIABLE) {
-		node = std::make_shared<eNode>(NodeType::VARIABLE, sym, 0);
+		node = pool->make_node(NodeType::VARIABLE, sym, 0);
 	} else {
-		node = std::make_shared<eNode>(NodeType::CONSTANT, sym, val);
+		node = pool->make_node(NodeType::CONSTANT, sym, val);
 	}
 
-	nodes[id] = node;
-	graph.add_node(id);
-	leaf_intern[key] = id;
+	node->fp = leaf_fingerprint(t, sym, val);
+
+	auto lock = pool->write();
+
+	// another thread may have interned it meanwhile
+	auto it = pool->leaf_intern.find(key);
+
+	if (it != pool->leaf_intern.end())
+		return it->second;
+
+	if (t == NodeType::VARIABLE)
+		node->vars = VarSet::of(pool->var_slot(node->symbol_id()));
+
+	pool->nodes[id] = node;
+	pool->graph.add_node(id);
+	pool->leaf_intern.emplace(std::move(key), id);
 	return id;
 }
 
@@ -308,7 +808,7 @@ bool eDAG::is_assoc(OPType op) const {
 	return (op == OPType::ADD || op == OPType::MULTIPLY);
 }
 
-std::string eDAG::make_op_key(OPType op, const std::vector<std::string> &children) {
+std::pmr::string eDAG::make_op_key(OPType op, const std::vector<std::string> &children) const {
 	std::vector<std::string> ids = children;
 
 	if (this->is_comm(op)) {
@@ -317,7 +817,9 @@ std::string eDAG::make_op_key(OPType op, const std::vector<std::string> &childre
 		ids = sorted;
 	}
 
-	std::string key = math_utils::op_to_string(op) + "|";
+	std::pmr::string key(pool->mr);
+	key = math_utils::op_to_string(op);
+	key += "|";
 
 	for (size_t j = 0; j < ids.size(); ++j) {
 		if (j)
@@ -340,13 +842,13 @@ std::string eDAG::intern_op_node(OPType op,
 		std::vector<std::string> flat;
 
 		for (const auto &child_id : ordered) {
-			auto it = nodes.find(child_id);
-			if (it != nodes.end() && it->second->op == op && !it->second->is_unary) {
-				auto ordered_it = orderedc.find(child_id);
-				if (ordered_it != orderedc.end()) {
+			auto child = pool->find(child_id);
+			if (child && child->op == op && !child->is_unary) {
+				auto grand = pool->find_children(child_id);
+				if (grand) {
 					flat.insert(flat.end(),
-							    ordered_it->second.begin(),
-								ordered_it->second.end());
+							    grand->begin(),
+								grand->end());
 					continue;
 				}
 			}
@@ -355,222 +857,439 @@ std::string eDAG::intern_op_node(OPType op,
 		ordered.swap(flat);
 	}
 
-	std::string key = this->make_op_key(op, ordered);
+	if (this->fold) {
+		std::string folded = this->fold_op(op, ordered);
 
-	auto it = op_intern.find(key);
+		if (!folded.empty())
+			return folded;
+	}
 
-	if (it != op_intern.end())
-		return it->second;
+	std::pmr::string key = this->make_op_key(op, ordered);
+	std::string found = pool->find_op(key);
+
+	if (!found.empty())
+		return found;
 
 	std::string id = this->generate_id();
 
-	auto node = std::make_shared<eNode>(NodeType::OPERATION,
-										sym,
-										0.0,
-										op,
-										precedence,
-										is_unary);
+	auto node = pool->make_node(NodeType::OPERATION,
+								sym,
+								0.0,
+								op,
+								precedence,
+								is_unary);
+
+	std::vector<Fingerprint> fps;
+	fps.reserve(ordered.size());
+
+	for (const auto &child_id : ordered) {
+		const auto &child = pool->node(child_id);
 
-	nodes[id] = node;
-	graph.add_node(id);
-	orderedc[id] = ordered;
+		node->vars.merge(child->vars);
+		fps.push_back(child->fp);
+	}
+
+	node->fp = this->op_fingerprint(op, sym, fps);
+
+	auto lock = pool->write();
+
+	// another thread may have interned it meanwhile
+	auto it = pool->op_intern.find(key);
+
+	if (it != pool->op_intern.end())
+		return it->second;
+
+	pool->nodes[id] = node;
+	pool->graph.add_node(id);
+	pool->orderedc[id].assign(ordered.begin(), ordered.end());
 
 	for (const auto &child_id : ordered)
-		graph.add_edge(id, child_id);
+		pool->graph.add_edge(id, child_id);
 
-	op_intern[key] = id;
+	pool->op_intern.emplace(std::move(key), id);
 
 	return id;
 }
 
-std::variant<int64_t, Rational, double> eDAG::eval_node(const std::string &node_id,
-				 const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var) const {
-	auto node_it = nodes.find(node_id);
+std::string eDAG::intern_const(const Rational &r) {
+	std::string sym = std::to_string(r.numerator());
 
-	if (node_it == nodes.end()) {
-		throw std::runtime_error("node not found: " + node_id);
-	}
+	if (r.denominator() != 1)
+		sym += "/" + std::to_string(r.denominator());
 
-	auto node = node_it->second;
+	return this->intern_leaf(NodeType::CONSTANT, sym, r);
+}
 
-	if (node->is_leaf()) {
-		return node->eval(var);
-	}
+bool eDAG::const_value(const std::string &node_id, Rational &out) const {
+	auto node = pool->find(node_id);
 
-	auto neighbors = graph.get_neighbors(node_id);
+	if (!node || node->type != NodeType::CONSTANT)
+		return 0;
 
-	if (neighbors.empty()) {
-		throw std::runtime_error("operation node without operands: " + node_id);
-	}
+	if (!node->value.is_exact())
+		return 0;
 
-	const auto &child_order = orderedc.find(node_id);
+	out = node->value.to_rational();
+	return 1;
+}
 
-	std::vector<std::string> eval_order;
+// Smart constructor used when folding is on. Returns the id of an existing
+// node when op(children) reduces to one, otherwise returns "" after merging
+// constant operands and dropping neutral elements from children. Only exact
+// (Rational) results are folded; on overflow the node is left as is.
+std::string eDAG::fold_op(OPType op, std::vector<std::string> &children) {
+	Rational a(0, 1), b(0, 1);
+	bool ca = (!children.empty() && this->const_value(children[0], a));
+	bool cb = (children.size() == 2 && this->const_value(children[1], b));
 
-	if (child_order != orderedc.end() && !child_order->second.empty()) {
-		eval_order = child_order->second;
-	} else {
-		eval_order = neighbors;
-	}
+	try {
+		switch (op) {
+			case OPType::ADD:
+			case OPType::MULTIPLY: {
+				bool add = (op == OPType::ADD);
+				Rational acc(add ? 0 : 1, 1);
+				std::vector<std::string> rest;
+
+				for (const auto &c : children) {
+					if (this->const_value(c, a)) {
+						acc = add ? acc + a : acc * a;
+					} else {
+						rest.push_back(c);
+					}
+				}
 
-	std::vector<std::variant<int64_t, Rational, double>> op_vals;
+				// x*0 -> 0
+				if (!add && acc.is_zero())
+					return this->intern_const(acc);
 
-	for (const auto &op : eval_order) {
-		op_vals.push_back(this->eval_node(op, var));
-	}
+				bool neutral = add ? acc.is_zero() : (acc == Rational(1, 1));
 
-	switch (node->op) {
-		case (OPType::ADD): {
-			if (op_vals.empty()) throw std::runtime_error("ADD requires >=1 op.");
-			
-			// Try exact arithmetic first
-			if (all_rational(op_vals)) {
-				Rational sum(0, 1);
-				for (const auto& val : op_vals) {
-					sum = sum + variant_to_rational(val);
-				}
-				return sum;
-			}
-			
-			// Fall back to double arithmetic
-			double s = variant_to_double(op_vals[0]);
-			for (size_t j = 1; j < op_vals.size(); ++j) {
-				s += variant_to_double(op_vals[j]);
+				if (!neutral)
+					rest.insert(rest.begin(), this->intern_const(acc));
+
+				if (rest.empty())
+					return this->intern_const(acc);
+
+				if (rest.size() == 1)
+					return rest[0];
+
+				children.swap(rest);
+				return "";
 			}
-			return s;
-		}
-		case (OPType::SUBTRACT): {
-			if (op_vals.size() != 2) throw std::runtime_error("SUB requires 2 ops.");
-			
-			// Try exact arithmetic first
-			if (all_rational(op_vals)) {
-				Rational left = variant_to_rational(op_vals[0]);
-				Rational right = variant_to_rational(op_vals[1]);
-				return left - right;
-			}
-			
-			// Fall back to double arithmetic
-			double left = variant_to_double(op_vals[0]);
-			double right = variant_to_double(op_vals[1]);
-			return left - right;
-		}
-		case (OPType::MULTIPLY): {
-			if (op_vals.empty()) throw std::runtime_error("MUL requires >=1 op.");
-			
-			// Try exact arithmetic first
-			if (all_rational(op_vals)) {
-				Rational product(1, 1);
-				for (const auto& val : op_vals) {
-					product = product * variant_to_rational(val);
+			case OPType::SUBTRACT: {
+				if (children.size() != 2)
+					return "";
+
+				if (ca && cb)
+					return this->intern_const(a - b);
+
+				if (cb && b.is_zero())
+					return children[0];
+
+				if (children[0] == children[1])
+					return this->intern_const(Rational(0, 1));
+
+				if (ca && a.is_zero()) {
+					return this->intern_op_node(OPType::NEGATE,
+												"neg",
+												math_utils::get_op_precedence(OPType::NEGATE),
+												1,
+												{ children[1] });
 				}
-				return product;
-			}
-			
-			// Fall back to double arithmetic
-			double p = variant_to_double(op_vals[0]);
-			for (size_t j = 1; j < op_vals.size(); ++j) {
-				p *= variant_to_double(op_vals[j]);
+
+				return "";
 			}
-			return p;
-		}
-		case (OPType::DIVIDE): {
-			if (op_vals.size() != 2) throw std::runtime_error("DIV requires 2 ops.");
-			
-			// Check for division by zero
-			if (std::holds_alternative<double>(op_vals[1]) && std::get<double>(op_vals[1]) == 0.0) {
-				throw std::runtime_error("DIV BY ZERO.");
+			case OPType::DIVIDE: {
+				if (children.size() != 2)
+					return "";
+
+				if (ca && cb && !b.is_zero())
+					return this->intern_const(a / b);
+
+				if (cb && b == Rational(1, 1))
+					return children[0];
+
+				return "";
 			}
-			if (std::holds_alternative<int64_t>(op_vals[1]) && std::get<int64_t>(op_vals[1]) == 0) {
-				throw std::runtime_error("DIV BY ZERO.");
+			case OPType::POWER: {
+				if (children.size() != 2)
+					return "";
+
+				// pow(x, 0) and pow(1, x) are 1 for every x, matching eval
+				if ((cb && b.is_zero()) || (ca && a == Rational(1, 1)))
+					return this->intern_const(Rational(1, 1));
+
+				if (cb && b == Rational(1, 1))
+					return children[0];
+
+				Rational r(0, 1);
+
+				if (ca && cb && b.is_int() && math_utils::exact_pow(a, b.to_int(), r))
+					return this->intern_const(r);
+
+				return "";
 			}
-			if (std::holds_alternative<Rational>(op_vals[1]) && std::get<Rational>(op_vals[1]).is_zero()) {
-				throw std::runtime_error("DIV BY ZERO.");
+			case OPType::NEGATE: {
+				if (ca)
+					return this->intern_const(-a);
+
+				// -(-x) -> x
+				auto inner = pool->find(children[0]);
+
+				if (inner && inner->is_op() && inner->op == OPType::NEGATE)
+					return pool->children(children[0])[0];
+
+				return "";
+			}
+			case OPType::SIN:
+			case OPType::TAN:
+			case OPType::SQRT: {
+				Rational r(0, 1);
+
+				if (ca && op == OPType::SQRT && math_utils::exact_sqrt(a, r))
+					return this->intern_const(r);
+
+				if (ca && a.is_zero())
+					return children[0];
+
+				return "";
+			}
+			case OPType::COS:
+			case OPType::EXP: {
+				if (ca && a.is_zero())
+					return this->intern_const(Rational(1, 1));
+
+				return "";
+			}
+			case OPType::LOG: {
+				if (ca && a == Rational(1, 1))
+					return this->intern_const(Rational(0, 1));
+
+				return "";
+			}
+			case OPType::ABS: {
+				if (ca)
+					return this->intern_const(a < Rational(0, 1) ? -a : a);
+
+				return "";
+			}
+			default:
+				return "";
+		}
+	} catch (const std::runtime_error &) {
+		return "";
+	}
+}
+
+Number eDAG::eval_node(const std::string &node_id,
+				 const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var) const {
+	if (!pool->find(node_id)) {
+		throw std::runtime_error("node not found: " + node_id);
+	}
+
+	// children first, each shared node evaluated once
+	std::unordered_map<std::string, Number> memo;
+
+	for (const auto &id : this->post_order(node_id)) {
+		const auto &node = pool->node(id);
+
+		if (node->type == NodeType::CONSTANT) {
+			memo.emplace(id, node->value);
+			continue;
+		}
+
+		if (node->is_leaf()) {
+			memo.emplace(id, Number(node->eval(var)));
+			continue;
+		}
+
+		auto child_order = pool->find_children(id);
+
+		if (!child_order || child_order->empty()) {
+			throw std::runtime_error("operation node without operands: " + id);
+		}
+
+		std::vector<Number> op_vals;
+		op_vals.reserve(child_order->size());
+
+		for (const auto &op : *child_order) {
+			op_vals.push_back(memo.at(op));
+		}
+
+		memo.emplace(id, this->apply_op(*node, op_vals));
+	}
+
+	return memo.at(node_id);
+}
+
+// exact when every operand is, else in doubles
+Number eDAG::apply_op(const eNode &node, const std::vector<Number> &op_vals) const {
+	bool exact = 1;
+
+	for (const auto &v : op_vals)
+		exact = exact && v.is_exact();
+
+	switch (node.op) {
+		case (OPType::ADD): {
+			if (op_vals.empty()) throw std::runtime_error("ADD requires >=1 op.");
+
+			if (exact) {
+				Number sum(Rational(0, 1));
+				for (const auto &val : op_vals) {
+					sum = sum + val;
+				}
+				return sum;
+			}
+
+			double s = op_vals[0].to_double();
+			for (size_t j = 1; j < op_vals.size(); ++j) {
+				s += op_vals[j].to_double();
+			}
+			return s;
+		}
+		case (OPType::SUBTRACT): {
+			if (op_vals.size() != 2) throw std::runtime_error("SUB requires 2 ops.");
+
+			if (exact)
+				return op_vals[0] - op_vals[1];
+
+			return op_vals[0].to_double() - op_vals[1].to_double();
+		}
+		case (OPType::MULTIPLY): {
+			if (op_vals.empty()) throw std::runtime_error("MUL requires >=1 op.");
+
+			if (exact) {
+				Number product(Rational(1, 1));
+				for (const auto &val : op_vals) {
+					product = product * val;
+				}
+				return product;
 			}
-			
-			// Try exact arithmetic first
-			if (all_rational(op_vals)) {
-				Rational left = variant_to_rational(op_vals[0]);
-				Rational right = variant_to_rational(op_vals[1]);
-				return left / right;
+
+			double p = op_vals[0].to_double();
+			for (size_t j = 1; j < op_vals.size(); ++j) {
+				p *= op_vals[j].to_double();
+			}
+			return p;
+		}
+		case (OPType::DIVIDE): {
+			if (op_vals.size() != 2) throw std::runtime_error("DIV requires 2 ops.");
+
+			if (op_vals[1].is_zero()) {
+				throw std::runtime_error("DIV BY ZERO.");
 			}
-			
-			// Fall back to double arithmetic
-			double left = variant_to_double(op_vals[0]);
-			double right = variant_to_double(op_vals[1]);
-			if (right == 0) throw std::runtime_error("DIV BY ZERO.");
-			return left / right;
+
+			if (exact)
+				return op_vals[0] / op_vals[1];
+
+			return op_vals[0].to_double() / op_vals[1].to_double();
 		}
 		case (OPType::POWER): {
 			if (op_vals.size() != 2) throw std::runtime_error("POW requires 2 ops.");
-			double base = variant_to_double(op_vals[0]);
-			double exp = variant_to_double(op_vals[1]);
-			return std::pow(base, exp);
+			return std::pow(op_vals[0].to_double(), op_vals[1].to_double());
 		}
 		case (OPType::NEGATE): {
 			if (op_vals.size() != 1) throw std::runtime_error("NEG requires 1 op.");
-			
-			// Try exact arithmetic first
-			if (std::holds_alternative<Rational>(op_vals[0])) {
-				Rational r = std::get<Rational>(op_vals[0]);
-				return -r;
-			} else if (std::holds_alternative<int64_t>(op_vals[0])) {
-				return -std::get<int64_t>(op_vals[0]);
-			}
-			
-			// Fall back to double arithmetic
-			return -variant_to_double(op_vals[0]);
+			return -op_vals[0];
 		}
 		case (OPType::SIN): {
 			if (op_vals.size() != 1) throw std::runtime_error("SIN requires 1 op.");
-			return std::sin(variant_to_double(op_vals[0]));
+			return std::sin(op_vals[0].to_double());
 		}
 		case (OPType::COS): {
 			if (op_vals.size() != 1) throw std::runtime_error("COS requires 1 op.");
-			return std::cos(variant_to_double(op_vals[0]));
+			return std::cos(op_vals[0].to_double());
 		}
 		case (OPType::TAN): {
 			if (op_vals.size() != 1) throw std::runtime_error("TAN requires 1 op.");
-			return std::tan(variant_to_double(op_vals[0]));
+			return std::tan(op_vals[0].to_double());
 		}
 		case (OPType::LOG): {
 			if (op_vals.size() != 1) throw std::runtime_error("LOG requires 1 op.");
-			return std::log(variant_to_double(op_vals[0]));
+			return std::log(op_vals[0].to_double());
 		}
 		case (OPType::EXP): {
 			if (op_vals.size() != 1) throw std::runtime_error("EXP requires 1 op.");
-			return std::exp(variant_to_double(op_vals[0]));
+			return std::exp(op_vals[0].to_double());
 		}
 		case (OPType::SQRT): {
 			if (op_vals.size() != 1) throw std::runtime_error("SQRT requires 1 op.");
-			return std::sqrt(variant_to_double(op_vals[0]));
+			return std::sqrt(op_vals[0].to_double());
 		}
 		case (OPType::ABS): {
 			if (op_vals.size() != 1) throw std::runtime_error("ABS requires 1 op.");
-			return std::abs(variant_to_double(op_vals[0]));
+			return std::abs(op_vals[0].to_double());
 		}
 		default:
-			throw std::runtime_error("UNKNOWN OP: " + node->symbol);
+			throw std::runtime_error("UNKNOWN OP: " + node.symbol());
 	}
 }
 
 std::vector<std::string> eDAG::get_nodes(NodeType type) const {
 	std::vector<std::string> filter;
 
-	for (const auto &p : nodes) {
-		if (p.second->type == type) {
-			filter.push_back(p.second->symbol);
+	if (root.empty()) {
+		auto lock = pool->read();
+
+		for (const auto &p : pool->nodes) {
+			if (p.second->type == type) {
+				filter.push_back(p.second->symbol());
+			}
+		}
+
+		return filter;
+	}
+
+	for (const auto &id : this->post_order(root)) {
+		const auto &node = pool->node(id);
+
+		if (node->type == type) {
+			filter.push_back(node->symbol());
 		}
 	}
 
 	return filter;
 }
 
-void eDAG::parse(const std::string &expr) {
-	clear();
+std::vector<std::string> eDAG::post_order(const std::string &node_id) const {
+	std::vector<std::string> order;
+	std::unordered_set<std::string> seen;
+	std::vector<std::pair<std::string, bool>> work = { { node_id, 0 } };
 
-	auto tokens = this->tokenize(expr);
-	auto postfix = this->infix2postfix(tokens);
+	while (!work.empty()) {
+		auto [id, expanded] = work.back();
+		work.pop_back();
+
+		if (expanded) {
+			order.push_back(id);
+			continue;
+		}
+
+		if (!seen.insert(id).second)
+			continue;
+
+		if (!pool->find(id)) {
+			throw std::runtime_error("node not found: " + id);
+		}
+
+		work.push_back({ id, 1 });
+
+		auto kids = pool->find_children(id);
+
+		if (kids) {
+			for (auto c = kids->rbegin(); c != kids->rend(); ++c) {
+				if (seen.find(*c) == seen.end())
+					work.push_back({ *c, 0 });
+			}
+		}
+	}
+
+	return order;
+}
 
+// nodes for a postfix token list; names in bound stand for their nodes
+std::string eDAG::build_postfix(const std::vector<std::string> &postfix,
+								const std::unordered_map<std::string, std::string> &bound) {
 	std::stack<std::string> node_stack;
 
 	for (const auto &token : postfix) {
@@ -588,7 +1307,8 @@ void eDAG::parse(const std::string &expr) {
 			}
 		} else if (math_utils::is_var(token) &&
 				   math_utils::string_to_op(token) == OPType::UNKNOWN) {
-			std::string node_id = intern_leaf(NodeType::VARIABLE, token, 0);
+			auto it = bound.find(token);
+			std::string node_id = (it != bound.end()) ? it->second : intern_leaf(NodeType::VARIABLE, token, 0);
 			node_stack.push(node_id);
 		} else {
 			OPType op = math_utils::string_to_op(token);
@@ -632,28 +1352,93 @@ void eDAG::parse(const std::string &expr) {
 		throw std::runtime_error("invalid expression: multiple root nodes.");
 	}
 
-	root = node_stack.top();
+	return node_stack.top();
+}
+
+void eDAG::parse(const std::string &expr) {
+	clear();
+
+	auto tokens = this->tokenize(expr);
+	std::unordered_map<std::string, std::string> bound;
+	size_t at = 0;
+
+	// let name = value in ..., as to_string(1) prints it. let is a keyword
+	// only before "name =", and in only where it ends a binding's value,
+	// right after an operand; anywhere else both are plain names.
+	auto ends_operand = [](const std::string &token) {
+		return token == ")" || math_utils::is_num(token) || math_utils::is_var(token);
+	};
+
+	while (tokens.size() - at > 2 && tokens[at] == "let" &&
+		   math_utils::is_var(tokens[at + 1]) && tokens[at + 2] == "=") {
+		std::string name = tokens[at + 1];
+		size_t end = at + 3;
+		int depth = 0;
+
+		for (; end < tokens.size(); ++end) {
+			if (tokens[end] == "(")
+				++depth;
+			else if (tokens[end] == ")")
+				--depth;
+			else if (!depth && tokens[end] == "in" && end > at + 3 && ends_operand(tokens[end - 1]))
+				break;
+		}
+
+		if (end == tokens.size()) {
+			throw std::runtime_error("invalid expr: let {" + name + "} without in");
+		}
+
+		std::vector<std::string> value(tokens.begin() + at + 3, tokens.begin() + end);
+		bound[name] = this->build_postfix(this->infix2postfix(value), bound);
+		at = end + 1;
+	}
+
+	tokens.erase(tokens.begin(), tokens.begin() + at);
+	root = this->build_postfix(this->infix2postfix(tokens), bound);
+
+	// folding leaves the operands it consumed behind
+	if (this->fold)
+		this->prune();
+}
+
+// drop every node that is not reachable from root
+void eDAG::prune() {
+	// nodes of a shared pool may belong to another root
+	if (pool.use_count() > 1)
+		return;
+
+	// this is the only eDAG on the pool
+	pool->collect();
 }
 
 void eDAG::add_var(const std::string &name) {
 	std::string node_id = this->generate_id();
 
-	auto node = std::make_shared<eNode>(NodeType::VARIABLE,
-										name);
+	auto node = pool->make_node(NodeType::VARIABLE,
+								name);
 
-	nodes[node_id] = node;
-	graph.add_node(node_id);
+	node->fp = leaf_fingerprint(NodeType::VARIABLE, name, 0);
+
+	auto lock = pool->write();
+
+	node->vars = VarSet::of(pool->var_slot(node->symbol_id()));
+	pool->nodes[node_id] = node;
+	pool->graph.add_node(node_id);
 }
 
 void eDAG::add_const(const std::string &name, double value) {
 	std::string node_id = this->generate_id();
 
-	auto node = std::make_shared<eNode>(NodeType::CONSTANT,
-										name,
-										value);
+	auto node = pool->make_node(NodeType::CONSTANT,
+								name,
+								value);
+
+	node->fp = leaf_fingerprint(NodeType::CONSTANT, name, value);
+
+	auto lock = pool->write();
 
-	nodes[node_id] = node;
-	graph.add_node(node_id);
+	pool->nodes[node_id] = node;
+	pool->graph.add_node(node_id);
 }
 
 void eDAG::add_op(const std::string &name,
@@ -662,15 +1447,39 @@ void eDAG::add_op(const std::string &name,
 				  bool is_unary) {
 	std::string node_id = this->generate_id();
 
-	auto node = std::make_shared<eNode>(NodeType::OPERATION,
-										name,
-										0.0,
-										op,
-										precedence,
-										is_unary);
+	auto node = pool->make_node(NodeType::OPERATION,
+								name,
+								0.0,
+								op,
+								precedence,
+								is_unary);
+
+	std::vector<Fingerprint> none;
+	node->fp = this->op_fingerprint(op, name, none);
+
+	auto lock = pool->write();
+
+	pool->nodes[node_id] = node;
+	pool->graph.add_node(node_id);
+}
+
+void eDAG::set_folding(bool on) {
+	this->fold = on;
+}
+
+bool eDAG::folding() const {
+	return this->fold;
+}
+
+void eDAG::set_arena(bool on) {
+	this->arena = on;
+
+	if (!this->scoped && root.empty() && pool->size() == 0)
+		this->set_pool(this->fresh_pool());
+}
 
-	nodes[node_id] = node;
-	graph.add_node(node_id);
+bool eDAG::uses_arena() const {
+	return this->arena;
 }
 
 std::string eDAG::get_root() const {
@@ -682,7 +1491,7 @@ std::variant<int64_t, Rational, double> eDAG::eval(const std::unordered_map<std:
 		throw std::runtime_error("no expression parsed.");
 	}
 
-	return eval_node(root, var);
+	return eval_node(root, var).to_variant();
 }
 
 std::variant<int64_t, Rational, double> eDAG::eval_exact(const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var) const {
@@ -690,13 +1499,43 @@ std::variant<int64_t, Rational, double> eDAG::eval_exact(const std::unordered_ma
 		throw std::runtime_error("no expression parsed.");
 	}
 
-	return eval_node(root, var);
+	return eval_node(root, var).to_variant();
 }
 
 std::vector<std::string> eDAG::get_vars() const {
 	return this->get_nodes(NodeType::VARIABLE);
 }
 
+std::vector<uint32_t> eDAG::get_var_ids() const {
+	std::vector<uint32_t> ids;
+
+	if (root.empty()) {
+		auto lock = pool->read();
+
+		for (const auto &p : pool->nodes) {
+			if (p.second->type == NodeType::VARIABLE)
+				ids.push_back(p.second->symbol_id());
+		}
+
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+		return ids;
+	}
+
+	// the root's variable set, cached at intern time: no walk of the graph
+	ids = pool->node(root)->vars.slots();
+
+	auto lock = pool->read();
+
+	for (auto &id : ids)
+		id = pool->slot_syms[id];
+
+	std::sort(ids.begin(), ids.end());
+
+	return ids;
+}
+
 std::vector<std::string> eDAG::get_consts() const {
 	return this->get_nodes(NodeType::CONSTANT);
 }
@@ -706,192 +1545,2208 @@ std::vector<std::string> eDAG::get_ops() const {
 }
 
 bool eDAG::is_valid() const {
-	return !root.empty() && !graph.has_cycle() && graph.size() > 0;
-}
-
-// TODO
-std::string eDAG::to_string() const {
-	return "";
-}
-
-// TODO
-std::string eDAG::to_latex() const {
-	return "";
+	auto lock = pool->read();
+	return !root.empty() && !pool->graph.has_cycle() && pool->graph.size() > 0;
 }
 
-const DAG<std::string>& eDAG::get_graph() const {
-	return graph;
-}
+// x, \pi, \mathrm{rate}, x_{1}
+std::string eDAG::latex_name(const std::string &name) {
+	if (name == "pi" || name == "PI")
+		return "\\pi";
 
-std::shared_ptr<eNode> eDAG::get_node(const std::string &node_id) const {
-	auto it = nodes.find(node_id);
+	if (name == "tau" || name == "TAU")
+		return "\\tau";
 
-	if (it != nodes.end()) {
-		return it->second;
-	}
+	size_t d = name.size();
 
-	return nullptr;
-}
+	while (d > 1 && math_utils::is_digit(name[d - 1]))
+		--d;
 
-void eDAG::clear() {
-	graph.clear();
-	nodes.clear();
-	root.clear();
-	orderedc.clear();
-	leaf_intern.clear();
-	op_intern.clear();
-}
+	std::string head = name.substr(0, d);
 
-size_t eDAG::size() const {
-	return graph.size();
-}
+	if (d < name.size() && head.size() > 1 && head.back() == '_')
+		head.pop_back();
 
-bool eDAG::empty() const {
-	return (graph.size() == 0);
-}
+	std::string out;
 
-// Rational detection and conversion methods
-bool eDAG::is_rational_expression(const std::string &node_id) const {
-	auto node = get_node(node_id);
-	if (!node) return false;
-	
-	if (node->is_leaf()) {
-		return std::holds_alternative<Rational>(node->value) || std::holds_alternative<int64_t>(node->value);
-	}
-	
-	// Check if this is a function that can't be rational
-	if (node->type == NodeType::OPERATION) {
-		switch (node->op) {
-			case OPType::SIN:
-			case OPType::COS:
-			case OPType::TAN:
-			case OPType::LOG:
-			case OPType::EXP:
-			case OPType::SQRT:
-			case OPType::ABS:
-				return false;  // These functions generally don't produce rational results
-			default:
-				break;
-		}
-	}
-	
-	// Check if all children are rational
-	auto neighbors = graph.get_neighbors(node_id);
-	for (const auto &child : neighbors) {
-		if (!is_rational_expression(child)) {
-			return false;
-		}
-	}
-	
-	return true;
-}
+	if (head.size() == 1) {
+		out = head;
+	} else {
+		out = "\\mathrm{";
 
-Rational eDAG::to_rational(const std::string &node_id) const {
-	auto node = get_node(node_id);
-	if (!node) throw std::runtime_error("Node not found");
-	
-	if (node->is_leaf()) {
-		if (std::holds_alternative<Rational>(node->value)) {
-			return std::get<Rational>(node->value);
-		} else if (std::holds_alternative<int64_t>(node->value)) {
-			return Rational(std::get<int64_t>(node->value), 1);
-		} else {
-			return Rational(std::get<double>(node->value));
-		}
-	}
-	
-	// Evaluate the node and convert to rational
-	auto result = eval_node(node_id, {});
-	return variant_to_rational(result);
-}
+		for (char c : head)
+			out += (c == '_') ? std::string("\\_") : std::string(1, c);
 
-Rational eDAG::to_rational() const {
-	if (root.empty()) {
-		throw std::runtime_error("No expression parsed");
+		out += "}";
 	}
-	return to_rational(root);
-}
 
-// Exact simplification methods
-eDAG eDAG::simplify_exact() const {
-	eDAG result = *this;
-	
-	// Apply exact simplifications
-	result = result.combine_like_terms();
-	result = result.factor_rationals();
-	
-	return result;
-}
+	if (d < name.size())
+		out += "_{" + name.substr(d) + "}";
 
-eDAG eDAG::combine_like_terms() const {
-	// For now, return a copy - full implementation would require
-	// polynomial detection and like-term combining
-	eDAG result = *this;
-	return result;
+	return out;
 }
 
-eDAG eDAG::factor_rationals() const {
-	// For now, return a copy - full implementation would require
-	// rational factorization and simplification
-	eDAG result = *this;
-	return result;
-}
+void eDAG::print_node(std::ostream &out,
+					  const std::string &node_id,
+					  bool latex,
+					  const std::unordered_map<std::string, std::string> &names) const {
+	// how an operand binds: precedence (5 for atoms), whether it starts
+	// with a minus, and whether it needs parentheses as a base in LaTeX
+	// (fractions and e^{x})
+	struct Shape {
+		int prec = 5;
+		bool neg = 0;
+		bool script = 0;
+	};
 
-eDAG eDAG::canonicalize() const {
-	eDAG out;
+	auto named = [&](const std::string &id) {
+		return (id != node_id) ? names.find(id) : names.end();
+	};
 
-	std::function<std::string(const std::string&)> clone_id = [&](const std::string &id) -> std::string {
-		auto it = nodes.find(id);
+	auto shape = [&](const eNode *node) {
+		Shape sh;
 
-		if (it == nodes.end()) {
-			throw std::runtime_error("node not found: " + id);
-		}
+		if (!node)
+			return sh;
 
-		const auto &node = it->second;
+		if (node->type == NodeType::CONSTANT) {
+			if (node->value.is_exact()) {
+				Rational r = node->value.to_rational();
+				sh.neg = (r.numerator() < 0);
 
-		if (node->is_leaf()) {
-			if (node->type == NodeType::VARIABLE) {
-				return out.intern_leaf(NodeType::VARIABLE, node->symbol, 0.0);
-			} else {
-				// Convert value to string for symbol
-				std::string symbol;
-				if (std::holds_alternative<Rational>(node->value)) {
-					Rational r = std::get<Rational>(node->value);
-					if (r.denominator() == 1) {
-						symbol = std::to_string(r.numerator());
-					} else {
-						symbol = std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
-					}
-				} else if (std::holds_alternative<int64_t>(node->value)) {
-					symbol = std::to_string(std::get<int64_t>(node->value));
-				} else {
-					symbol = std::to_string(std::get<double>(node->value));
+				if (r.denominator() != 1 && !math_utils::is_num(node->symbol())) {
+					sh.prec = latex ? 5 : 2;
+					sh.script = 1;
 				}
-				return out.intern_leaf(NodeType::CONSTANT, symbol, node->value);
+			} else {
+				sh.neg = (node->value.to_double() < 0);
+			}
+		} else if (node->type == NodeType::OPERATION) {
+			sh.prec = math_utils::get_op_precedence(node->op);
+			sh.neg = (node->op == OPType::NEGATE);
+
+			if (latex && (node->op == OPType::DIVIDE || node->op == OPType::EXP)) {
+				sh.prec = 5;
+				sh.script = 1;
 			}
 		}
 
-		auto itc = orderedc.find(id);
+		return sh;
+	};
+
+	// operand k of op needs parentheses; function arguments, fractions and
+	// exponents in LaTeX are delimited already
+	auto wrap = [&](OPType op, size_t k, const Shape &sh) {
+		switch (op) {
+			case OPType::NEGATE:
+				return (sh.prec < 4 || sh.neg);
+			case OPType::POWER:
+				if (k == 0)
+					return (sh.prec <= 3 || sh.neg || (latex && sh.script));
+
+				return (!latex && sh.prec < 3);
+			case OPType::DIVIDE:
+				if (latex)
+					return false;
+				[[fallthrough]];
+			case OPType::ADD:
+			case OPType::SUBTRACT:
+			case OPType::MULTIPLY: {
+				int prec = math_utils::get_op_precedence(op);
+
+				if (k == 0)
+					return (sh.prec < prec);
+
+				return (sh.prec <= prec || sh.neg);
+			}
+			default:
+				return false;
+		}
+	};
+
+	auto open = [&](OPType op) -> const char* {
+		switch (op) {
+			case OPType::NEGATE: return "-";
+			case OPType::DIVIDE: return latex ? "\\frac{" : "";
+			case OPType::SIN: return latex ? "\\sin\\left(" : "sin(";
+			case OPType::COS: return latex ? "\\cos\\left(" : "cos(";
+			case OPType::TAN: return latex ? "\\tan\\left(" : "tan(";
+			case OPType::LOG: return latex ? "\\ln\\left(" : "log(";
+			case OPType::EXP: return latex ? "e^{" : "exp(";
+			case OPType::SQRT: return latex ? "\\sqrt{" : "sqrt(";
+			case OPType::ABS: return latex ? "\\left|" : "abs(";
+			default: return "";
+		}
+	};
+
+	auto sep = [&](OPType op) -> const char* {
+		switch (op) {
+			case OPType::ADD: return " + ";
+			case OPType::SUBTRACT: return " - ";
+			case OPType::MULTIPLY: return latex ? " \\cdot " : " * ";
+			case OPType::DIVIDE: return latex ? "}{" : " / ";
+			case OPType::POWER: return latex ? "^{" : "^";
+			default: return ", ";
+		}
+	};
+
+	auto close = [&](OPType op) -> const char* {
+		switch (op) {
+			case OPType::ADD:
+			case OPType::SUBTRACT:
+			case OPType::MULTIPLY:
+			case OPType::NEGATE:
+				return "";
+			case OPType::DIVIDE:
+			case OPType::POWER:
+				return latex ? "}" : "";
+			case OPType::EXP:
+			case OPType::SQRT:
+				return latex ? "}" : ")";
+			case OPType::ABS:
+				return latex ? "\\right|" : ")";
+			default:
+				return latex ? "\\right)" : ")";
+		}
+	};
+
+	const char *lparen = latex ? "\\left(" : "(";
+	const char *rparen = latex ? "\\right)" : ")";
+
+	struct Frame {
+		OPType op;
+		const std::pmr::vector<std::string> *kids;
+		size_t k;
+		// the operand being printed is parenthesized
+		bool wrapped;
+	};
+
+	// explicit stack: chains a million deep print without recursion
+	std::vector<Frame> work;
+
+	// print a leaf, or start an operator
+	auto enter = [&](const std::string &id, const eNode *node) {
+		if (node->type == NodeType::VARIABLE) {
+			out << (latex ? latex_name(node->symbol()) : node->symbol());
+		} else if (node->type == NodeType::CONSTANT && math_utils::is_num(node->symbol())) {
+			// a literal as written, "0.5", reads back as the same constant
+			out << node->symbol();
+		} else if (node->type == NodeType::CONSTANT && latex && node->value.is_rational() &&
+				   node->value.to_rational().denominator() != 1) {
+			Rational r = node->value.to_rational();
+
+			out << (r.numerator() < 0 ? "-" : "") << "\\frac{"
+				<< (r.numerator() < 0 ? -r.numerator() : r.numerator()) << "}{"
+				<< r.denominator() << "}";
+		} else if (node->type == NodeType::OPERATION) {
+			out << open(node->op);
+			work.push_back({ node->op, &pool->children(id), 0, 0 });
+		} else {
+			out << node->to_string();
+		}
+	};
+
+	enter(node_id, pool->node(node_id).get());
+
+	while (!work.empty()) {
+		Frame &f = work.back();
+
+		if (f.wrapped)
+			out << rparen;
+
+		if (f.k == f.kids->size()) {
+			out << close(f.op);
+			work.pop_back();
+			continue;
+		}
+
+		const std::string &c = (*f.kids)[f.k];
+		auto it = named(c);
+		// names print as atoms
+		const eNode *node = (it == names.end()) ? pool->node(c).get() : nullptr;
+
+		if (f.k > 0)
+			out << sep(f.op);
+
+		f.wrapped = wrap(f.op, f.k, shape(node));
+		f.k++;
+
+		if (f.wrapped)
+			out << lparen;
+
+		if (node)
+			enter(c, node); // may push, so f is not used after this
+		else
+			out << (latex ? latex_name(it->second) : it->second);
+	}
+}
+
+void eDAG::print(std::ostream &out, bool latex, bool let) const {
+	if (root.empty())
+		return;
+
+	std::unordered_map<std::string, std::string> names;
+	std::vector<std::string> bound;
+
+	if (let) {
+		std::vector<std::string> order = this->post_order(root);
+		std::unordered_map<std::string, size_t> uses;
+
+		for (const auto &id : order) {
+			auto kids = pool->find_children(id);
+
+			if (kids) {
+				for (const auto &c : *kids)
+					uses[c]++;
+			}
+		}
+
+		// binding names start with a prefix no variable starts with
+		std::vector<std::string> vars = this->free_vars();
+		std::string prefix = "t";
+
+		auto clash = [&]() {
+			for (const auto &v : vars) {
+				if (v.compare(0, prefix.size(), prefix) == 0)
+					return 1;
+			}
+
+			return 0;
+		};
+
+		while (clash())
+			prefix += "_";
+
+		// children first, so each binding only uses earlier ones
+		for (const auto &id : order) {
+			if (uses[id] > 1 && pool->node(id)->type == NodeType::OPERATION) {
+				bound.push_back(id);
+				names.emplace(id, prefix + std::to_string(bound.size()));
+			}
+		}
+	}
+
+	for (const auto &id : bound) {
+		if (latex)
+			out << "\\mathrm{let}\\ " << latex_name(names.at(id)) << " = ";
+		else
+			out << "let " << names.at(id) << " = ";
+
+		this->print_node(out, id, latex, names);
+		out << (latex ? "\\ \\mathrm{in}\\ " : " in ");
+	}
+
+	this->print_node(out, root, latex, names);
+}
+
+std::string eDAG::to_string(bool let) const {
+	std::ostringstream out;
+	this->print(out, 0, let);
+	return out.str();
+}
+
+void eDAG::to_string(std::ostream &out, bool let) const {
+	this->print(out, 0, let);
+}
+
+std::string eDAG::to_latex(bool let) const {
+	std::ostringstream out;
+	this->print(out, 1, let);
+	return out.str();
+}
+
+void eDAG::to_latex(std::ostream &out, bool let) const {
+	this->print(out, 1, let);
+}
+
+// symbols nodes get when the expression is parsed or built, which the binary
+// format leaves out
+std::string eDAG::usual_const_sym(const Number &v) {
+	if (!v.is_exact())
+		return std::to_string(v.to_double());
+
+	Rational r = v.to_rational();
+	std::string sym = std::to_string(r.numerator());
+
+	if (r.denominator() != 1)
+		sym += "/" + std::to_string(r.denominator());
+
+	return sym;
+}
+
+std::string eDAG::usual_op_sym(OPType op) {
+	return (op == OPType::NEGATE) ? "neg" : math_utils::op_to_string(op);
+}
+
+// Binary format, version 1. Integers are LEB128 varints, signed ones
+// zigzag-encoded first; strings are a varint length and the bytes;
+// doubles are 8 bytes little-endian.
+//
+//   "CASB" u8 version  varint payload size  u64 FNV-1a of the payload
+//   payload: varint count, then the variable names: the symbol table
+//            varint count, then the constant pool, each a u8 kind and
+//              [string symbol] value: 0 integer: varint;
+//              1 rational: varint num, varint den; 2 double: 8 bytes
+//            varint count, then the operators children first, each a
+//              u8 2 + OPType, [string symbol] [varint arity] and a varint
+//              reference per child
+//
+// Leaves are numbered variables first, then constants. A child reference
+// is 2 * leaf for a leaf and 2 * (operator index - child index) - 1 for an
+// operator, so nearby operands take one byte. Bracketed fields are there
+// only if the kind byte has 0x80 set when the symbol isn't the usual one
+// (the number for a constant, "neg" or the op string for an operator) or
+// 0x40 set when the arity isn't 1 for unary operators and 2 for the rest.
+// The root is the last operator, or the only leaf.
+void eDAG::serialize(std::ostream &out) const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	auto put_varint = [](std::string &buf, uint64_t v) {
+		while (v >= 0x80) {
+			buf += (char) (v | 0x80);
+			v >>= 7;
+		}
+
+		buf += (char) v;
+	};
+
+	auto put_string = [&](std::string &buf, const std::string &str) {
+		put_varint(buf, str.size());
+		buf += str;
+	};
+
+	auto zigzag = [](int64_t v) {
+		return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+	};
+
+	auto put_u64 = [](std::string &buf, uint64_t v) {
+		for (int k = 0; k < 8; ++k)
+			buf += (char) (v >> (8 * k));
+	};
+
+	std::vector<std::string> order = this->post_order(root);
+	std::vector<std::shared_ptr<eNode>> vars, consts, ops;
+	std::vector<std::string> var_ids, const_ids, op_ids;
+
+	for (const auto &id : order) {
+		auto node = pool->node(id);
+
+		if (node->type == NodeType::VARIABLE) {
+			vars.push_back(node);
+			var_ids.push_back(id);
+		} else if (node->type == NodeType::CONSTANT) {
+			consts.push_back(node);
+			const_ids.push_back(id);
+		} else if (node->type == NodeType::OPERATION && node->op != OPType::UNKNOWN) {
+			ops.push_back(node);
+			op_ids.push_back(id);
+		} else {
+			throw std::runtime_error("can't serialize node: " + node->to_string());
+		}
+	}
+
+	std::string payload;
+	put_varint(payload, vars.size());
+
+	for (const auto &node : vars)
+		put_string(payload, node->symbol());
+
+	put_varint(payload, consts.size());
+
+	for (const auto &node : consts) {
+		const Number &v = node->value;
+		uint8_t named = (node->symbol() != usual_const_sym(v)) ? 0x80 : 0;
+
+		if (v.is_int()) {
+			payload += (char) (0 | named);
+		} else if (v.is_rational()) {
+			payload += (char) (1 | named);
+		} else {
+			payload += (char) (2 | named);
+		}
+
+		if (named)
+			put_string(payload, node->symbol());
+
+		if (v.is_int()) {
+			put_varint(payload, zigzag(v.as_int()));
+		} else if (v.is_rational()) {
+			Rational r = v.to_rational();
+			put_varint(payload, zigzag(r.numerator()));
+			put_varint(payload, (uint64_t) r.denominator());
+		} else {
+			uint64_t bits;
+			double d = v.to_double();
+			std::memcpy(&bits, &d, sizeof(bits));
+			put_u64(payload, bits);
+		}
+	}
+
+	// child references: 2 * leaf, or 2 * distance - 1 for operators
+	std::unordered_map<std::string, uint64_t> leaf, index;
+	leaf.reserve(vars.size() + consts.size());
+	index.reserve(ops.size());
+
+	for (const auto &id : var_ids)
+		leaf.emplace(id, leaf.size());
+
+	for (const auto &id : const_ids)
+		leaf.emplace(id, leaf.size());
+
+	for (const auto &id : op_ids)
+		index.emplace(id, index.size());
+
+	put_varint(payload, ops.size());
+
+	for (size_t j = 0; j < ops.size(); ++j) {
+		const auto &node = ops[j];
+		const auto &kids = pool->children(op_ids[j]);
+		uint8_t named = (node->symbol() != usual_op_sym(node->op)) ? 0x80 : 0;
+		uint8_t arity = (kids.size() != (math_utils::is_unary(node->op) ? 1u : 2u)) ? 0x40 : 0;
+
+		payload += (char) ((2 + (int) node->op) | named | arity);
+
+		if (named)
+			put_string(payload, node->symbol());
+
+		if (arity)
+			put_varint(payload, kids.size());
+
+		for (const auto &c : kids) {
+			auto it = leaf.find(c);
+
+			if (it != leaf.end())
+				put_varint(payload, 2 * it->second);
+			else
+				put_varint(payload, 2 * (j - index.at(c)) - 1);
+		}
+	}
+
+	std::string header = "CASB";
+	header += (char) 1;
+	put_varint(header, payload.size());
+	put_u64(header, utils::fnv1a(payload.data(), payload.size()));
+
+	out << header << payload;
+}
+
+std::string eDAG::serialize() const {
+	std::ostringstream out;
+	this->serialize(out);
+	return out.str();
+}
+
+void eDAG::deserialize(const std::string &data) {
+	size_t pos = 0, end = data.size();
+
+	auto byte = [&]() -> uint8_t {
+		if (pos >= end) {
+			throw std::runtime_error("deserialize: truncated data.");
+		}
+
+		return (uint8_t) data[pos++];
+	};
+
+	auto varint = [&]() {
+		uint64_t v = 0;
+
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t b = byte();
+			v |= (uint64_t) (b & 0x7f) << shift;
+
+			if (!(b & 0x80))
+				return v;
+		}
+
+		throw std::runtime_error("deserialize: bad varint.");
+	};
+
+	// every count is bounded by the bytes left, so corrupt counts can't
+	// allocate much
+	auto count = [&]() {
+		uint64_t n = varint();
+
+		if (n > end - pos) {
+			throw std::runtime_error("deserialize: bad count.");
+		}
+
+		return n;
+	};
+
+	auto string = [&]() {
+		uint64_t len = count();
+		pos += len;
+		return data.substr(pos - len, len);
+	};
+
+	auto unzigzag = [](uint64_t v) {
+		return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+	};
+
+	auto get_u64 = [&]() {
+		uint64_t v = 0;
+
+		for (int k = 0; k < 8; ++k)
+			v |= (uint64_t) byte() << (8 * k);
+
+		return v;
+	};
+
+	if (data.compare(0, 4, "CASB") != 0) {
+		throw std::runtime_error("deserialize: not a serialized expression.");
+	}
+
+	pos = 4;
+	uint8_t version = byte();
+
+	if (version != 1) {
+		throw std::runtime_error("deserialize: unsupported version " + std::to_string(version) + ".");
+	}
+
+	uint64_t size = varint();
+	uint64_t sum = get_u64();
+
+	if (size != end - pos) {
+		throw std::runtime_error("deserialize: truncated data.");
+	}
+
+	if (utils::fnv1a(data.data() + pos, size) != sum) {
+		throw std::runtime_error("deserialize: checksum mismatch.");
+	}
+
+	this->clear();
+
+	// the nodes were interned as written, so interning them again must not
+	// fold them into something else
+	bool folding = this->fold;
+	this->fold = 0;
+
+	try {
+		std::vector<std::string> leaves(count());
+
+		for (auto &id : leaves)
+			id = this->intern_leaf(NodeType::VARIABLE, string(), 0);
+
+		size_t nvars = leaves.size();
+		leaves.resize(nvars + count());
+
+		for (size_t j = nvars; j < leaves.size(); ++j) {
+			uint8_t kind = byte();
+			std::string sym = (kind & 0x80) ? string() : std::string();
+			Number v;
+
+			switch (kind & 0x7f) {
+				case 0:
+					v = Number((int64_t) unzigzag(varint()));
+					break;
+				case 1: {
+					int64_t num = unzigzag(varint());
+					uint64_t den = varint();
+
+					if (den == 0 || den > (uint64_t) INT64_MAX) {
+						throw std::runtime_error("deserialize: bad constant.");
+					}
+
+					v = Number(Rational(num, (int64_t) den));
+					break;
+				}
+				case 2: {
+					uint64_t bits = get_u64();
+					double d;
+					std::memcpy(&d, &bits, sizeof(d));
+					v = Number(d);
+					break;
+				}
+				default:
+					throw std::runtime_error("deserialize: bad constant.");
+			}
+
+			if (!(kind & 0x80))
+				sym = usual_const_sym(v);
+
+			leaves[j] = this->intern_leaf(NodeType::CONSTANT, sym, v);
+		}
+
+		std::vector<std::string> ids(count());
+		std::vector<std::string> kids;
+
+		pool->reserve(ids.size());
+
+		for (size_t j = 0; j < ids.size(); ++j) {
+			uint8_t code = byte();
+			int kind = (code & 0x3f) - 2;
+
+			if (kind < 0 || kind >= (int) OPType::UNKNOWN) {
+				throw std::runtime_error("deserialize: bad node.");
+			}
+
+			OPType op = (OPType) kind;
+			std::string sym = (code & 0x80) ? string() : usual_op_sym(op);
+			uint64_t arity = (code & 0x40) ? count() : (math_utils::is_unary(op) ? 1 : 2);
+
+			kids.clear();
+
+			for (uint64_t k = 0; k < arity; ++k) {
+				uint64_t ref = varint();
+
+				if (!(ref & 1) && ref / 2 < leaves.size()) {
+					kids.push_back(leaves[ref / 2]);
+				} else if ((ref & 1) && ref / 2 < j) {
+					kids.push_back(ids[j - ref / 2 - 1]);
+				} else {
+					throw std::runtime_error("deserialize: bad child reference.");
+				}
+			}
+
+			ids[j] = this->intern_op_node(op,
+										  sym,
+										  math_utils::get_op_precedence(op),
+										  math_utils::is_unary(op),
+										  kids);
+		}
+
+		if (pos != end || (ids.empty() && leaves.size() != 1)) {
+			throw std::runtime_error("deserialize: bad node count.");
+		}
+
+		root = ids.empty() ? leaves[0] : ids.back();
+	} catch (...) {
+		this->fold = folding;
+		this->clear();
+		throw;
+	}
+
+	this->fold = folding;
+}
+
+// reads one record, so several can follow each other in a stream
+void eDAG::deserialize(std::istream &in) {
+	std::string data(5, '\0');
+
+	if (!in.read(&data[0], 5)) {
+		throw std::runtime_error("deserialize: truncated data.");
+	}
+
+	uint64_t size = 0;
+
+	for (int shift = 0; ; shift += 7) {
+		int b = in.get();
+
+		if (b == EOF || shift >= 64) {
+			throw std::runtime_error("deserialize: truncated data.");
+		}
+
+		data += (char) b;
+		size |= (uint64_t) (b & 0x7f) << shift;
+
+		if (!(b & 0x80))
+			break;
+	}
+
+	// in chunks, so a corrupt size fails at end of stream instead of
+	// allocating it up front
+	uint64_t left = 8 + size;
+	char chunk[1 << 16];
+
+	while (left) {
+		size_t n = (size_t) std::min<uint64_t>(left, sizeof(chunk));
+
+		if (!in.read(chunk, n)) {
+			throw std::runtime_error("deserialize: truncated data.");
+		}
+
+		data.append(chunk, n);
+		left -= n;
+	}
+
+	this->deserialize(data);
+}
+
+const DAG<std::string>& eDAG::get_graph() const {
+	return pool->graph;
+}
+
+const std::shared_ptr<ePool>& eDAG::get_pool() const {
+	return pool;
+}
+
+std::shared_ptr<eNode> eDAG::get_node(const std::string &node_id) const {
+	return pool->find(node_id);
+}
+
+void eDAG::clear() {
+	// other eDAGs may still share the old pool
+	if (!this->scoped)
+		this->set_pool(this->fresh_pool());
+
+	root.clear();
+}
+
+size_t eDAG::size() const {
+	if (root.empty())
+		return pool->size();
+
+	return this->post_order(root).size();
+}
+
+Fingerprint eDAG::fingerprint(const std::string &node_id) const {
+	auto node = pool->find(node_id);
+
+	if (!node) {
+		throw std::runtime_error("node not found: " + node_id);
+	}
+
+	return node->fp;
+}
+
+Fingerprint eDAG::fingerprint() const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	return this->fingerprint(root);
+}
+
+bool eDAG::empty() const {
+	return (root.empty() && pool->size() == 0);
+}
+
+eMetrics eDAG::metrics(const std::string &node_id) const {
+	if (!pool->find(node_id)) {
+		throw std::runtime_error("node not found: " + node_id);
+	}
+
+	auto op_cost = [](OPType op) -> uint64_t {
+		switch (op) {
+			case OPType::DIVIDE:
+				return 4;
+			case OPType::SQRT:
+				return 10;
+			case OPType::POWER:
+			case OPType::SIN:
+			case OPType::COS:
+			case OPType::TAN:
+			case OPType::LOG:
+			case OPType::EXP:
+				return 20;
+			default:
+				return 1;
+		}
+	};
+
+	auto sat_add = [](uint64_t a, uint64_t b) -> uint64_t {
+		uint64_t s;
+		return __builtin_add_overflow(a, b, &s) ? UINT64_MAX : s;
+	};
+
+	eMetrics m;
+
+	// children first, so every operand is done before its parent
+	std::vector<std::string> order = this->post_order(node_id);
+	std::unordered_map<std::string, size_t> at;
+	std::vector<uint64_t> tree(order.size());
+	std::vector<size_t> depth(order.size());
+
+	for (size_t j = 0; j < order.size(); ++j) {
+		const auto &node = pool->node(order[j]);
+		auto kids = pool->find_children(order[j]);
+
+		at.emplace(order[j], j);
+		tree[j] = 1;
+		depth[j] = 0;
+
+		if (!kids) {
+			m.cost = sat_add(m.cost, 1);
+			continue;
+		}
+
+		for (const auto &c : *kids) {
+			size_t k = at.at(c);
+			tree[j] = sat_add(tree[j], tree[k]);
+			depth[j] = std::max(depth[j], depth[k] + 1);
+		}
+
+		m.ops[node->op]++;
+		m.cost = sat_add(m.cost, op_cost(node->op) * std::max<uint64_t>(kids->size(), 1));
+	}
+
+	m.dag_size = order.size();
+	m.tree_size = tree.back();
+	m.depth = depth.back();
+
+	return m;
+}
+
+eMetrics eDAG::metrics() const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	return this->metrics(root);
+}
+
+// Rational detection and conversion methods
+bool eDAG::is_rational_expression(const std::string &node_id) const {
+	auto node = get_node(node_id);
+	if (!node) return false;
+	
+	for (const auto &id : this->post_order(node_id)) {
+		const auto &n = pool->node(id);
+
+		if (n->is_leaf()) {
+			if (!n->value.is_exact())
+				return false;
+
+			continue;
+		}
+
+		// Check if this is a function that can't be rational
+		switch (n->op) {
+			case OPType::SIN:
+			case OPType::COS:
+			case OPType::TAN:
+			case OPType::LOG:
+			case OPType::EXP:
+			case OPType::SQRT:
+			case OPType::ABS:
+				return false;  // These functions generally don't produce rational results
+			default:
+				break;
+		}
+	}
+	
+	return true;
+}
+
+Rational eDAG::to_rational(const std::string &node_id) const {
+	auto node = get_node(node_id);
+	if (!node) throw std::runtime_error("Node not found");
+	
+	if (node->is_leaf()) {
+		return node->value.to_rational();
+	}
+	
+	// Evaluate the node and convert to rational
+	return eval_node(node_id, {}).to_rational();
+}
+
+Rational eDAG::to_rational() const {
+	if (root.empty()) {
+		throw std::runtime_error("No expression parsed");
+	}
+	return to_rational(root);
+}
+
+// Exact simplification methods
+eDAG eDAG::simplify_exact() const {
+	eDAG result = *this;
+	
+	// Apply exact simplifications
+	result = result.combine_like_terms();
+	result = result.factor_rationals();
+	
+	return result;
+}
+
+// Each term of a sum is split into coefficient * key, where the key is the
+// sorted list of (factor id, exponent). Factor ids are hash-consed, so equal
+// keys mean like terms; coefficients are summed in a hash map keyed by them.
+eDAG eDAG::combine_like_terms() const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	using Key = std::vector<std::pair<std::string, int64_t>>;
+
+	struct KeyHash {
+		size_t operator()(const Key &k) const {
+			size_t h = k.size();
+
+			for (const auto &p : k) {
+				h ^= std::hash<std::string>()(p.first) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+				h ^= std::hash<int64_t>()(p.second) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+			}
+
+			return h;
+		}
+	};
+
+	eDAG out = *this;
+
+	auto split = [&](const std::string &id, Rational &coeff, Key &key) {
+		std::vector<std::pair<std::string, int64_t>> work = { { id, 1 } };
+		Rational c(0, 1);
+
+		key.clear();
+
+		while (!work.empty()) {
+			auto [f, e] = work.back();
+			work.pop_back();
+
+			const auto &node = out.pool->node(f);
+
+			if (e == 1 && out.const_value(f, c)) {
+				coeff = coeff * c;
+				continue;
+			}
+
+			if (e == 1 && node->is_op() && node->op == OPType::NEGATE) {
+				coeff = -coeff;
+				work.push_back({ out.pool->children(f)[0], 1 });
+				continue;
+			}
+
+			if (e == 1 && node->is_op() && node->op == OPType::MULTIPLY) {
+				for (const auto &g : out.pool->children(f))
+					work.push_back({ g, 1 });
+				continue;
+			}
+
+			if (node->is_op() && node->op == OPType::POWER) {
+				const auto &pc = out.pool->children(f);
+
+				if (out.const_value(pc[1], c) && c.is_int()) {
+					int64_t n;
+
+					if (__builtin_mul_overflow(e, c.numerator(), &n)) {
+						throw std::runtime_error("MUL overflow.");
+					}
+
+					key.push_back({ pc[0], n });
+					continue;
+				}
+			}
+
+			key.push_back({ f, e });
+		}
+
+		// x * x^2 -> x^3
+		std::sort(key.begin(), key.end());
+
+		Key merged;
+
+		for (const auto &p : key) {
+			if (!merged.empty() && merged.back().first == p.first) {
+				if (__builtin_add_overflow(merged.back().second, p.second, &merged.back().second)) {
+					throw std::runtime_error("ADD overflow.");
+				}
+			} else {
+				merged.push_back(p);
+			}
+		}
+
+		key.clear();
+
+		for (const auto &p : merged) {
+			if (p.second)
+				key.push_back(p);
+		}
+	};
+
+	auto build = [&](const Key &key, const Rational &coeff) {
+		if (key.empty())
+			return out.intern_const(coeff);
+
+		std::vector<std::string> fs;
+
+		for (const auto &[b, e] : key) {
+			if (e == 1) {
+				fs.push_back(b);
+			} else {
+				fs.push_back(out.intern_op_node(OPType::POWER,
+												"^",
+												math_utils::get_op_precedence(OPType::POWER),
+												0,
+												{ b, out.intern_const(Rational(e, 1)) }));
+			}
+		}
+
+		if (coeff != Rational(1, 1) && coeff != Rational(-1, 1))
+			fs.insert(fs.begin(), out.intern_const(coeff));
+
+		std::string prod = fs[0];
+
+		if (fs.size() > 1) {
+			prod = out.intern_op_node(OPType::MULTIPLY,
+									  "*",
+									  math_utils::get_op_precedence(OPType::MULTIPLY),
+									  0,
+									  fs);
+		}
+
+		if (coeff == Rational(-1, 1)) {
+			prod = out.intern_op_node(OPType::NEGATE,
+									  "neg",
+									  math_utils::get_op_precedence(OPType::NEGATE),
+									  1,
+									  { prod });
+		}
+
+		return prod;
+	};
+
+	auto combine = [&](OPType op, const std::vector<std::string> &children) {
+		std::unordered_map<Key, size_t, KeyHash> slot;
+		std::vector<Key> keys;
+		std::vector<Rational> sums;
+		Key key;
+
+		auto add = [&](const std::string &id, const Rational &sign) {
+			Rational coeff = sign;
+			split(id, coeff, key);
+
+			auto it = slot.find(key);
+
+			if (it == slot.end()) {
+				slot.emplace(key, keys.size());
+				keys.push_back(key);
+				sums.push_back(coeff);
+			} else {
+				sums[it->second] = sums[it->second] + coeff;
+			}
+		};
+
+		// a rebuilt child may itself have become a sum
+		auto add_sum = [&](const std::string &id, const Rational &sign) {
+			const auto &node = out.pool->node(id);
+
+			if (node->is_op() && node->op == OPType::ADD) {
+				for (const auto &t : out.pool->children(id))
+					add(t, sign);
+			} else {
+				add(id, sign);
+			}
+		};
+
+		if (op == OPType::SUBTRACT) {
+			add_sum(children[0], Rational(1, 1));
+			add_sum(children[1], Rational(-1, 1));
+		} else {
+			for (const auto &c : children)
+				add_sum(c, Rational(1, 1));
+		}
+
+		std::vector<std::string> terms;
+
+		for (size_t j = 0; j < keys.size(); ++j) {
+			if (!sums[j].is_zero())
+				terms.push_back(build(keys[j], sums[j]));
+		}
+
+		if (terms.empty())
+			return out.intern_const(Rational(0, 1));
+
+		if (terms.size() == 1)
+			return terms[0];
+
+		return out.intern_op_node(OPType::ADD,
+								  "+",
+								  math_utils::get_op_precedence(OPType::ADD),
+								  0,
+								  terms);
+	};
+
+	std::unordered_map<std::string, std::string> memo;
+
+	for (const auto &id : this->post_order(root)) {
+		const auto &node = pool->node(id);
+
+		if (node->is_leaf()) {
+			memo[id] = out.intern_leaf(node->type, node->symbol(), node->value);
+			continue;
+		}
+
+		std::vector<std::string> mapped;
+
+		for (const auto &c : pool->children(id))
+			mapped.push_back(memo.at(c));
+
+		std::string r;
+
+		if (node->op == OPType::ADD || node->op == OPType::SUBTRACT) {
+			try {
+				r = combine(node->op, mapped);
+			} catch (const std::runtime_error &) {
+				// coefficient overflow: keep the sum as written
+				r.clear();
+			}
+		}
+
+		if (r.empty()) {
+			r = out.intern_op_node(node->op,
+								   node->symbol(),
+								   node->precedence,
+								   node->is_unary,
+								   mapped);
+		}
+
+		memo[id] = r;
+	}
+
+	out.root = memo.at(root);
+
+	return out;
+}
+
+
+// Nodes are labelled level by level (AHU style): a node's signature is its
+// op/atom plus the labels of its children, sorted for commutative ops, and
+// labels are handed out in sorted signature order. Labels depend only on
+// structure, so they give the operand order of commutative nodes and the
+// order nodes are emitted in, whatever the ids of the input were.
+eDAG eDAG::canonical() const {
+	struct Sig {
+		int type;
+		int op;
+		bool is_unary;
+		std::string atom;
+		std::vector<size_t> kids;
+		size_t at;
+	};
+
+	auto atom_of = [](const std::shared_ptr<eNode> &node) -> std::string {
+		if (node->type == NodeType::VARIABLE || node->is_op())
+			return node->symbol();
+
+		const auto &v = node->value;
+
+		if (v.is_rational()) {
+			Rational r = v.to_rational();
+			return std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
+		} else if (v.is_int()) {
+			return std::to_string(v.as_int()) + "/1";
+		}
+
+		return double_key(v.to_double());
+	};
+
+	// work on positions in the post-order, one hash lookup per edge
+	std::vector<std::string> order = this->post_order(root);
+	std::unordered_map<std::string, size_t> index;
+	std::vector<std::vector<size_t>> kids(order.size());
+	std::vector<size_t> height(order.size(), 0), label(order.size(), 0);
+	std::vector<std::vector<size_t>> levels;
+
+	index.reserve(order.size());
+
+	for (size_t j = 0; j < order.size(); ++j) {
+		index[order[j]] = j;
+
+		auto it = pool->find_children(order[j]);
+
+		if (it) {
+			for (const auto &c : *it) {
+				size_t k = index.at(c);
+				kids[j].push_back(k);
+				height[j] = std::max(height[j], height[k] + 1);
+			}
+		}
+
+		if (levels.size() <= height[j])
+			levels.resize(height[j] + 1);
+
+		levels[height[j]].push_back(j);
+	}
+
+	std::vector<size_t> emit;
+	size_t next = 0;
+
+	for (const auto &level : levels) {
+		std::vector<Sig> sigs;
+		sigs.reserve(level.size());
+
+		for (size_t j : level) {
+			const auto &node = pool->node(order[j]);
+			Sig s{ (int) node->type, (int) node->op, node->is_unary, atom_of(node), {}, j };
+
+			if (this->is_comm(node->op)) {
+				std::stable_sort(kids[j].begin(), kids[j].end(), [&](size_t x, size_t y) {
+					return label[x] < label[y];
+				});
+			}
+
+			for (size_t k : kids[j])
+				s.kids.push_back(label[k]);
+
+			sigs.push_back(std::move(s));
+		}
+
+		std::sort(sigs.begin(), sigs.end(), [](const Sig &x, const Sig &y) {
+			return std::tie(x.type, x.op, x.is_unary, x.atom, x.kids) <
+				   std::tie(y.type, y.op, y.is_unary, y.atom, y.kids);
+		});
+
+		for (size_t j = 0; j < sigs.size(); ++j) {
+			const Sig &s = sigs[j];
+
+			// structurally equal nodes share a label
+			bool same = (j && std::tie(s.type, s.op, s.is_unary, s.atom, s.kids) ==
+							  std::tie(sigs[j-1].type, sigs[j-1].op, sigs[j-1].is_unary, sigs[j-1].atom, sigs[j-1].kids));
+
+			if (!same)
+				++next;
+
+			label[s.at] = next;
+			emit.push_back(s.at);
+		}
+	}
+
+	// a fresh pool: an existing + or * node would keep its old operand order
+	eDAG out;
+	out.fold = this->fold;
+	out.set_arena(this->arena);
+
+	std::vector<std::string> memo(order.size());
+
+	for (size_t j : emit) {
+		const auto &node = pool->node(order[j]);
+
+		if (node->is_leaf()) {
+			if (node->type == NodeType::VARIABLE) {
+				memo[j] = out.intern_leaf(NodeType::VARIABLE, node->symbol(), 0.0);
+			} else {
+				// Convert value to string for symbol
+				std::string symbol;
+				if (node->value.is_rational()) {
+					Rational r = node->value.to_rational();
+					if (r.denominator() == 1) {
+						symbol = std::to_string(r.numerator());
+					} else {
+						symbol = std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
+					}
+				} else if (node->value.is_int()) {
+					symbol = std::to_string(node->value.as_int());
+				} else {
+					// the literal as written, which reads back as the value
+					symbol = node->symbol();
+				}
+				memo[j] = out.intern_leaf(NodeType::CONSTANT, symbol, node->value);
+			}
+			continue;
+		}
 
-		std::vector<std::string> children = ((itc != orderedc.end()) ? itc->second : graph.get_neighbors(id));
 		std::vector<std::string> rebuilt;
 
-		for (const auto &c : children) {
-			rebuilt.push_back(clone_id(c));
+		for (size_t k : kids[j])
+			rebuilt.push_back(memo[k]);
+
+		memo[j] = out.intern_op_node(node->op,
+									 node->symbol(),
+									 node->precedence,
+									 node->is_unary,
+									 rebuilt);
+	}
+
+	out.root = memo[index.at(this->root)];
+	out.prune();
+
+	return out;
+}
+
+std::string eDAG::import_node(const eDAG &src, const std::string &node_id) {
+	std::unordered_map<std::string, std::string> memo;
+
+	for (const auto &id : src.post_order(node_id)) {
+		const auto &node = src.pool->node(id);
+
+		if (node->is_leaf()) {
+			memo[id] = this->intern_leaf(node->type, node->symbol(), node->value);
+			continue;
+		}
+
+		std::vector<std::string> mapped;
+
+		for (const auto &c : src.pool->children(id))
+			mapped.push_back(memo.at(c));
+
+		memo[id] = this->intern_op_node(node->op,
+										node->symbol(),
+										node->precedence,
+										node->is_unary,
+										mapped);
+	}
+
+	return memo.at(node_id);
+}
+
+// Only the cone above the substituted variables is visited: a depth-first
+// walk down from the root that skips every subgraph whose cached VarSet
+// has none of them. The result shares the pool, so everything below or
+// beside the cone is reused as is. Rebuilt nodes are re-interned, so equal
+// results collapse.
+eDAG eDAG::substitute(const std::unordered_map<std::string, std::string> &subs) const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	eDAG out = *this;
+
+	// old node id -> id in out
+	std::unordered_map<std::string, std::string> memo;
+
+	for (const auto &p : subs) {
+		std::string var = pool->find_leaf(this->make_leaf_key(NodeType::VARIABLE, p.first, 0));
+
+		if (var.empty())
+			continue;
+
+		eDAG rep;
+		rep.fold = this->fold;
+		rep.parse(p.second);
+
+		memo[var] = out.import_node(rep, rep.root);
+	}
+
+	if (memo.empty())
+		return out;
+
+	VarSet hit;
+
+	for (const auto &p : memo)
+		hit.merge(pool->node(p.first)->vars);
+
+	// nodes under the root that depend on a substituted variable, children
+	// first; subgraphs without one are kept as they are
+	std::vector<std::string> order;
+	std::unordered_set<std::string> seen;
+	std::vector<std::pair<std::string, bool>> stack = { { root, 0 } };
+
+	while (!stack.empty()) {
+		auto [id, expanded] = stack.back();
+		stack.pop_back();
+
+		if (expanded) {
+			order.push_back(id);
+			continue;
+		}
+
+		if (memo.find(id) != memo.end() || !seen.insert(id).second)
+			continue;
+
+		if (!pool->node(id)->vars.intersects(hit))
+			continue;
+
+		stack.push_back({ id, 1 });
+
+		for (const auto &c : pool->children(id)) {
+			if (seen.find(c) == seen.end())
+				stack.push_back({ c, 0 });
+		}
+	}
+
+	for (const auto &id : order) {
+		const auto &node = pool->node(id);
+		std::vector<std::string> mapped;
+
+		for (const auto &c : pool->children(id)) {
+			auto m = memo.find(c);
+			mapped.push_back(m != memo.end() ? m->second : c);
+		}
+
+		memo[id] = out.intern_op_node(node->op,
+									  node->symbol(),
+									  node->precedence,
+									  node->is_unary,
+									  mapped);
+	}
+
+	out.root = (memo.find(root) != memo.end()) ? memo.at(root) : root;
+
+	return out;
+}
+
+// Forward over the post-order: d[id] is the derivative of id, "" when it is
+// zero, so subexpressions without var add no terms. The result shares the
+// pool and is interned like any other node, so the derivative of a shared
+// subexpression is built once.
+eDAG eDAG::differentiate(const std::string &var) const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	eDAG out = *this;
+
+	uint32_t sym = Symbols::find(var);
+	uint32_t slot = (sym == Symbols::none) ? Symbols::none : pool->find_var(sym);
+
+	if (slot == Symbols::none) {
+		out.root = out.intern_const(Rational(0, 1));
+		return out;
+	}
+
+	auto make = [&](OPType op, const std::vector<std::string> &kids) {
+		return out.intern_op_node(op,
+								  usual_op_sym(op),
+								  math_utils::get_op_precedence(op),
+								  math_utils::is_unary(op),
+								  kids);
+	};
+
+	auto is_one = [&](const std::string &id) {
+		Rational r(0, 1);
+		return out.const_value(id, r) && r == Rational(1, 1);
+	};
+
+	// value of a subtree of constants, such as the 1/2 of x^(1/2), which the
+	// parser keeps as an operator
+	auto exact = [&](const std::string &id, Rational &v) {
+		if (!pool->node(id)->vars.empty() || !this->is_rational_expression(id))
+			return 0;
+
+		try {
+			v = this->to_rational(id);
+			return 1;
+		} catch (const std::runtime_error &) {
+			return 0;
 		}
+	};
+
+	auto times = [&](const std::string &a, const std::string &b) {
+		if (is_one(a))
+			return b;
+
+		if (is_one(b))
+			return a;
+
+		return make(OPType::MULTIPLY, { a, b });
+	};
+
+	auto sum = [&](const std::vector<std::string> &terms) -> std::string {
+		if (terms.empty())
+			return "";
 
-		return out.intern_op_node(node->op,
-								  node->symbol,
-								  node->precedence,
-								  node->is_unary,
-								  rebuilt);
+		return (terms.size() == 1) ? terms[0] : make(OPType::ADD, terms);
 	};
 
-	out.root = clone_id(this->root);
+	std::unordered_map<std::string, std::string> d;
+
+	for (const auto &id : this->post_order(root)) {
+		const auto &node = pool->node(id);
+
+		if (!node->vars.contains(slot)) {
+			d[id] = "";
+			continue;
+		}
+
+		if (node->type == NodeType::VARIABLE) {
+			d[id] = out.intern_const(Rational(1, 1));
+			continue;
+		}
+
+		const auto &c = pool->children(id);
+		std::vector<std::string> dc;
+
+		for (const auto &k : c)
+			dc.push_back(d.at(k));
+
+		std::string r;
+
+		switch (node->op) {
+			case OPType::ADD: {
+				std::vector<std::string> terms;
+
+				for (const auto &t : dc) {
+					if (!t.empty())
+						terms.push_back(t);
+				}
+
+				r = sum(terms);
+				break;
+			}
+			case OPType::SUBTRACT: {
+				std::vector<std::string> rest;
+
+				for (size_t k = 1; k < dc.size(); ++k) {
+					if (!dc[k].empty())
+						rest.push_back(dc[k]);
+				}
+
+				if (rest.empty()) {
+					r = dc[0];
+				} else if (dc[0].empty()) {
+					r = make(OPType::NEGATE, { sum(rest) });
+				} else {
+					rest.insert(rest.begin(), dc[0]);
+					r = make(OPType::SUBTRACT, rest);
+				}
+				break;
+			}
+			case OPType::MULTIPLY: {
+				std::vector<std::string> terms;
+
+				for (size_t k = 0; k < c.size(); ++k) {
+					if (dc[k].empty())
+						continue;
+
+					std::vector<std::string> fs;
+
+					for (size_t j = 0; j < c.size(); ++j) {
+						if (j != k)
+							fs.push_back(c[j]);
+					}
+
+					if (!is_one(dc[k]))
+						fs.push_back(dc[k]);
+
+					terms.push_back((fs.size() == 1) ? fs[0] : make(OPType::MULTIPLY, fs));
+				}
+
+				r = sum(terms);
+				break;
+			}
+			case OPType::DIVIDE: {
+				if (c.size() != 2) {
+					throw std::runtime_error("derivative: unsupported division arity.");
+				}
+
+				const std::string &u = c[0], &v = c[1], &du = dc[0], &dv = dc[1];
+
+				if (dv.empty()) {
+					r = make(OPType::DIVIDE, { du, v });
+					break;
+				}
+
+				std::string v2 = make(OPType::POWER, { v, out.intern_const(Rational(2, 1)) });
+				std::string udv = times(u, dv);
+
+				if (du.empty()) {
+					r = make(OPType::NEGATE, { make(OPType::DIVIDE, { udv, v2 }) });
+				} else {
+					r = make(OPType::DIVIDE, { make(OPType::SUBTRACT, { times(du, v), udv }), v2 });
+				}
+				break;
+			}
+			case OPType::POWER: {
+				const std::string &u = c[0], &v = c[1], &du = dc[0], &dv = dc[1];
+				Rational n(0, 1);
+
+				if (dv.empty()) {
+					// v * u^(v - 1) * du
+					std::string p, v_id = v;
+
+					if (exact(v, n)) {
+						Rational m = n - Rational(1, 1);
+						p = (m == Rational(1, 1)) ? u : make(OPType::POWER, { u, out.intern_const(m) });
+						v_id = out.intern_const(n);
+					} else {
+						p = make(OPType::POWER, { u, make(OPType::SUBTRACT, { v, out.intern_const(Rational(1, 1)) }) });
+					}
+
+					r = times(make(OPType::MULTIPLY, { v_id, p }), du);
+				} else if (du.empty()) {
+					// u^v * log(u) * dv, log(e) = 1
+					const auto &base = pool->node(u);
+					bool is_e = (base->type == NodeType::VARIABLE && base->symbol() == "e");
+
+					r = times(is_e ? id : make(OPType::MULTIPLY, { id, make(OPType::LOG, { u }) }), dv);
+				} else {
+					// u^v * (dv * log(u) + v * du / u)
+					std::string a = times(make(OPType::LOG, { u }), dv);
+					std::string b = make(OPType::DIVIDE, { times(v, du), u });
+
+					r = make(OPType::MULTIPLY, { id, make(OPType::ADD, { a, b }) });
+				}
+				break;
+			}
+			case OPType::NEGATE:
+				r = make(OPType::NEGATE, { dc[0] });
+				break;
+			case OPType::SIN:
+				r = times(make(OPType::COS, { c[0] }), dc[0]);
+				break;
+			case OPType::COS:
+				r = make(OPType::NEGATE, { times(make(OPType::SIN, { c[0] }), dc[0]) });
+				break;
+			case OPType::TAN: {
+				std::string cos2 = make(OPType::POWER, { make(OPType::COS, { c[0] }), out.intern_const(Rational(2, 1)) });
+				r = make(OPType::DIVIDE, { dc[0], cos2 });
+				break;
+			}
+			case OPType::LOG:
+				r = make(OPType::DIVIDE, { dc[0], c[0] });
+				break;
+			case OPType::EXP:
+				r = times(id, dc[0]);
+				break;
+			case OPType::SQRT:
+				r = make(OPType::DIVIDE, { dc[0], make(OPType::MULTIPLY, { out.intern_const(Rational(2, 1)), id }) });
+				break;
+			case OPType::ABS:
+				// sign(u) * du, undefined at 0 like u / |u|
+				r = times(make(OPType::DIVIDE, { c[0], id }), dc[0]);
+				break;
+			default:
+				throw std::runtime_error("derivative: unsupported op: " + node->symbol());
+		}
+
+		d[id] = r;
+	}
+
+	const std::string &dr = d.at(root);
+	out.root = dr.empty() ? out.intern_const(Rational(0, 1)) : dr;
 
 	return out;
 }
 
+// 64-bit modular arithmetic for the primes equivalent() draws from
+static uint64_t eq_mulmod(uint64_t a, uint64_t b, uint64_t p) {
+	return (uint64_t) ((unsigned __int128) a * b % p);
+}
+
+static uint64_t eq_powmod(uint64_t b, uint64_t e, uint64_t p) {
+	uint64_t r = 1;
+
+	while (e) {
+		if (e & 1)
+			r = eq_mulmod(r, b, p);
+
+		b = eq_mulmod(b, b, p);
+		e >>= 1;
+	}
+
+	return r;
+}
+
+// Miller-Rabin with the bases that decide every 64-bit n
+static bool eq_is_prime(uint64_t n) {
+	if (n < 2)
+		return 0;
+
+	static const uint64_t bases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+
+	for (uint64_t q : bases) {
+		if (n % q == 0)
+			return n == q;
+	}
+
+	uint64_t d = n - 1;
+	int s = 0;
+
+	while (!(d & 1)) {
+		d >>= 1;
+		++s;
+	}
+
+	for (uint64_t q : bases) {
+		uint64_t x = eq_powmod(q, d, n);
+
+		if (x == 1 || x == n - 1)
+			continue;
+
+		bool composite = 1;
+
+		for (int r = 1; r < s && composite; ++r) {
+			x = eq_mulmod(x, x, n);
+			composite = (x != n - 1);
+		}
+
+		if (composite)
+			return 0;
+	}
+
+	return 1;
+}
+
+// Schwartz-Zippel: a nonzero polynomial of degree D vanishes at a uniform
+// random point mod p with probability at most D/p. Each node gets a bound
+// (num, den) on the degrees of the numerator and denominator it is built
+// as, without cancelling, and a - b = (Na Db - Nb Da) / (Da Db), so a wrong
+// "equal" per point has probability at most max(na + db, nb + da) / p.
+// Points where a denominator vanishes are drawn again. Primes are drawn
+// too, so a difference whose coefficients one fixed prime divides can't
+// pass every trial.
+bool eDAG::equivalent(const eDAG &a, const eDAG &b, double error) {
+	if (a.root.empty() || b.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	if (a.fingerprint() == b.fingerprint())
+		return 1;
+
+	// degree bounds saturate well below any prime drawn
+	const uint64_t DEG_MAX = 1ULL << 60;
+
+	auto sat_add = [&](uint64_t x, uint64_t y) {
+		return std::min(DEG_MAX, x + y);
+	};
+
+	auto sat_mul = [&](uint64_t x, uint64_t y) {
+		return (x && y > DEG_MAX / x) ? DEG_MAX : std::min(DEG_MAX, x * y);
+	};
+
+	struct Op {
+		const eNode *node;
+		std::vector<uint32_t> kids;
+		// variables: index into names
+		uint32_t var = 0;
+		// POWER by a constant integer
+		int64_t exponent = 0;
+	};
+
+	struct Flat {
+		std::vector<Op> ops;
+		// + - * /, negation, integer powers, exact constants and variables
+		// other than pi, e and tau only
+		bool rational = 1;
+		uint64_t num = 0, den = 0;
+	};
+
+	std::unordered_map<std::string, uint32_t> names;
+
+	auto flatten = [&](const eDAG &dag) {
+		Flat f;
+		std::vector<std::string> order = dag.post_order(dag.root);
+		std::unordered_map<std::string, uint32_t> at;
+		// exact value of constant subtrees, for exponents
+		std::vector<bool> known(order.size(), 0);
+		std::vector<Rational> value(order.size(), Rational(0, 1));
+		std::vector<uint64_t> num(order.size(), 0), den(order.size(), 0);
+
+		at.reserve(order.size());
+		f.ops.reserve(order.size());
+
+		for (uint32_t j = 0; j < order.size(); ++j) {
+			const auto &node = dag.pool->node(order[j]);
+			Op o;
+
+			at[order[j]] = j;
+			o.node = node.get();
+
+			if (node->type == NodeType::VARIABLE) {
+				const std::string &s = node->symbol();
+
+				if (s == "pi" || s == "PI" || s == "e" || s == "tau" || s == "TAU")
+					f.rational = 0;
+
+				o.var = names.emplace(s, (uint32_t) names.size()).first->second;
+				num[j] = 1;
+			} else if (node->type == NodeType::CONSTANT) {
+				if (node->value.is_exact()) {
+					known[j] = 1;
+					value[j] = node->value.to_rational();
+				} else {
+					f.rational = 0;
+				}
+			} else {
+				for (const auto &c : dag.pool->children(order[j]))
+					o.kids.push_back(at.at(c));
+
+				const auto &k = o.kids;
+				bool all_known = 1;
+
+				for (uint32_t c : k)
+					all_known = all_known && known[c];
+
+				try {
+					switch (node->op) {
+						case OPType::ADD:
+						case OPType::SUBTRACT:
+							// (n1 d2 + n2 d1) / (d1 d2), across the operands
+							num[j] = num[k[0]];
+							den[j] = den[k[0]];
+
+							for (size_t i = 1; i < k.size(); ++i) {
+								num[j] = std::max(sat_add(num[j], den[k[i]]), sat_add(num[k[i]], den[j]));
+								den[j] = sat_add(den[j], den[k[i]]);
+							}
+
+							if (all_known) {
+								Rational v = value[k[0]];
+
+								for (size_t i = 1; i < k.size(); ++i)
+									v = (node->op == OPType::ADD) ? v + value[k[i]] : v - value[k[i]];
+
+								value[j] = v;
+								known[j] = 1;
+							}
+							break;
+						case OPType::MULTIPLY:
+						case OPType::DIVIDE:
+							num[j] = num[k[0]];
+							den[j] = den[k[0]];
+
+							for (size_t i = 1; i < k.size(); ++i) {
+								bool mul = (node->op == OPType::MULTIPLY);
+								num[j] = sat_add(num[j], mul ? num[k[i]] : den[k[i]]);
+								den[j] = sat_add(den[j], mul ? den[k[i]] : num[k[i]]);
+							}
+
+							if (all_known) {
+								Rational v = value[k[0]];
+								bool ok = 1;
+
+								for (size_t i = 1; i < k.size() && ok; ++i) {
+									if (node->op == OPType::MULTIPLY) {
+										v = v * value[k[i]];
+									} else if (value[k[i]] == Rational(0, 1)) {
+										ok = 0;
+									} else {
+										v = v / value[k[i]];
+									}
+								}
+
+								value[j] = v;
+								known[j] = ok;
+							}
+							break;
+						case OPType::NEGATE:
+							num[j] = num[k[0]];
+							den[j] = den[k[0]];
+
+							if (all_known) {
+								value[j] = -value[k[0]];
+								known[j] = 1;
+							}
+							break;
+						case OPType::POWER: {
+							const Rational &e = value[k[1]];
+
+							if (!known[k[1]] || e.denominator() != 1) {
+								f.rational = 0;
+								break;
+							}
+
+							o.exponent = e.numerator();
+							uint64_t m = (o.exponent < 0) ? -(uint64_t) o.exponent : (uint64_t) o.exponent;
+
+							num[j] = sat_mul(m, (o.exponent < 0) ? den[k[0]] : num[k[0]]);
+							den[j] = sat_mul(m, (o.exponent < 0) ? num[k[0]] : den[k[0]]);
+
+							Rational v(0, 1);
+
+							if (known[k[0]] && math_utils::exact_pow(value[k[0]], o.exponent, v)) {
+								value[j] = v;
+								known[j] = 1;
+							}
+							break;
+						}
+						default:
+							f.rational = 0;
+							break;
+					}
+				} catch (const std::runtime_error &) {
+					// overflow: the value stays unknown, the degrees hold
+					known[j] = 0;
+				}
+
+				if (known[j])
+					num[j] = den[j] = 0;
+			}
+
+			f.ops.push_back(std::move(o));
+		}
+
+		f.num = num.back();
+		f.den = den.back();
+
+		return f;
+	};
+
+	Flat fa = flatten(a), fb = flatten(b);
+
+	static thread_local std::mt19937_64 rng(std::random_device{}());
+
+	if (fa.rational && fb.rational) {
+		uint64_t deg = std::max(sat_add(fa.num, fb.den), sat_add(fb.num, fa.den));
+		const uint64_t LO = 1ULL << 61;
+
+		// primes are above 2^61, so each point errs with probability at
+		// most deg / 2^61
+		double q = (double) deg / (double) LO;
+		size_t trials = 0;
+
+		if (deg == 0) {
+			trials = 1;
+		} else if (q < 0.5) {
+			trials = (size_t) std::ceil(std::log(error) / std::log(q));
+			trials = std::max<size_t>(trials, 1);
+		}
+
+		std::vector<uint64_t> x(names.size()), va, vb;
+
+		// value of f at x mod p, false if a denominator vanishes
+		auto eval_mod = [&](const Flat &f, std::vector<uint64_t> &v, uint64_t p) {
+			v.resize(f.ops.size());
+
+			for (size_t j = 0; j < f.ops.size(); ++j) {
+				const Op &o = f.ops[j];
+				const auto &k = o.kids;
+				const eNode &node = *o.node;
+
+				if (node.type == NodeType::VARIABLE) {
+					v[j] = x[o.var];
+					continue;
+				}
+
+				if (node.type == NodeType::CONSTANT) {
+					Rational r = node.value.to_rational();
+					uint64_t n = (uint64_t) (r.numerator() % (int64_t) p + (int64_t) p) % p;
+					uint64_t d = (uint64_t) r.denominator() % p;
+
+					if (d == 0)
+						return 0;
+
+					v[j] = eq_mulmod(n, eq_powmod(d, p - 2, p), p);
+					continue;
+				}
+
+				uint64_t r = v[k[0]];
+
+				switch (node.op) {
+					case OPType::ADD:
+						for (size_t i = 1; i < k.size(); ++i)
+							r = (r + v[k[i]]) % p;
+						break;
+					case OPType::SUBTRACT:
+						for (size_t i = 1; i < k.size(); ++i)
+							r = (r + p - v[k[i]]) % p;
+						break;
+					case OPType::MULTIPLY:
+						for (size_t i = 1; i < k.size(); ++i)
+							r = eq_mulmod(r, v[k[i]], p);
+						break;
+					case OPType::DIVIDE:
+						for (size_t i = 1; i < k.size(); ++i) {
+							if (v[k[i]] == 0)
+								return 0;
+
+							r = eq_mulmod(r, eq_powmod(v[k[i]], p - 2, p), p);
+						}
+						break;
+					case OPType::NEGATE:
+						r = (p - r) % p;
+						break;
+					case OPType::POWER:
+						if (o.exponent < 0) {
+							if (r == 0)
+								return 0;
+
+							r = eq_powmod(eq_powmod(r, p - 2, p), -(uint64_t) o.exponent, p);
+						} else {
+							r = eq_powmod(r, (uint64_t) o.exponent, p);
+						}
+						break;
+					default:
+						break;
+				}
+
+				v[j] = r;
+			}
+
+			return 1;
+		};
+
+		for (size_t t = 0, bad = 0; t < trials; ) {
+			uint64_t p;
+
+			do {
+				p = (LO + (rng() & (LO - 1))) | 1;
+			} while (!eq_is_prime(p));
+
+			for (auto &xi : x)
+				xi = rng() % p;
+
+			if (!eval_mod(fa, va, p) || !eval_mod(fb, vb, p)) {
+				// a pole or 0/0 everywhere: leave it to the numbers
+				if (++bad > 16)
+					break;
+
+				continue;
+			}
+
+			if (va.back() != vb.back())
+				return 0;
+
+			if (++t == trials)
+				return 1;
+		}
+	}
+
+	// Numerically, in long double at points of either sign with magnitudes
+	// in [1/32, 32], so that abs, sqrt and log see negative arguments too.
+	// m[j] bounds the magnitudes summed into v[j]; the rounding error of
+	// v[j] is a small multiple of m[j] times the unit roundoff, so the
+	// values must agree to a relative 1e-12 of it, with no absolute floor.
+	// Points where both are undefined are skipped; a point where only one
+	// is defined is a mismatch.
+	std::vector<long double> x(names.size()), va, vb, ma, mb;
+
+	auto eval_num = [&](const Flat &f, std::vector<long double> &v, std::vector<long double> &m) {
+		v.resize(f.ops.size());
+		m.resize(f.ops.size());
+
+		for (size_t j = 0; j < f.ops.size(); ++j) {
+			const Op &o = f.ops[j];
+			const auto &k = o.kids;
+			const eNode &node = *o.node;
+
+			if (node.type == NodeType::VARIABLE) {
+				const std::string &s = node.symbol();
+
+				if (s == "pi" || s == "PI")
+					v[j] = 3.141592653589793238462643383279502884L;
+				else if (s == "e")
+					v[j] = 2.718281828459045235360287471352662498L;
+				else if (s == "tau" || s == "TAU")
+					v[j] = 6.283185307179586476925286766559005768L;
+				else
+					v[j] = x[o.var];
+
+				m[j] = std::fabs(v[j]);
+				continue;
+			}
+
+			if (node.type == NodeType::CONSTANT) {
+				if (node.value.is_exact()) {
+					Rational r = node.value.to_rational();
+					v[j] = (long double) r.numerator() / (long double) r.denominator();
+				} else {
+					v[j] = node.value.to_double();
+				}
+
+				m[j] = std::fabs(v[j]);
+				continue;
+			}
+
+			long double r = v[k[0]], mr = m[k[0]];
+
+			switch (node.op) {
+				case OPType::ADD:
+					for (size_t i = 1; i < k.size(); ++i) {
+						r += v[k[i]];
+						mr += m[k[i]];
+					}
+					break;
+				case OPType::SUBTRACT:
+					for (size_t i = 1; i < k.size(); ++i) {
+						r -= v[k[i]];
+						mr += m[k[i]];
+					}
+					break;
+				case OPType::MULTIPLY:
+					for (size_t i = 1; i < k.size(); ++i) {
+						r *= v[k[i]];
+						mr *= m[k[i]];
+					}
+					break;
+				case OPType::DIVIDE:
+					for (size_t i = 1; i < k.size(); ++i) {
+						r /= v[k[i]];
+						mr /= std::fabs(v[k[i]]);
+					}
+					break;
+				case OPType::NEGATE: r = -r; break;
+				case OPType::POWER: r = std::pow(r, v[k[1]]); mr = std::fabs(r); break;
+				case OPType::SIN: r = std::sin(r); mr = std::fabs(r); break;
+				case OPType::COS: r = std::cos(r); mr = std::fabs(r); break;
+				case OPType::TAN: r = std::tan(r); mr = std::fabs(r); break;
+				case OPType::LOG: r = std::log(r); mr = std::fabs(r); break;
+				case OPType::EXP: r = std::exp(r); mr = std::fabs(r); break;
+				case OPType::SQRT: r = std::sqrt(r); mr = std::fabs(r); break;
+				case OPType::ABS: r = std::fabs(r); break;
+				default:
+					throw std::runtime_error("equivalent: unsupported op: " + node.symbol());
+			}
+
+			v[j] = r;
+			m[j] = mr;
+		}
+	};
+
+	// a different function is taken to agree at a random point with
+	// probability at most 1/2, so log2(1/error) points bound a wrong true
+	size_t points = 8;
+
+	if (error > 0 && error < 1)
+		points = std::max<size_t>(points, (size_t) std::ceil(-std::log2(error)));
+	else if (error <= 0)
+		points = 256;
+
+	std::uniform_real_distribution<double> magnitude(-5.0, 5.0);
+	size_t compared = 0;
+
+	for (size_t t = 0; t < points; ++t) {
+		for (auto &xi : x) {
+			xi = std::exp2((long double) magnitude(rng));
+
+			if (rng() & 1)
+				xi = -xi;
+		}
+
+		eval_num(fa, va, ma);
+		eval_num(fb, vb, mb);
+
+		long double p = va.back(), q = vb.back();
+
+		if (std::isnan(p) && std::isnan(q))
+			continue;
+
+		if (std::isnan(p) != std::isnan(q))
+			return 0;
+
+		if (std::isinf(p) || std::isinf(q)) {
+			if (p != q)
+				return 0;
+
+			continue;
+		}
+
+		long double scale = std::max(ma.back(), mb.back());
+
+		if (std::fabs(p - q) > 1e-12L * scale)
+			return 0;
+
+		++compared;
+	}
+
+	return compared > 0;
+}
+
+bool eDAG::depends_on(const std::string &node_id, const std::string &var) const {
+	uint32_t sym = Symbols::find(var);
+
+	if (sym == Symbols::none)
+		return 0;
+
+	uint32_t slot = pool->find_var(sym);
+
+	if (slot == Symbols::none)
+		return 0;
+
+	return pool->node(node_id)->vars.contains(slot);
+}
+
+bool eDAG::depends_on(const std::string &var) const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	return this->depends_on(root, var);
+}
+
+std::vector<std::string> eDAG::free_vars(const std::string &node_id) const {
+	std::vector<uint32_t> slots = pool->node(node_id)->vars.slots();
+	std::vector<std::string> names;
+	names.reserve(slots.size());
+
+	auto lock = pool->read();
+
+	for (uint32_t s : slots)
+		names.push_back(Symbols::name(pool->slot_syms[s]));
+
+	return names;
+}
+
+std::vector<std::string> eDAG::free_vars() const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	return this->free_vars(root);
+}
+
 
 namespace math_utils {
 	OPType string_to_op(const std::string &op) {
@@ -1007,6 +3862,52 @@ namespace math_utils {
 		return has_digit;
 	}
 
+	bool exact_pow(const Rational &base, int64_t e, Rational &out) {
+		if (e == INT64_MIN || (e < 0 && base.is_zero()))
+			return 0;
+
+		Rational b = (e < 0) ? Rational(1, 1) / base : base;
+		Rational r(1, 1);
+
+		// throws on overflow
+		for (uint64_t k = (e < 0) ? -e : e; k; k >>= 1) {
+			if (k & 1)
+				r = r * b;
+
+			if (k > 1)
+				b = b * b;
+		}
+
+		out = r;
+		return 1;
+	}
+
+	bool exact_sqrt(const Rational &r, Rational &out) {
+		if (r < Rational(0, 1))
+			return 0;
+
+		auto isqrt = [](int64_t n, int64_t &root) {
+			int64_t s = (int64_t) std::sqrt((double) n);
+
+			while (s > 0 && s * s > n)
+				--s;
+
+			while ((s + 1) * (s + 1) <= n)
+				++s;
+
+			root = s;
+			return s * s == n;
+		};
+
+		int64_t n, d;
+
+		if (!isqrt(r.numerator(), n) || !isqrt(r.denominator(), d))
+			return 0;
+
+		out = Rational(n, d);
+		return 1;
+	}
+
 	bool is_var(const std::string &str) {
 		if (str.empty())
 			return 0;
@@ -4,6 +4,8 @@
 
 #include "dag.hpp"
 #include "rat.hpp"
+#include "number.hpp"
+#include "symbols.hpp"
 #include <string>
 #include <unordered_map>
 #include <memory>
@@ -11,6 +13,10 @@
 #include <vector>
 #include <sstream>
 #include <stdexcept>
+#include <mutex>
+#include <shared_mutex>
+#include <memory_resource>
+#include <map>
 
 class eNode;
 class eDAG;
@@ -39,22 +45,74 @@ enum class OPType {
 	UNKNOWN
 };
 
+// Set of variable slots of a pool (see ePool::var_slot). The first 64 slots
+// are bits of one word; the rest live in a sorted array that is shared with
+// the operand sets whenever a union adds nothing new to it.
+class VarSet {
+	private:
+		uint64_t bits = 0;
+		std::shared_ptr<const std::vector<uint32_t>> rest;
+	public:
+		static VarSet of(uint32_t slot);
+
+		void merge(const VarSet &other);
+
+		// O(1) for the first 64 slots, O(log n) after
+		bool contains(uint32_t slot) const;
+		bool intersects(const VarSet &other) const;
+
+		bool empty() const;
+		size_t size() const;
+
+		// ascending
+		std::vector<uint32_t> slots() const;
+};
+
+// 128-bit structural hash of an expression. Equal structures get equal
+// fingerprints whatever their node ids, pool or process, and operand order
+// doesn't matter under + and *. Nodes get theirs when interned, from their
+// children's, so it costs one mix per edge and no traversal.
+struct Fingerprint {
+	uint64_t hi = 0;
+	uint64_t lo = 0;
+
+	bool operator==(const Fingerprint &other) const;
+	bool operator!=(const Fingerprint &other) const;
+	// a total order that is the same in every process
+	bool operator<(const Fingerprint &other) const;
+
+	// 32 hex digits
+	std::string to_string() const;
+
+	struct Hash {
+		size_t operator()(const Fingerprint &f) const;
+	};
+};
+
 class eNode {
 	public:
 		NodeType type;
-		std::string symbol;
-		std::variant<int64_t, Rational, double> value;
+		Number value;
 		OPType op;
 		int precedence;
 		bool is_unary;
+		// variables this node depends on, filled in when it is interned
+		VarSet vars;
+		// filled in when it is interned, see Fingerprint
+		Fingerprint fp;
 
 		eNode(NodeType t,
 			  const std::string &sym,
-			  std::variant<int64_t, Rational, double> val = 0,
+			  const Number &val = 0,
 			  OPType op = OPType::UNKNOWN,
 			  int prec = 0,
 			  bool unary = false);
 
+		// the literal text is counted, see Literals
+		eNode(const eNode &other);
+		eNode& operator=(const eNode &) = delete;
+		~eNode();
+
 		std::string to_string() const;
 
 		std::variant<int64_t, Rational, double> eval(const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var = {}) const;
@@ -66,40 +124,255 @@ class eNode {
 		int get_precedence() const;
 
 		bool is_left_assoc() const;
+
+		// name, operator or literal text. Names and operators are interned
+		// in Symbols; literal text is held in Literals while the node lives,
+		// and a constant's symbol_id() is Symbols::none.
+		const std::string& symbol() const;
+		uint32_t symbol_id() const;
+
+	private:
+		uint32_t sym_id;
+		// in Symbols, or in Literals for a constant
+		const std::string *sym_name;
+};
+
+// a pointer to the text rather than a string of its own per node
+static_assert(sizeof(eNode) <= 96, "eNode grew");
+
+// Allocator for the nodes of a pool. allocate_shared keeps a copy in each
+// node's control block, so keep holds the arena for as long as the node lives.
+template <typename T>
+struct NodeAllocator {
+	using value_type = T;
+
+	std::shared_ptr<std::pmr::memory_resource> keep;
+	std::pmr::memory_resource *mr;
+
+	NodeAllocator(std::shared_ptr<std::pmr::memory_resource> keep, std::pmr::memory_resource *mr)
+		: keep(std::move(keep)), mr(mr) {}
+	template <typename U>
+	NodeAllocator(const NodeAllocator<U> &other) : keep(other.keep), mr(other.mr) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(mr->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T *p, size_t n) {
+		mr->deallocate(p, n * sizeof(T), alignof(T));
+	}
+
+	template <typename U>
+	bool operator==(const NodeAllocator<U> &other) const { return mr == other.mr; }
+	template <typename U>
+	bool operator!=(const NodeAllocator<U> &other) const { return mr != other.mr; }
+};
+
+// Hash-consed node storage. Nodes are never modified once interned, so a
+// pool can be shared by any number of eDAGs: each one is a root into it, and
+// interning only appends nodes that other roots cannot reach.
+//
+// Pools made by create() or global() are meant to be shared across eDAGs and
+// threads: lookups take a shared lock and interning an exclusive one, so
+// equal expressions built anywhere get the same node id. Private pools (the
+// default for a new eDAG) skip the locking.
+//
+// Arena pools (create_arena()) take the nodes, child lists, adjacency and
+// intern tables from one monotonic buffer, so building an expression costs a
+// handful of large allocations and dropping the pool frees them all at once.
+// Nothing is returned to the arena before then. Every node holds a reference
+// to the arena (see NodeAllocator), so node pointers handed out by the pool
+// stay valid after it is dropped; the buffer goes when the last of them does.
+// Arena pools are private to one thread.
+struct ePool {
+	// declared before the tables, which allocate from mr
+	std::shared_ptr<std::pmr::monotonic_buffer_resource> arena;
+	std::pmr::memory_resource *mr;
+
+	DAG<std::string> graph;
+	std::pmr::unordered_map<std::string, std::shared_ptr<eNode>> nodes;
+	std::pmr::unordered_map<std::string, std::pmr::vector<std::string>> orderedc;
+	std::pmr::unordered_map<std::pmr::string, std::string> leaf_intern;
+	std::pmr::unordered_map<std::pmr::string, std::string> op_intern;
+
+	bool concurrent = 0;
+	mutable std::shared_mutex mutex;
+
+	// live eDAGs using this pool, their roots are what collect() keeps
+	std::unordered_set<const eDAG*> views;
+	mutable std::mutex views_mutex;
+
+	// arena_bytes > 0 makes an arena pool with that initial buffer size
+	explicit ePool(size_t arena_bytes = 0);
+
+	// new pool for sharing between eDAGs and threads
+	static std::shared_ptr<ePool> create();
+
+	// new arena pool
+	static std::shared_ptr<ePool> create_arena(size_t initial_bytes = 1 << 16);
+
+	template <typename... Args>
+	std::shared_ptr<eNode> make_node(Args&&... args) const {
+		return std::allocate_shared<eNode>(NodeAllocator<eNode>(arena, mr),
+										   std::forward<Args>(args)...);
+	}
+
+	// process-wide pool
+	static const std::shared_ptr<ePool>& global();
+
+	std::shared_lock<std::shared_mutex> read() const;
+	std::unique_lock<std::shared_mutex> write();
+
+	// node by id, throws std::out_of_range if missing
+	std::shared_ptr<eNode> node(const std::string &id) const;
+	// nullptr if missing
+	std::shared_ptr<eNode> find(const std::string &id) const;
+
+	// ordered children of an op node, throws std::out_of_range if missing
+	const std::pmr::vector<std::string>& children(const std::string &id) const;
+	// nullptr for leaves and missing nodes
+	const std::pmr::vector<std::string>* find_children(const std::string &id) const;
+
+	std::vector<std::string> parents(const std::string &id) const;
+
+	// id interned under key, "" if none
+	std::string find_leaf(const std::pmr::string &key) const;
+	std::string find_op(const std::pmr::string &key) const;
+
+	size_t size() const;
+
+	// room for n more nodes in the tables, for bulk loads
+	void reserve(size_t n);
+
+	// per-pool numbering of variables by Symbols id, for VarSet. var_slot
+	// assigns one and needs the write lock; find_var returns Symbols::none
+	// if the variable was never interned here
+	std::pmr::unordered_map<uint32_t, uint32_t> var_slots;
+	std::pmr::vector<uint32_t> slot_syms;
+	uint32_t var_slot(uint32_t sym);
+	uint32_t find_var(uint32_t sym) const;
+
+	void attach(const eDAG *view);
+	void detach(const eDAG *view);
+
+	// mark-sweep from the roots of the attached eDAGs, returns the number
+	// of nodes freed. Must not run while another thread is building an
+	// expression in this pool, since its nodes have no root yet.
+	size_t collect();
+
+	// remove nodes and their intern entries; callers make sure nothing
+	// that stays still points at them
+	void erase(const std::unordered_set<std::string> &drop);
+};
+
+// Size and cost of an expression, from one children-first pass over its DAG.
+// tree_size is what printing or any pass that does not share subexpressions
+// would visit; it saturates at UINT64_MAX instead of overflowing.
+struct eMetrics {
+	// distinct nodes
+	size_t dag_size = 0;
+	uint64_t tree_size = 0;
+	// edges on the longest path to a leaf
+	size_t depth = 0;
+	// distinct op nodes per op
+	std::map<OPType, size_t> ops;
+	// rough cost of one eval(): leaves and +,-,* operands count 1, division
+	// 4, sqrt 10, powers and transcendental functions 20
+	uint64_t cost = 0;
 };
 
+// Copying an eDAG copies the root and shares the pool. Passes that start
+// from a copy intern only the nodes they change. Removing nodes (prune) is
+// done only by the sole owner of a pool. clear() and parse() detach onto a
+// fresh pool, unless the eDAG was constructed on a given pool, which it then
+// keeps. Copies that share a private pool must not be modified from
+// different threads.
 class eDAG {
+	friend class Rewriter;
+	friend class Polynomial;
+	friend class CodeGen;
+	friend class eStore;
+	friend class eCache;
+	friend class IntervalEval;
+	friend class IncrementalEval;
+
 	private:
-		DAG<std::string> graph;
+		std::shared_ptr<ePool> pool = std::make_shared<ePool>();
 		std::string root;
-		std::unordered_map<std::string, std::shared_ptr<eNode>> nodes;
-		std::unordered_map<std::string, std::vector<std::string>> orderedc;
-		std::unordered_map<std::string, std::string> leaf_intern;
-		std::unordered_map<std::string, std::string> op_intern;
+		bool fold = 0;
+		// constructed on a given pool, clear() keeps it
+		bool scoped = 0;
+		// clear() and parse() start arena pools
+		bool arena = 0;
 
 		std::vector<std::string> tokenize(const std::string &expr);
 		std::vector<std::string> infix2postfix(const std::vector<std::string> &tokens);
+		std::string build_postfix(const std::vector<std::string> &postfix,
+								  const std::unordered_map<std::string, std::string> &bound);
 		std::shared_ptr<eNode> create_node(const std::string &token);
 		std::string generate_id();
-		std::string intern_leaf(NodeType t, const std::string &sym, std::variant<int64_t, Rational, double> val);
+		std::string intern_leaf(NodeType t, const std::string &sym, const Number &val);
 		bool is_comm(OPType op) const;
 		bool is_assoc(OPType op) const;
-		std::string make_op_key(OPType op, const std::vector<std::string> &children);
+		std::pmr::string make_op_key(OPType op, const std::vector<std::string> &children) const;
+		std::pmr::string make_leaf_key(NodeType t,
+									  const std::string &sym,
+									  const Number &val) const;
+		std::string intern_const(const Rational &r);
+		static Fingerprint leaf_fingerprint(NodeType t, const std::string &sym, const Number &val);
+		Fingerprint op_fingerprint(OPType op,
+								   const std::string &sym,
+								   std::vector<Fingerprint> &fps) const;
+		bool const_value(const std::string &node_id, Rational &out) const;
+		std::string fold_op(OPType op, std::vector<std::string> &children);
+		void prune();
+		void set_pool(const std::shared_ptr<ePool> &p);
+		std::shared_ptr<ePool> fresh_pool() const;
 		std::string intern_op_node(OPType op,
 								   const std::string &sym,
 								   int precedence,
 								   bool is_unary,
 								   const std::vector<std::string> &children);
-		std::variant<int64_t, Rational, double> eval_node(const std::string &node_id,
+		Number eval_node(const std::string &node_id,
 						 const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var) const;
+		Number apply_op(const eNode &node, const std::vector<Number> &op_vals) const;
 
 		std::vector<std::string> get_nodes(NodeType type) const;
+
+		// nodes reachable from node_id, children before parents
+		std::vector<std::string> post_order(const std::string &node_id) const;
+
+		// text of node_id, infix or LaTeX; nodes in names (other than
+		// node_id) print as their name
+		void print_node(std::ostream &out,
+						const std::string &node_id,
+						bool latex,
+						const std::unordered_map<std::string, std::string> &names) const;
+		void print(std::ostream &out, bool latex, bool let) const;
+		static std::string latex_name(const std::string &name);
+		static std::string usual_const_sym(const Number &v);
+		static std::string usual_op_sym(OPType op);
+
+		// intern the subgraph of src rooted at node_id, returns its id here
+		std::string import_node(const eDAG &src, const std::string &node_id);
+
+		// uncached derivative(), simplify() and canonicalize()
+		eDAG differentiate(const std::string &var) const;
+		eDAG simplified() const;
+		eDAG canonical() const;
 	public:
-		eDAG() = default;
+		eDAG();
+
+		// intern into p, e.g. ePool::global() or a pool from ePool::create()
+		explicit eDAG(const std::shared_ptr<ePool> &p);
+
+		eDAG(const eDAG &other);
+
+		eDAG& operator=(const eDAG &other);
 
-		~eDAG() = default;
+		~eDAG();
 
-		// parse expression
+		// parse expression, with the let bindings to_string(1) prints:
+		// "let t1 = x + y in t1 * t1"
 		void parse(const std::string &exp);
 
 		// add var node
@@ -114,6 +387,18 @@ class eDAG {
 					int precedence,
 					bool is_unary = 0);
 
+		// fold constants and drop identities while interning (off by default)
+		void set_folding(bool on);
+
+		bool folding() const;
+
+		// allocate from an arena pool (see ePool), for parse-and-discard
+		// work. Takes effect now on an empty eDAG, else on the next clear()
+		// or parse(); ignored for eDAGs constructed on a given pool.
+		void set_arena(bool on);
+
+		bool uses_arena() const;
+
 		// return id of node
 		std::string get_root() const;
 
@@ -124,35 +409,99 @@ class eDAG {
 
 		std::vector<std::string> get_vars() const;
 
+		// Symbols ids of the variables, ascending, without copying names.
+		// Read from the root's variable set (see VarSet), not by a walk.
+		std::vector<uint32_t> get_var_ids() const;
+
 		std::vector<std::string> get_consts() const;
 
 		std::vector<std::string> get_ops() const;
 
 		bool is_valid() const;
 
-		std::string to_string() const;
-
-		std::string to_latex() const;
-
+		// infix text, with only the parentheses parse() needs to read it
+		// back. Plain text is the expanded tree, metrics().tree_size nodes
+		// long, which grows exponentially with nested sharing. With let,
+		// operators used more than once are bound first,
+		// "let t1 = x + y in t1 * t1", and the text is linear in the DAG
+		// size.
+		std::string to_string(bool let = 0) const;
+		void to_string(std::ostream &out, bool let = 0) const;
+
+		// the same as LaTeX math, with let bindings as \mathrm{let}
+		std::string to_latex(bool let = 0) const;
+		void to_latex(std::ostream &out, bool let = 0) const;
+
+		// compact binary form, for caching parsed expressions between runs:
+		// a versioned header with a checksum, then a symbol table, a
+		// constant pool and the nodes in topological order, children as
+		// varint offsets back. Shared nodes are written once.
+		std::string serialize() const;
+		void serialize(std::ostream &out) const;
+
+		// replace the expression by one written with serialize(), interning
+		// its nodes in one pass. Throws on a bad header, version or
+		// checksum.
+		void deserialize(const std::string &data);
+		void deserialize(std::istream &in);
+
+		// graph of the whole pool, which may hold nodes of other eDAGs
 		const DAG<std::string>& get_graph() const;
 
+		const std::shared_ptr<ePool>& get_pool() const;
+
 		std::shared_ptr<eNode> get_node(const std::string& node_id) const;
 
 		void clear();
 
+		// nodes reachable from the root
 		size_t size() const;
 
+		// structural fingerprint of the expression at node_id (default the
+		// root): a cache or dedup key that is stable across processes
+		Fingerprint fingerprint(const std::string &node_id) const;
+		Fingerprint fingerprint() const;
+
 		bool empty() const;
 
+		// metrics of the expression at node_id (default the root), to refuse
+		// or route requests that would expand it
+		eMetrics metrics(const std::string &node_id) const;
+		eMetrics metrics() const;
+
 		void tree() const;
 
+		// d/dvar, with zero terms and factors of one left out. These three
+		// go through the installed eCache, if any.
 		eDAG derivative(const std::string &var) const;
 
 		eDAG simplify() const;
 
 		eDAG canonicalize() const;
 
+		// Whether a and b are the same function, probably. Rational
+		// functions (+ - * /, integer powers, exact constants) are compared
+		// at random points modulo random primes above 2^61, at enough points
+		// that a wrong true has probability at most error, and a false is
+		// always right. Anything else, such as sin or pi, is compared in long
+		// double at max(8, log2(1/error)) random points of either sign, to a
+		// relative 1e-12 of the magnitudes summed; a point where only one
+		// side is defined makes them different.
+		static bool equivalent(const eDAG &a, const eDAG &b, double error = 1e-12);
+
+		// replace variables by parsed expressions: {"x", "y+1"}
 		eDAG substitute(const std::unordered_map<std::string, std::string> &subs) const;
+
+		// whether the expression at node_id (default the root) contains var,
+		// from the set cached at intern time: O(1) for the first 64
+		// variables of the pool
+		bool depends_on(const std::string &node_id, const std::string &var) const;
+		bool depends_on(const std::string &var) const;
+
+		// variables of the expression at node_id (default the root), in the
+		// order they were first interned in the pool
+		std::vector<std::string> free_vars(const std::string &node_id) const;
+		std::vector<std::string> free_vars() const;
 		
 		// Add rational detection and conversion
 		bool is_rational_expression(const std::string &node_id) const;
@@ -162,6 +511,8 @@ class eDAG {
 		// Add exact simplification methods
 		eDAG simplify_exact() const;
 		eDAG combine_like_terms() const;
+
+		// cancel common polynomial factors in univariate p(x)/q(x)
 		eDAG factor_rationals() const;
 };
 
@@ -195,8 +546,17 @@ namespace math_utils {
 	bool is_num(const std::string &str);
 
 	bool is_var(const std::string &str);
+
+	// exact base^e, false if undefined; throws on overflow
+	bool exact_pow(const Rational &base, int64_t e, Rational &out);
+
+	// exact square root of a perfect-square rational
+	bool exact_sqrt(const Rational &r, Rational &out);
 };
 
 #include "edag.cpp"
+#include "rewrite.hpp"
+#include "poly.hpp"
+#include "cache.hpp"
 
 #endif
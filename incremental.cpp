@@ -0,0 +1,185 @@
+#include "incremental.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+// whether a recomputed value can stop the propagation: doubles compare by
+// their bits, so -0.0 and 0.0 differ (1/x tells them apart) and a NaN is
+// only the same as an identical NaN
+static bool inc_same(const Number &a, const Number &b) {
+	if (a.is_double() && b.is_double()) {
+		double x = a.to_double(), y = b.to_double();
+		return std::memcmp(&x, &y, sizeof x) == 0;
+	}
+
+	return a.to_variant() == b.to_variant();
+}
+
+IncrementalEval::IncrementalEval(const eDAG &expr,
+								 const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var)
+	: dag(expr), bindings(var) {
+	if (dag.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	std::vector<std::string> order = dag.post_order(dag.root);
+	std::unordered_map<std::string, uint32_t> at;
+	uint32_t n = order.size();
+
+	at.reserve(n);
+	this->nodes.reserve(n);
+	this->first.reserve(n + 1);
+
+	for (const auto &id : order) {
+		const auto &node = dag.pool->node(id);
+
+		this->first.push_back(this->kids.size());
+
+		if (node->type == NodeType::VARIABLE) {
+			this->leaves[node->symbol()] = this->nodes.size();
+		} else if (!node->is_leaf()) {
+			auto child_order = dag.pool->find_children(id);
+
+			if (!child_order || child_order->empty()) {
+				throw std::runtime_error("operation node without operands: " + id);
+			}
+
+			for (const auto &c : *child_order)
+				this->kids.push_back(at.at(c));
+		}
+
+		at[id] = this->nodes.size();
+		this->nodes.push_back(node.get());
+	}
+
+	this->first.push_back(this->kids.size());
+
+	// reverse edges of this expression only: the pool's also lead into
+	// every other expression sharing it
+	this->pfirst.assign(n + 1, 0);
+
+	for (uint32_t c : this->kids)
+		this->pfirst[c + 1]++;
+
+	for (uint32_t k = 0; k < n; ++k)
+		this->pfirst[k + 1] += this->pfirst[k];
+
+	this->pars.resize(this->kids.size());
+	std::vector<uint32_t> fill(this->pfirst.begin(), this->pfirst.end() - 1);
+
+	for (uint32_t k = 0; k < n; ++k) {
+		for (uint32_t j = this->first[k]; j < this->first[k + 1]; ++j)
+			this->pars[fill[this->kids[j]]++] = k;
+	}
+
+	this->vals.assign(n, Number(Rational(0, 1)));
+	this->queued.assign(n, 0);
+}
+
+void IncrementalEval::push(uint32_t k) {
+	if (this->queued[k])
+		return;
+
+	this->queued[k] = 1;
+	this->heap.push_back(k);
+	std::push_heap(this->heap.begin(), this->heap.end(), std::greater<uint32_t>());
+}
+
+Number IncrementalEval::compute(uint32_t k) const {
+	const eNode &node = *this->nodes[k];
+
+	if (node.type == NodeType::CONSTANT)
+		return node.value;
+
+	if (node.is_leaf())
+		return Number(node.eval(this->bindings));
+
+	std::vector<Number> op_vals;
+	op_vals.reserve(this->first[k + 1] - this->first[k]);
+
+	for (uint32_t j = this->first[k]; j < this->first[k + 1]; ++j)
+		op_vals.push_back(this->vals[this->kids[j]]);
+
+	return this->dag.apply_op(node, op_vals);
+}
+
+// nodes come out of the heap in post-order, so a node's children are final
+// by the time it is computed
+void IncrementalEval::refresh() {
+	try {
+		if (this->stale) {
+			for (uint32_t k = 0; k < this->nodes.size(); ++k)
+				this->vals[k] = this->compute(k);
+
+			this->recomputed = this->nodes.size();
+			this->stale = 0;
+
+			for (uint32_t k : this->heap)
+				this->queued[k] = 0;
+
+			this->heap.clear();
+			return;
+		}
+
+		if (this->heap.empty())
+			return;
+
+		size_t count = 0;
+
+		while (!this->heap.empty()) {
+			std::pop_heap(this->heap.begin(), this->heap.end(), std::greater<uint32_t>());
+			uint32_t k = this->heap.back();
+			this->heap.pop_back();
+			this->queued[k] = 0;
+
+			Number v = this->compute(k);
+			count++;
+
+			if (inc_same(v, this->vals[k]))
+				continue;
+
+			this->vals[k] = v;
+
+			for (uint32_t j = this->pfirst[k]; j < this->pfirst[k + 1]; ++j)
+				this->push(this->pars[j]);
+		}
+
+		this->recomputed = count;
+	} catch (...) {
+		// values are half updated: start over on the next value()
+		for (uint32_t k : this->heap)
+			this->queued[k] = 0;
+
+		this->heap.clear();
+		this->stale = 1;
+		throw;
+	}
+}
+
+void IncrementalEval::set(const std::string &var, const std::variant<int64_t, Rational, double> &v) {
+	this->bindings[var] = v;
+
+	auto it = this->leaves.find(var);
+
+	if (it != this->leaves.end() && !this->stale)
+		this->push(it->second);
+}
+
+void IncrementalEval::set(const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var) {
+	for (const auto &[name, v] : var)
+		this->set(name, v);
+}
+
+std::variant<int64_t, Rational, double> IncrementalEval::value() {
+	this->refresh();
+	return this->vals.back().to_variant();
+}
+
+size_t IncrementalEval::last_recomputed() const {
+	return this->recomputed;
+}
+
+size_t IncrementalEval::size() const {
+	return this->nodes.size();
+}
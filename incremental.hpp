@@ -0,0 +1,64 @@
+// Incremental evaluation of an eDAG under changing bindings
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <vector>
+#include <variant>
+#include <unordered_map>
+
+// Keeps the value of every node of an expression between evaluations. set()
+// marks the variable's leaf dirty; value() recomputes the dirty nodes and,
+// through the reverse edges of the expression, the parents of each node
+// whose value changed, children before parents. A node that comes out as it
+// was stops the propagation there, so an update costs the part of the graph
+// it really changes, not the whole of it.
+//
+// Values are those eDAG::eval gives for the same bindings: exact while the
+// operands are, else doubles. The expression is copied, so its pool stays
+// alive and it may be changed or destroyed meanwhile.
+class IncrementalEval {
+	private:
+		eDAG dag;
+		// nodes children first; children and parents as offsets into kids
+		// and pars, both restricted to the expression
+		std::vector<const eNode*> nodes;
+		std::vector<uint32_t> first, kids;
+		std::vector<uint32_t> pfirst, pars;
+		// leaf index of each variable
+		std::unordered_map<std::string, uint32_t> leaves;
+
+		std::unordered_map<std::string, std::variant<int64_t, Rational, double>> bindings;
+		std::vector<Number> vals;
+
+		// min-heap of dirty nodes, and whether each is in it
+		std::vector<uint32_t> heap;
+		std::vector<uint8_t> queued;
+		// nothing computed yet, or a recomputation failed
+		bool stale = 1;
+		size_t recomputed = 0;
+
+		void push(uint32_t k);
+		Number compute(uint32_t k) const;
+		void refresh();
+	public:
+		explicit IncrementalEval(const eDAG &expr,
+								 const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var = {});
+
+		// bind var; nothing is recomputed until value()
+		void set(const std::string &var, const std::variant<int64_t, Rational, double> &v);
+		void set(const std::unordered_map<std::string, std::variant<int64_t, Rational, double>> &var);
+
+		// value of the expression under the current bindings; throws like
+		// eDAG::eval for a variable never bound
+		std::variant<int64_t, Rational, double> value();
+
+		// nodes recomputed by the last value() that had work to do
+		size_t last_recomputed() const;
+		size_t size() const;
+};
+
+#include "incremental.cpp"
+
+#endif
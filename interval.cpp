@@ -0,0 +1,616 @@
+#include "interval.hpp"
+#include "codegen.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// below this, error terms from fma may underflow; widen instead
+static const double TINY = std::ldexp(1.0, -960);
+
+// nextafter towards -inf and +inf, on the bits: the libm call costs more
+// than the operation it rounds
+static double down(double x) {
+	if (std::isnan(x) || x == -HUGE_VAL)
+		return x;
+
+	if (x == 0)
+		return -DBL_TRUE_MIN;
+
+	uint64_t b;
+	std::memcpy(&b, &x, sizeof(b));
+	b += (x > 0) ? -1 : 1;
+	std::memcpy(&x, &b, sizeof(b));
+
+	return x;
+}
+
+static double up(double x) {
+	return -down(-x);
+}
+
+// A rounded result x = RN(exact) and the sign of exact - x give the bound:
+// x itself when it is exact or on the right side, else one ulp further.
+// Overflow to infinity from finite operands is bounded by DBL_MAX.
+static double overflow_down(double x, bool finite) {
+	return (x > 0 && finite) ? DBL_MAX : x;
+}
+
+static double overflow_up(double x, bool finite) {
+	return (x < 0 && finite) ? -DBL_MAX : x;
+}
+
+// exact error of a + b by TwoSum
+static double add_err(double a, double b, double s) {
+	double bb = s - a;
+	return (a - (s - bb)) + (b - bb);
+}
+
+static double add_down(double a, double b) {
+	double s = a + b;
+
+	if (std::isinf(s))
+		return overflow_down(s, std::isfinite(a) && std::isfinite(b));
+
+	return (add_err(a, b, s) < 0) ? down(s) : s;
+}
+
+static double add_up(double a, double b) {
+	double s = a + b;
+
+	if (std::isinf(s))
+		return overflow_up(s, std::isfinite(a) && std::isfinite(b));
+
+	return (add_err(a, b, s) > 0) ? up(s) : s;
+}
+
+// 0 * inf is 0: a bound of 0 times an unbounded one
+static double mul_down(double a, double b) {
+	if (a == 0 || b == 0)
+		return 0;
+
+	double p = a * b;
+
+	if (std::isinf(p))
+		return overflow_down(p, std::isfinite(a) && std::isfinite(b));
+
+	if (std::fabs(p) < TINY)
+		return down(p);
+
+	return (std::fma(a, b, -p) < 0) ? down(p) : p;
+}
+
+static double mul_up(double a, double b) {
+	if (a == 0 || b == 0)
+		return 0;
+
+	double p = a * b;
+
+	if (std::isinf(p))
+		return overflow_up(p, std::isfinite(a) && std::isfinite(b));
+
+	if (std::fabs(p) < TINY)
+		return up(p);
+
+	return (std::fma(a, b, -p) > 0) ? up(p) : p;
+}
+
+// sign of a / b - RN(a / b), from the exact remainder a - q * b; b != 0
+static int div_err(double a, double b, double q) {
+	double r = std::fma(-q, b, a);
+
+	if (r == 0)
+		return 0;
+
+	return ((r < 0) == (b < 0)) ? 1 : -1;
+}
+
+static double div_down(double a, double b) {
+	if (a == 0)
+		return 0;
+
+	double q = a / b;
+
+	if (std::isinf(q))
+		return overflow_down(q, std::isfinite(a));
+
+	if (std::isinf(a) || std::isinf(b))
+		return q;
+
+	if (std::fabs(q) < TINY || std::fabs(a) < TINY)
+		return down(q);
+
+	return (div_err(a, b, q) < 0) ? down(q) : q;
+}
+
+static double div_up(double a, double b) {
+	if (a == 0)
+		return 0;
+
+	double q = a / b;
+
+	if (std::isinf(q))
+		return overflow_up(q, std::isfinite(a));
+
+	if (std::isinf(a) || std::isinf(b))
+		return q;
+
+	if (std::fabs(q) < TINY || std::fabs(a) < TINY)
+		return up(q);
+
+	return (div_err(a, b, q) > 0) ? up(q) : q;
+}
+
+// libm results, within two ulps of the exact value
+static double lib_down(double v) {
+	return down(down(v));
+}
+
+static double lib_up(double v) {
+	return up(up(v));
+}
+
+// whether phase + k * period lies in [lo, hi] for some integer k, erring
+// towards yes near the ends: computing the points in doubles loses up to a
+// few ulps of |x|
+static bool hits(double lo, double hi, double phase, double period) {
+	double m = 4e-15 * (1 + std::max(std::fabs(lo), std::fabs(hi)));
+	double k = std::floor((lo - phase) / period);
+
+	for (int j = -1; j <= 2; ++j) {
+		double p = phase + (k + j) * period;
+
+		if (p >= lo - m && p <= hi + m)
+			return 1;
+	}
+
+	return 0;
+}
+
+// beyond this, ulps of x are large enough that the phase is lost
+static const double PERIODIC_MAX = 1e9;
+
+Interval::Interval(double v) : lo(v), hi(v) {}
+
+Interval::Interval(double lo, double hi) : lo(lo), hi(hi) {}
+
+Interval Interval::empty() {
+	return Interval(NAN, NAN);
+}
+
+Interval Interval::entire() {
+	return Interval(-HUGE_VAL, HUGE_VAL);
+}
+
+bool Interval::is_empty() const {
+	return std::isnan(this->lo) || std::isnan(this->hi);
+}
+
+bool Interval::contains(double v) const {
+	return (this->lo <= v && v <= this->hi);
+}
+
+double Interval::width() const {
+	return this->hi - this->lo;
+}
+
+Interval IntervalEval::add(const Interval &a, const Interval &b) {
+	if (a.is_empty() || b.is_empty())
+		return Interval::empty();
+
+	return Interval(add_down(a.lo, b.lo), add_up(a.hi, b.hi));
+}
+
+Interval IntervalEval::sub(const Interval &a, const Interval &b) {
+	if (a.is_empty() || b.is_empty())
+		return Interval::empty();
+
+	return Interval(add_down(a.lo, -b.hi), add_up(a.hi, -b.lo));
+}
+
+// RN is monotone, so the least rounded product is RN of the least exact
+// one, and only the corners that reach it need their error checked
+Interval IntervalEval::mul(const Interval &a, const Interval &b) {
+	if (a.is_empty() || b.is_empty())
+		return Interval::empty();
+
+	const double x[4] = { a.lo, a.lo, a.hi, a.hi }, y[4] = { b.lo, b.hi, b.lo, b.hi };
+	double p[4];
+
+	for (int k = 0; k < 4; ++k)
+		p[k] = (x[k] == 0 || y[k] == 0) ? 0 : x[k] * y[k];
+
+	double lo = std::min({ p[0], p[1], p[2], p[3] }), hi = std::max({ p[0], p[1], p[2], p[3] });
+	double l = lo, h = hi;
+
+	for (int k = 0; k < 4; ++k) {
+		if (p[k] == l)
+			lo = std::min(lo, mul_down(x[k], y[k]));
+
+		if (p[k] == h)
+			hi = std::max(hi, mul_up(x[k], y[k]));
+	}
+
+	return Interval(lo, hi);
+}
+
+Interval IntervalEval::div(const Interval &a, const Interval &b) {
+	if (a.is_empty() || b.is_empty() || (b.lo == 0 && b.hi == 0))
+		return Interval::empty();
+
+	if (b.lo < 0 && b.hi > 0)
+		return Interval::entire();
+
+	// 0 at one end: a times the half-line 1 / b
+	if (b.lo == 0)
+		return mul(a, Interval(div_down(1, b.hi), HUGE_VAL));
+
+	if (b.hi == 0)
+		return mul(a, Interval(-HUGE_VAL, div_up(1, b.lo)));
+
+	const double x[4] = { a.lo, a.lo, a.hi, a.hi }, y[4] = { b.lo, b.hi, b.lo, b.hi };
+	double q[4];
+
+	for (int k = 0; k < 4; ++k)
+		q[k] = (x[k] == 0) ? 0 : x[k] / y[k];
+
+	double lo = std::min({ q[0], q[1], q[2], q[3] }), hi = std::max({ q[0], q[1], q[2], q[3] });
+	double l = lo, h = hi;
+
+	for (int k = 0; k < 4; ++k) {
+		if (q[k] == l)
+			lo = std::min(lo, div_down(x[k], y[k]));
+
+		if (q[k] == h)
+			hi = std::max(hi, div_up(x[k], y[k]));
+	}
+
+	return Interval(lo, hi);
+}
+
+Interval IntervalEval::neg(const Interval &a) {
+	return Interval(-a.hi, -a.lo);
+}
+
+Interval IntervalEval::abs(const Interval &a) {
+	if (a.is_empty())
+		return a;
+
+	if (a.lo >= 0)
+		return a;
+
+	if (a.hi <= 0)
+		return neg(a);
+
+	return Interval(0, std::max(-a.lo, a.hi));
+}
+
+Interval IntervalEval::sqrt(const Interval &a) {
+	if (a.is_empty() || a.hi < 0)
+		return Interval::empty();
+
+	auto root = [](double x, bool upper) {
+		double r = std::sqrt(x);
+
+		if (x == 0 || std::isinf(x))
+			return r;
+
+		if (x < TINY)
+			return upper ? up(r) : down(r);
+
+		// x - r^2, exact
+		double e = std::fma(-r, r, x);
+
+		if (upper)
+			return (e > 0) ? up(r) : r;
+
+		return (e < 0) ? down(r) : r;
+	};
+
+	return Interval(root(std::max(a.lo, 0.0), 0), root(a.hi, 1));
+}
+
+Interval IntervalEval::exp(const Interval &a) {
+	if (a.is_empty())
+		return a;
+
+	return Interval(std::max(0.0, lib_down(std::exp(a.lo))), lib_up(std::exp(a.hi)));
+}
+
+Interval IntervalEval::log(const Interval &a) {
+	if (a.is_empty() || a.hi <= 0)
+		return Interval::empty();
+
+	double lo = (a.lo <= 0) ? -HUGE_VAL : lib_down(std::log(a.lo));
+
+	return Interval(lo, lib_up(std::log(a.hi)));
+}
+
+Interval IntervalEval::sin(const Interval &a) {
+	if (a.is_empty())
+		return a;
+
+	if (!std::isfinite(a.lo) || !std::isfinite(a.hi) || a.width() >= 2 * M_PI ||
+		std::max(std::fabs(a.lo), std::fabs(a.hi)) > PERIODIC_MAX)
+		return Interval(-1, 1);
+
+	double sl = std::sin(a.lo), sh = std::sin(a.hi);
+	double lo = std::max(-1.0, std::min(lib_down(sl), lib_down(sh)));
+	double hi = std::min(1.0, std::max(lib_up(sl), lib_up(sh)));
+
+	if (hits(a.lo, a.hi, M_PI / 2, 2 * M_PI))
+		hi = 1;
+
+	if (hits(a.lo, a.hi, -M_PI / 2, 2 * M_PI))
+		lo = -1;
+
+	return Interval(lo, hi);
+}
+
+Interval IntervalEval::cos(const Interval &a) {
+	if (a.is_empty())
+		return a;
+
+	if (!std::isfinite(a.lo) || !std::isfinite(a.hi) || a.width() >= 2 * M_PI ||
+		std::max(std::fabs(a.lo), std::fabs(a.hi)) > PERIODIC_MAX)
+		return Interval(-1, 1);
+
+	double cl = std::cos(a.lo), ch = std::cos(a.hi);
+	double lo = std::max(-1.0, std::min(lib_down(cl), lib_down(ch)));
+	double hi = std::min(1.0, std::max(lib_up(cl), lib_up(ch)));
+
+	if (hits(a.lo, a.hi, 0, 2 * M_PI))
+		hi = 1;
+
+	if (hits(a.lo, a.hi, M_PI, 2 * M_PI))
+		lo = -1;
+
+	return Interval(lo, hi);
+}
+
+// increasing between poles at pi/2 + k pi, entire across one
+Interval IntervalEval::tan(const Interval &a) {
+	if (a.is_empty())
+		return a;
+
+	if (!std::isfinite(a.lo) || !std::isfinite(a.hi) || a.width() >= M_PI ||
+		std::max(std::fabs(a.lo), std::fabs(a.hi)) > PERIODIC_MAX ||
+		hits(a.lo, a.hi, M_PI / 2, M_PI))
+		return Interval::entire();
+
+	return Interval(lib_down(std::tan(a.lo)), lib_up(std::tan(a.hi)));
+}
+
+// x^n by squaring for x >= 0, each step rounded towards the bound wanted;
+// exact when the powers are
+static double ipow(double x, uint64_t n, bool upper) {
+	double r = 1;
+
+	while (n) {
+		if (n & 1)
+			r = upper ? mul_up(r, x) : mul_down(r, x);
+
+		n >>= 1;
+
+		if (n)
+			x = upper ? mul_up(x, x) : mul_down(x, x);
+	}
+
+	return r;
+}
+
+// bound of x^n for integer n > 0 and any x; libm pow past small n
+static double pown(double x, double n, bool upper) {
+	if (n > 64)
+		return upper ? lib_up(std::pow(x, n)) : lib_down(std::pow(x, n));
+
+	if (x >= 0)
+		return ipow(x, (uint64_t) n, upper);
+
+	if (std::fmod(n, 2) == 0)
+		return ipow(-x, (uint64_t) n, upper);
+
+	return -ipow(-x, (uint64_t) n, !upper);
+}
+
+// Integer exponents: odd powers are increasing, even ones decreasing then
+// increasing, negative ones 1 / a^-n. Otherwise a^b is defined for a >= 0
+// and monotone in each argument, so the corners bound it.
+Interval IntervalEval::pow(const Interval &a, const Interval &b) {
+	if (a.is_empty() || b.is_empty())
+		return Interval::empty();
+
+	auto p_down = [](double x, double y) { return lib_down(std::pow(x, y)); };
+	auto p_up = [](double x, double y) { return lib_up(std::pow(x, y)); };
+
+	if (b.lo == b.hi && std::isfinite(b.lo) && b.lo == std::floor(b.lo)) {
+		double n = b.lo;
+
+		if (n == 0)
+			return Interval(1);
+
+		if (n < 0)
+			return div(Interval(1), pow(a, Interval(-n)));
+
+		if (std::fmod(n, 2) != 0)
+			return Interval(pown(a.lo, n, 0), pown(a.hi, n, 1));
+
+		if (a.lo >= 0)
+			return Interval(std::max(0.0, pown(a.lo, n, 0)), pown(a.hi, n, 1));
+
+		if (a.hi <= 0)
+			return Interval(std::max(0.0, pown(a.hi, n, 0)), pown(a.lo, n, 1));
+
+		return Interval(0, std::max(pown(a.lo, n, 1), pown(a.hi, n, 1)));
+	}
+
+	// a negative base is defined at integer exponents, which a wide b may
+	// contain
+	if (a.lo < 0 && b.lo != b.hi)
+		return Interval::entire();
+
+	if (a.hi < 0)
+		return Interval::empty();
+
+	double x0 = std::max(a.lo, 0.0), x1 = a.hi;
+	double lo = std::min({ p_down(x0, b.lo), p_down(x0, b.hi), p_down(x1, b.lo), p_down(x1, b.hi) });
+	double hi = std::max({ p_up(x0, b.lo), p_up(x0, b.hi), p_up(x1, b.lo), p_up(x1, b.hi) });
+
+	return Interval(std::max(0.0, lo), hi);
+}
+
+// the exact value when it is a double, else the two doubles around it
+static Interval enclose(const Number &v) {
+	if (!v.is_exact())
+		return Interval(v.to_double());
+
+	Rational r = v.to_rational();
+	int64_t n = r.numerator(), d = r.denominator();
+	const int64_t EXACT = (int64_t) 1 << 53;
+
+	if (n >= -EXACT && n <= EXACT && d <= EXACT)
+		return Interval(div_down((double) n, (double) d), div_up((double) n, (double) d));
+
+	double q = (double) n / (double) d;
+
+	return Interval(lib_down(q), lib_up(q));
+}
+
+IntervalEval::IntervalEval(const eDAG &dag) : vars(CodeGen::parameters(dag)) {
+	if (dag.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	std::vector<std::string> order = dag.post_order(dag.root);
+	std::unordered_map<std::string, uint32_t> at, arg;
+
+	for (uint32_t k = 0; k < this->vars.size(); ++k)
+		arg[this->vars[k]] = k;
+
+	at.reserve(order.size());
+	this->tape.reserve(order.size());
+
+	for (const auto &id : order) {
+		const auto &node = dag.pool->node(id);
+		Op o = { (uint8_t) node->type, (uint8_t) node->op, 0, (uint32_t) this->kids.size(), 0 };
+
+		if (node->type == NodeType::VARIABLE) {
+			const std::string &s = node->symbol();
+			auto it = arg.find(s);
+
+			if (it != arg.end()) {
+				o.arg = it->second;
+			} else {
+				// pi, e or tau
+				double v = (s == "e") ? std::exp(1) : (s == "tau" || s == "TAU") ? 2 * M_PI : M_PI;
+
+				o.type = (uint8_t) NodeType::CONSTANT;
+				o.arg = this->consts.size();
+				this->consts.push_back(Interval(down(v), up(v)));
+			}
+		} else if (node->type == NodeType::CONSTANT) {
+			o.arg = this->consts.size();
+			this->consts.push_back(enclose(node->value));
+		} else if (node->is_op() && node->op != OPType::UNKNOWN) {
+			for (const auto &c : dag.pool->children(id))
+				this->kids.push_back(at.at(c));
+
+			o.count = this->kids.size() - o.first;
+		} else {
+			throw std::runtime_error("interval: unsupported node: " + node->symbol());
+		}
+
+		at[id] = this->tape.size();
+		this->tape.push_back(o);
+	}
+}
+
+const std::vector<std::string>& IntervalEval::variables() const {
+	return this->vars;
+}
+
+// variable k at x[k * stride]; v has a slot per tape entry
+void IntervalEval::run(const Interval *x, size_t stride, Interval *v) const {
+	for (size_t j = 0; j < this->tape.size(); ++j) {
+		const Op &o = this->tape[j];
+
+		if (o.type == (uint8_t) NodeType::VARIABLE) {
+			v[j] = x[o.arg * stride];
+			continue;
+		}
+
+		if (o.type == (uint8_t) NodeType::CONSTANT) {
+			v[j] = this->consts[o.arg];
+			continue;
+		}
+
+		const uint32_t *k = this->kids.data() + o.first;
+		Interval r = v[k[0]];
+
+		switch ((OPType) o.op) {
+			case OPType::ADD:
+				for (uint32_t i = 1; i < o.count; ++i)
+					r = add(r, v[k[i]]);
+				break;
+			case OPType::SUBTRACT:
+				for (uint32_t i = 1; i < o.count; ++i)
+					r = sub(r, v[k[i]]);
+				break;
+			case OPType::MULTIPLY:
+				for (uint32_t i = 1; i < o.count; ++i)
+					r = mul(r, v[k[i]]);
+				break;
+			case OPType::DIVIDE:
+				for (uint32_t i = 1; i < o.count; ++i)
+					r = div(r, v[k[i]]);
+				break;
+			case OPType::POWER: r = pow(r, v[k[1]]); break;
+			case OPType::NEGATE: r = neg(r); break;
+			case OPType::SIN: r = sin(r); break;
+			case OPType::COS: r = cos(r); break;
+			case OPType::TAN: r = tan(r); break;
+			case OPType::LOG: r = log(r); break;
+			case OPType::EXP: r = exp(r); break;
+			case OPType::SQRT: r = sqrt(r); break;
+			case OPType::ABS: r = abs(r); break;
+			default: break;
+		}
+
+		v[j] = r;
+	}
+}
+
+Interval IntervalEval::operator()(const Interval *x) const {
+	std::vector<Interval> v(this->tape.size());
+
+	this->run(x, 1, v.data());
+
+	return v.back();
+}
+
+Interval IntervalEval::operator()(const std::unordered_map<std::string, Interval> &box) const {
+	std::vector<Interval> x(this->vars.size());
+
+	for (size_t k = 0; k < this->vars.size(); ++k) {
+		auto it = box.find(this->vars[k]);
+
+		if (it == box.end()) {
+			throw std::runtime_error("var: {" + this->vars[k] + "} not found in evaluation context.");
+		}
+
+		x[k] = it->second;
+	}
+
+	return (*this)(x.data());
+}
+
+// one scratch tape for all boxes
+void IntervalEval::operator()(const Interval *cols, size_t n, Interval *out) const {
+	std::vector<Interval> v(this->tape.size());
+
+	for (size_t i = 0; i < n; ++i) {
+		this->run(cols + i, n, v.data());
+		out[i] = v.back();
+	}
+}
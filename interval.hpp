@@ -0,0 +1,90 @@
+// Interval evaluation of eDAGs with outward rounding
+#ifndef INTERVAL_HPP
+#define INTERVAL_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Closed interval [lo, hi] of doubles; bounds may be infinite. The empty
+// interval, such as log of [-2, -1], has NaN bounds and makes every
+// interval computed from it empty.
+struct Interval {
+	double lo = 0;
+	double hi = 0;
+
+	Interval() = default;
+	Interval(double v);
+	Interval(double lo, double hi);
+
+	static Interval empty();
+	static Interval entire();
+
+	bool is_empty() const;
+	bool contains(double v) const;
+	double width() const;
+};
+
+// An expression compiled to a tape of nodes, children first, evaluated over
+// boxes of inputs. The result encloses the value at every point of the box:
+// each operation rounds its bounds outward, so the enclosure holds in spite
+// of floating-point rounding. +, -, *, / and sqrt widen a bound only when
+// the rounded result is inexact, found from its exact error with fma; sin,
+// cos, tan, exp, log and pow come from libm and are widened by two ulps.
+//
+// Enclosures are tight per operation: monotone functions take their
+// endpoints, sin and cos add the extrema inside the interval, tan is
+// entire across a pole, even powers of an interval around 0 start at 0. A
+// variable used twice is not correlated, so x - x over [0, 1] is [-1, 1].
+// pi, e and tau are the narrow intervals around them.
+class IntervalEval {
+	private:
+		struct Op {
+			uint8_t type;
+			uint8_t op;
+			// variables: argument index; constants: index into consts
+			uint32_t arg;
+			uint32_t first;
+			uint32_t count;
+		};
+
+		// argument order, sorted by name
+		std::vector<std::string> vars;
+		std::vector<Op> tape;
+		std::vector<uint32_t> kids;
+		std::vector<Interval> consts;
+
+		void run(const Interval *x, size_t stride, Interval *v) const;
+
+	public:
+		explicit IntervalEval(const eDAG &dag);
+
+		const std::vector<std::string>& variables() const;
+
+		// x[k] is the range of variables()[k]
+		Interval operator()(const Interval *x) const;
+		Interval operator()(const std::unordered_map<std::string, Interval> &box) const;
+
+		// n boxes in columns: cols[k * n + i] is variables()[k] in box i
+		void operator()(const Interval *cols, size_t n, Interval *out) const;
+
+		// the operations, for use outside a tape
+		static Interval add(const Interval &a, const Interval &b);
+		static Interval sub(const Interval &a, const Interval &b);
+		static Interval mul(const Interval &a, const Interval &b);
+		static Interval div(const Interval &a, const Interval &b);
+		static Interval neg(const Interval &a);
+		static Interval pow(const Interval &a, const Interval &b);
+		static Interval sin(const Interval &a);
+		static Interval cos(const Interval &a);
+		static Interval tan(const Interval &a);
+		static Interval log(const Interval &a);
+		static Interval exp(const Interval &a);
+		static Interval sqrt(const Interval &a);
+		static Interval abs(const Interval &a);
+};
+
+#include "interval.cpp"
+
+#endif
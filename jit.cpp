@@ -0,0 +1,171 @@
+#include "jit.hpp"
+#include "utils.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <dlfcn.h>
+#include <unistd.h>
+
+// s as one word for /bin/sh: inside single quotes only ' itself is special
+static std::string jit_quote(const std::string &s) {
+	std::string q = "'";
+
+	for (char c : s) {
+		if (c == '\'')
+			q += "'\\''";
+		else
+			q += c;
+	}
+
+	return q + "'";
+}
+
+// the kernel comes from CodeGen without strength reduction, so results
+// match eval() exactly; the entry points unpack the argument arrays
+std::string JIT::source(const eDAG &dag) {
+	CodeGen::Options opt;
+	opt.name = "cas_eval";
+	opt.c = 1;
+	opt.strength_reduce = 0;
+	opt.array_loop = 1;
+
+	std::vector<std::string> vars = CodeGen::parameters(dag);
+	std::ostringstream src;
+
+	src << CodeGen::generate(dag, opt) << "\n"
+		<< "double cas_scalar(const double *v) {\n"
+		<< (vars.empty() ? "\t(void) v;\n" : "")
+		<< "\treturn cas_eval(";
+
+	for (size_t k = 0; k < vars.size(); ++k)
+		src << (k ? ", " : "") << "v[" << k << "]";
+
+	src << ");\n"
+		<< "}\n\n"
+		<< "void cas_batch(const double *cols, size_t n, double *out) {\n"
+		<< (vars.empty() ? "\t(void) cols;\n" : "")
+		<< "\tcas_eval_n(n";
+
+	for (size_t k = 0; k < vars.size(); ++k)
+		src << ", cols + " << k << " * n";
+
+	src << ", out);\n"
+		<< "}\n";
+
+	return src.str();
+}
+
+JIT::JIT(const eDAG &dag, const std::string &cache_dir) : vars(CodeGen::parameters(dag)) {
+	std::string src = source(dag);
+
+	const char *env_cc = std::getenv("CC");
+	const char *env_dir = std::getenv("CAS_JIT_DIR");
+	std::string cc = env_cc ? env_cc : "cc";
+	std::string flags = "-O2 -shared -fPIC";
+	std::string dir = !cache_dir.empty() ? cache_dir : (env_dir ? env_dir : "/tmp/cas-jit");
+
+	char name[32];
+	std::string keyed = cc + "\n" + flags + "\n" + src;
+	std::snprintf(name, sizeof(name), "cas_%016llx",
+				  (unsigned long long) utils::fnv1a(keyed.data(), keyed.size()));
+
+	std::string base = dir + "/" + name;
+	this->path = base + ".so";
+
+	// the source is kept next to the object, so a hash collision is a miss
+	bool hit = 0;
+	{
+		std::ifstream in(base + ".c");
+		std::stringstream cached;
+		cached << in.rdbuf();
+		hit = in && cached.str() == src && std::filesystem::exists(this->path);
+	}
+
+	if (!hit) {
+		std::filesystem::create_directories(dir);
+
+		// build under a private name, then rename into place so concurrent
+		// processes and threads never load a half-written object
+		static std::atomic<uint64_t> next_tmp{ 0 };
+		std::string tmp = base + "." + std::to_string(::getpid()) + "." + std::to_string(next_tmp++);
+
+		{
+			std::ofstream out(tmp + ".c");
+			out << src;
+
+			if (!out) {
+				throw std::runtime_error("jit: can't write " + tmp + ".c");
+			}
+		}
+
+		// compiler output goes to a log that is reported on failure
+		std::string cmd = cc + " " + flags + " -o " + jit_quote(tmp + ".so") + " " +
+						  jit_quote(tmp + ".c") + " -lm > " + jit_quote(tmp + ".log") + " 2>&1";
+
+		if (std::system(cmd.c_str()) != 0) {
+			std::ifstream in(tmp + ".log");
+			std::stringstream log;
+			log << in.rdbuf();
+
+			std::filesystem::remove(tmp + ".c");
+			std::filesystem::remove(tmp + ".so");
+			std::filesystem::remove(tmp + ".log");
+			throw std::runtime_error("jit: compile failed: " + cmd + "\n" + log.str());
+		}
+
+		std::filesystem::remove(tmp + ".log");
+
+		std::filesystem::rename(tmp + ".so", this->path);
+		std::filesystem::rename(tmp + ".c", base + ".c");
+	}
+
+	void *h = ::dlopen(this->path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+	if (!h) {
+		throw std::runtime_error(std::string("jit: ") + ::dlerror());
+	}
+
+	this->handle = std::shared_ptr<void>(h, ::dlclose);
+	this->scalar = reinterpret_cast<Scalar>(::dlsym(h, "cas_scalar"));
+	this->batch = reinterpret_cast<Batch>(::dlsym(h, "cas_batch"));
+
+	if (!this->scalar || !this->batch) {
+		throw std::runtime_error("jit: missing entry points in " + this->path);
+	}
+}
+
+const std::vector<std::string>& JIT::variables() const {
+	return this->vars;
+}
+
+const std::string& JIT::object() const {
+	return this->path;
+}
+
+double JIT::operator()(const double *x) const {
+	return this->scalar(x);
+}
+
+double JIT::operator()(const std::unordered_map<std::string, double> &at) const {
+	std::vector<double> x(this->vars.size());
+
+	for (size_t k = 0; k < this->vars.size(); ++k) {
+		auto it = at.find(this->vars[k]);
+
+		if (it == at.end()) {
+			throw std::runtime_error("var: {" + this->vars[k] + "} not found in evaluation context.");
+		}
+
+		x[k] = it->second;
+	}
+
+	return this->scalar(x.data());
+}
+
+void JIT::operator()(const double *cols, size_t n, double *out) const {
+	this->batch(cols, n, out);
+}
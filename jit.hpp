@@ -0,0 +1,56 @@
+// Native compilation of eDAGs through the system C compiler
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "edag.hpp"
+#include "codegen.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// An expression compiled to a shared object and loaded with dlopen. The C
+// source comes from CodeGen, so shared subexpressions are computed once.
+// Objects are cached in a directory under the hash of their source, which
+// depends only on the expression's structure, so a later process loads them
+// without invoking the compiler.
+//
+// Evaluation is in double precision: exact rationals become the nearest
+// double and division by zero gives inf or nan instead of throwing. pi, e
+// and tau are constants, as in eval(). Needs -ldl on older glibc.
+class JIT {
+	private:
+		using Scalar = double (*)(const double *);
+		using Batch = void (*)(const double *, size_t, double *);
+
+		// argument order, sorted by name
+		std::vector<std::string> vars;
+		std::shared_ptr<void> handle;
+		Scalar scalar = nullptr;
+		Batch batch = nullptr;
+		std::string path;
+
+	public:
+		// compile dag, or load it from cache_dir; an empty cache_dir means
+		// $CAS_JIT_DIR, else /tmp/cas-jit. $CC picks the compiler (cc).
+		explicit JIT(const eDAG &dag, const std::string &cache_dir = "");
+
+		// C source for dag, with the variables in the order of variables()
+		static std::string source(const eDAG &dag);
+
+		const std::vector<std::string>& variables() const;
+
+		// shared object the functions were loaded from
+		const std::string& object() const;
+
+		// x[k] is the value of variables()[k]
+		double operator()(const double *x) const;
+		double operator()(const std::unordered_map<std::string, double> &at) const;
+
+		// n points in columns: cols[k * n + i] is variables()[k] at point i
+		void operator()(const double *cols, size_t n, double *out) const;
+};
+
+#include "jit.cpp"
+
+#endif
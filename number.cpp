@@ -0,0 +1,309 @@
+#include "number.hpp"
+#include <stdexcept>
+
+static_assert(sizeof(Number) == 16, "Number should stay 16 bytes.");
+
+// n/d in lowest terms with d > 0: an INT if d is 1, boxed if d needs more
+// than 32 bits
+void Number::set_rational(int64_t n, int64_t d) {
+	if (d == 1) {
+		this->i = n;
+		this->den = 1;
+		this->tag = Kind::INT;
+	} else if (d > 0 && d <= (int64_t) UINT32_MAX) {
+		this->i = n;
+		this->den = (uint32_t) d;
+		this->tag = Kind::RAT;
+	} else {
+		this->big = new Rational(n, d);
+		this->den = 0;
+		this->tag = Kind::BIG;
+	}
+}
+
+void Number::release() {
+	if (this->tag == Kind::BIG)
+		delete this->big;
+}
+
+int64_t Number::num_of() const {
+	return this->i;
+}
+
+int64_t Number::den_of() const {
+	return (this->tag == Kind::RAT) ? this->den : 1;
+}
+
+bool Number::is_inline() const {
+	return (this->tag == Kind::INT || this->tag == Kind::RAT);
+}
+
+Number::Number(int64_t v) : i(v), den(1), tag(Kind::INT) {}
+
+Number::Number(int v) : i(v), den(1), tag(Kind::INT) {}
+
+Number::Number(double v) : d(v), den(0), tag(Kind::DBL) {}
+
+Number::Number(const Rational &r) {
+	this->set_rational(r.numerator(), r.denominator());
+}
+
+Number::Number(const std::variant<int64_t, Rational, double> &v) : Number(int64_t(0)) {
+	if (std::holds_alternative<Rational>(v)) {
+		this->set_rational(std::get<Rational>(v).numerator(), std::get<Rational>(v).denominator());
+	} else if (std::holds_alternative<int64_t>(v)) {
+		this->i = std::get<int64_t>(v);
+	} else {
+		this->d = std::get<double>(v);
+		this->den = 0;
+		this->tag = Kind::DBL;
+	}
+}
+
+Number::Number(const Number &other) : i(other.i), den(other.den), tag(other.tag) {
+	if (this->tag == Kind::BIG)
+		this->big = new Rational(*other.big);
+}
+
+Number& Number::operator=(const Number &other) {
+	if (this != &other) {
+		Number copy(other);
+		this->release();
+
+		this->i = copy.i;
+		this->den = copy.den;
+		this->tag = copy.tag;
+
+		// the box now belongs to this
+		copy.tag = Kind::INT;
+	}
+
+	return *this;
+}
+
+Number::~Number() {
+	this->release();
+}
+
+Number::Kind Number::kind() const {
+	return this->tag;
+}
+
+bool Number::is_int() const {
+	return (this->tag == Kind::INT);
+}
+
+bool Number::is_rational() const {
+	return (this->tag == Kind::RAT || this->tag == Kind::BIG);
+}
+
+bool Number::is_double() const {
+	return (this->tag == Kind::DBL);
+}
+
+bool Number::is_exact() const {
+	return (this->tag != Kind::DBL);
+}
+
+bool Number::is_zero() const {
+	switch (this->tag) {
+		case Kind::INT:
+		case Kind::RAT:
+			return (this->i == 0);
+		case Kind::DBL:
+			return (this->d == 0.0);
+		default:
+			return this->big->is_zero();
+	}
+}
+
+int64_t Number::as_int() const {
+	if (this->tag != Kind::INT)
+		throw std::runtime_error("number is not an int.");
+
+	return this->i;
+}
+
+double Number::to_double() const {
+	switch (this->tag) {
+		case Kind::INT:
+			return (double) this->i;
+		case Kind::RAT:
+			return (double) this->i / this->den;
+		case Kind::DBL:
+			return this->d;
+		default:
+			return this->big->val();
+	}
+}
+
+Rational Number::to_rational() const {
+	switch (this->tag) {
+		case Kind::INT:
+			return Rational(this->i, 1);
+		case Kind::RAT:
+			return Rational(this->i, (int64_t) this->den);
+		case Kind::DBL:
+			return Rational(this->d);
+		default:
+			return *this->big;
+	}
+}
+
+std::variant<int64_t, Rational, double> Number::to_variant() const {
+	switch (this->tag) {
+		case Kind::INT:
+			return this->i;
+		case Kind::DBL:
+			return this->d;
+		default:
+			return this->to_rational();
+	}
+}
+
+// The exact cases below do the Rational arithmetic on the inline fields, with
+// one gcd at the end and none when both operands are integers. When the
+// unreduced cross products overflow they hand over to Rational, which reduces
+// first and throws only if the result itself doesn't fit.
+
+// a/b + c/d = (ad + bc)/bd
+Number Number::operator+(const Number &other) const {
+	if (this->tag == Kind::DBL || other.tag == Kind::DBL)
+		return Number(this->to_double() + other.to_double());
+
+	if (!this->is_inline() || !other.is_inline())
+		return Number(this->to_rational() + other.to_rational());
+
+	int64_t a = this->num_of(),
+			b = this->den_of(),
+			c = other.num_of(),
+			d = other.den_of();
+
+	int64_t n1, n2, n3, d1;
+	Number out;
+
+	if (b == 1 && d == 1) {
+		if (__builtin_add_overflow(a, c, &n3))
+			throw std::runtime_error("ADD overflow.");
+
+		out.set_rational(n3, 1);
+		return out;
+	}
+
+	if (__builtin_mul_overflow(a, d, &n1) ||
+		__builtin_mul_overflow(b, c, &n2) ||
+		__builtin_mul_overflow(b, d, &d1) ||
+		__builtin_add_overflow(n1, n2, &n3)) {
+		return Number(this->to_rational() + other.to_rational());
+	}
+
+	return Number(Rational(n3, d1));
+}
+
+// a/b - c/d = (ad - bc)/bd
+Number Number::operator-(const Number &other) const {
+	if (this->tag == Kind::DBL || other.tag == Kind::DBL)
+		return Number(this->to_double() - other.to_double());
+
+	if (!this->is_inline() || !other.is_inline())
+		return Number(this->to_rational() - other.to_rational());
+
+	int64_t a = this->num_of(),
+			b = this->den_of(),
+			c = other.num_of(),
+			d = other.den_of();
+
+	int64_t n1, n2, n3, d1;
+	Number out;
+
+	if (b == 1 && d == 1) {
+		if (__builtin_sub_overflow(a, c, &n3))
+			throw std::runtime_error("SUB overflow.");
+
+		out.set_rational(n3, 1);
+		return out;
+	}
+
+	if (__builtin_mul_overflow(a, d, &n1) ||
+		__builtin_mul_overflow(b, c, &n2) ||
+		__builtin_mul_overflow(b, d, &d1) ||
+		__builtin_sub_overflow(n1, n2, &n3)) {
+		return Number(this->to_rational() - other.to_rational());
+	}
+
+	return Number(Rational(n3, d1));
+}
+
+Number Number::operator*(const Number &other) const {
+	if (this->tag == Kind::DBL || other.tag == Kind::DBL)
+		return Number(this->to_double() * other.to_double());
+
+	if (!this->is_inline() || !other.is_inline())
+		return Number(this->to_rational() * other.to_rational());
+
+	int64_t a = this->num_of(),
+			b = this->den_of(),
+			c = other.num_of(),
+			d = other.den_of();
+
+	int64_t n1, d1;
+
+	if (__builtin_mul_overflow(a, c, &n1) ||
+		__builtin_mul_overflow(b, d, &d1)) {
+		return Number(this->to_rational() * other.to_rational());
+	}
+
+	if (d1 == 1) {
+		Number out;
+		out.set_rational(n1, 1);
+		return out;
+	}
+
+	return Number(Rational(n1, d1));
+}
+
+// a/b / (c/d) = ad/bc
+Number Number::operator/(const Number &other) const {
+	if (this->tag == Kind::DBL || other.tag == Kind::DBL)
+		return Number(this->to_double() / other.to_double());
+
+	if (other.is_zero())
+		throw std::runtime_error("can't divide by zero.");
+
+	if (!this->is_inline() || !other.is_inline())
+		return Number(this->to_rational() / other.to_rational());
+
+	int64_t a = this->num_of(),
+			b = this->den_of(),
+			c = other.num_of(),
+			d = other.den_of();
+
+	int64_t n1, d1;
+
+	if (__builtin_mul_overflow(a, d, &n1) ||
+		__builtin_mul_overflow(b, c, &d1)) {
+		return Number(this->to_rational() / other.to_rational());
+	}
+
+	return Number(Rational(n1, d1));
+}
+
+Number Number::operator-() const {
+	Number out(*this);
+
+	switch (this->tag) {
+		case Kind::INT:
+		case Kind::RAT:
+			if (__builtin_sub_overflow((int64_t) 0, this->i, &out.i))
+				throw std::runtime_error("NEGATE overflow.");
+			break;
+		case Kind::DBL:
+			out.d = -this->d;
+			break;
+		default:
+			*out.big = -*this->big;
+			break;
+	}
+
+	return out;
+}
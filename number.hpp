@@ -0,0 +1,68 @@
+// Compact tagged number used for node values and evaluation
+#ifndef NUMBER_HPP
+#define NUMBER_HPP
+
+#include "rat.hpp"
+#include <stdint.h>
+#include <string>
+#include <variant>
+
+// 16 bytes: an int64_t, an inline rational (int64_t numerator, uint32_t
+// denominator), a double, or a boxed Rational when the denominator does not
+// fit in 32 bits. Exact operands (INT, RAT, BIG) give exact results, an INT
+// when the result is an integer and a rational otherwise; anything with a
+// double gives a double. Overflow throws like Rational does.
+class Number {
+	public:
+		enum class Kind : uint8_t { INT, RAT, DBL, BIG };
+
+	private:
+		union {
+			int64_t i;
+			double d;
+			Rational *big;
+		};
+		uint32_t den;
+		Kind tag;
+
+		void set_rational(int64_t n, int64_t d);
+		void release();
+
+		// numerator and denominator of an INT or RAT
+		int64_t num_of() const;
+		int64_t den_of() const;
+		bool is_inline() const;
+	public:
+		Number(int64_t v = 0);
+		Number(int v);
+		Number(double v);
+		Number(const Rational &r);
+		Number(const std::variant<int64_t, Rational, double> &v);
+
+		Number(const Number &other);
+		Number& operator=(const Number &other);
+		~Number();
+
+		Kind kind() const;
+
+		bool is_int() const;
+		// RAT or BIG
+		bool is_rational() const;
+		bool is_double() const;
+		bool is_exact() const;
+		bool is_zero() const;
+
+		int64_t as_int() const;
+		double to_double() const;
+		Rational to_rational() const;
+
+		std::variant<int64_t, Rational, double> to_variant() const;
+
+		Number operator+(const Number &other) const;
+		Number operator-(const Number &other) const;
+		Number operator*(const Number &other) const;
+		Number operator/(const Number &other) const;
+		Number operator-() const;
+};
+
+#endif
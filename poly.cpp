@@ -0,0 +1,1488 @@
+#include "poly.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stack>
+
+Polynomial::Polynomial() {
+	this->layout(8);
+}
+
+Polynomial::Polynomial(const std::vector<std::string> &vars) : vars(vars) {
+	std::sort(this->vars.begin(), this->vars.end());
+	this->vars.erase(std::unique(this->vars.begin(), this->vars.end()), this->vars.end());
+	this->layout(8);
+}
+
+void Polynomial::layout(unsigned b) {
+	size_t per = 64 / b;
+
+	this->bits = b;
+	this->words = std::max<size_t>(1, (vars.size() + per - 1) / per);
+}
+
+const uint64_t* Polynomial::mono(size_t t) const {
+	return &exps[t * words];
+}
+
+uint32_t Polynomial::get_exp(const uint64_t *m, size_t k) const {
+	size_t per = 64 / bits;
+	unsigned shift = (per - 1 - k % per) * bits;
+	uint64_t mask = (bits == 32) ? 0xffffffffULL : ((1ULL << bits) - 1);
+
+	return (m[k / per] >> shift) & mask;
+}
+
+void Polynomial::set_exp(uint64_t *m, size_t k, uint32_t e) const {
+	size_t per = 64 / bits;
+	unsigned shift = (per - 1 - k % per) * bits;
+	uint64_t mask = (bits == 32) ? 0xffffffffULL : ((1ULL << bits) - 1);
+
+	m[k / per] = (m[k / per] & ~(mask << shift)) | ((uint64_t) e << shift);
+}
+
+int Polynomial::cmp(const uint64_t *a, const uint64_t *b) const {
+	for (size_t w = 0; w < words; ++w) {
+		if (a[w] != b[w])
+			return (a[w] < b[w]) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+void Polynomial::push_term(const uint64_t *m, const Rational &c) {
+	exps.insert(exps.end(), m, m + words);
+	coeffs.push_back(c);
+}
+
+// Coefficient arithmetic is int64 Rational, which throws on overflow; the
+// operators report that as one polynomial error whichever step hit it.
+[[noreturn]] static void coefficient_overflow() {
+	throw std::runtime_error("polynomial coefficient overflow.");
+}
+
+unsigned Polynomial::bits_for(uint64_t deg) {
+	if (deg < (1ULL << 8))
+		return 8;
+
+	if (deg < (1ULL << 16))
+		return 16;
+
+	if (deg < (1ULL << 32))
+		return 32;
+
+	throw std::runtime_error("polynomial exponent overflow.");
+}
+
+Polynomial Polynomial::repack(const std::vector<std::string> &to, unsigned b) const {
+	Polynomial p;
+	p.vars = to;
+	p.layout(b);
+
+	// variables only get inserted, so the relative order and the term order
+	// of existing monomials are unchanged
+	std::vector<size_t> where(vars.size());
+
+	for (size_t k = 0; k < vars.size(); ++k)
+		where[k] = std::lower_bound(to.begin(), to.end(), vars[k]) - to.begin();
+
+	std::vector<uint64_t> m(p.words);
+	p.exps.reserve(this->size() * p.words);
+	p.coeffs.reserve(this->size());
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		std::fill(m.begin(), m.end(), 0);
+
+		for (size_t k = 0; k < vars.size(); ++k)
+			p.set_exp(m.data(), where[k], this->get_exp(this->mono(t), k));
+
+		p.push_term(m.data(), coeffs[t]);
+	}
+
+	return p;
+}
+
+void Polynomial::align(const Polynomial &a,
+					   const Polynomial &b,
+					   unsigned min_bits,
+					   Polynomial &ta,
+					   Polynomial &tb,
+					   const Polynomial *&pa,
+					   const Polynomial *&pb) {
+	unsigned nb = std::max({ a.bits, b.bits, min_bits });
+	pa = &a;
+	pb = &b;
+
+	if (a.vars == b.vars && a.bits == nb && b.bits == nb)
+		return;
+
+	std::vector<std::string> merged;
+	std::set_union(a.vars.begin(), a.vars.end(),
+				   b.vars.begin(), b.vars.end(),
+				   std::back_inserter(merged));
+
+	if (a.vars != merged || a.bits != nb) {
+		ta = a.repack(merged, nb);
+		pa = &ta;
+	}
+
+	if (b.vars != merged || b.bits != nb) {
+		tb = b.repack(merged, nb);
+		pb = &tb;
+	}
+}
+
+Polynomial Polynomial::constant(const Rational &c) {
+	Polynomial p;
+
+	if (!c.is_zero()) {
+		uint64_t m = 0;
+		p.push_term(&m, c);
+	}
+
+	return p;
+}
+
+Polynomial Polynomial::variable(const std::string &name) {
+	Polynomial p({ name });
+	std::vector<uint64_t> m(p.words, 0);
+
+	p.set_exp(m.data(), 0, 1);
+	p.push_term(m.data(), Rational(1, 1));
+
+	return p;
+}
+
+Polynomial Polynomial::operator+(const Polynomial &other) const {
+	Polynomial ta, tb;
+	const Polynomial *pa, *pb;
+	align(*this, other, 8, ta, tb, pa, pb);
+
+	const Polynomial &a = *pa, &b = *pb;
+
+	Polynomial r;
+	r.vars = a.vars;
+	r.layout(a.bits);
+	r.exps.reserve(a.exps.size() + b.exps.size());
+	r.coeffs.reserve(a.size() + b.size());
+
+	size_t i = 0, j = 0;
+
+	while (i < a.size() && j < b.size()) {
+		int c = a.cmp(a.mono(i), b.mono(j));
+
+		if (c > 0) {
+			r.push_term(a.mono(i), a.coeffs[i]);
+			++i;
+		} else if (c < 0) {
+			r.push_term(b.mono(j), b.coeffs[j]);
+			++j;
+		} else {
+			Rational s(0, 1);
+
+			try {
+				s = a.coeffs[i] + b.coeffs[j];
+			} catch (const std::runtime_error &) {
+				coefficient_overflow();
+			}
+
+			if (!s.is_zero())
+				r.push_term(a.mono(i), s);
+
+			++i;
+			++j;
+		}
+	}
+
+	for (; i < a.size(); ++i)
+		r.push_term(a.mono(i), a.coeffs[i]);
+
+	for (; j < b.size(); ++j)
+		r.push_term(b.mono(j), b.coeffs[j]);
+
+	return r;
+}
+
+Polynomial Polynomial::operator-(const Polynomial &other) const {
+	return *this + (-other);
+}
+
+Polynomial Polynomial::operator-() const {
+	Polynomial r = *this;
+
+	try {
+		for (auto &c : r.coeffs)
+			c = -c;
+	} catch (const std::runtime_error &) {
+		coefficient_overflow();
+	}
+
+	return r;
+}
+
+Polynomial Polynomial::operator*(const Rational &c) const {
+	if (c.is_zero())
+		return Polynomial(vars);
+
+	Polynomial r = *this;
+
+	try {
+		for (auto &x : r.coeffs)
+			x = x * c;
+	} catch (const std::runtime_error &) {
+		coefficient_overflow();
+	}
+
+	return r;
+}
+
+Polynomial Polynomial::operator*(const Polynomial &other) const {
+	Polynomial ta, tb;
+	const Polynomial *pa, *pb;
+	align(*this, other, 8, ta, tb, pa, pb);
+
+	if (pa->is_zero() || pb->is_zero())
+		return Polynomial(pa->vars);
+
+	// exponents of the product are bounded by the sum of the operands'
+	auto da = pa->degrees(), db = pb->degrees();
+	std::vector<uint32_t> bound(da.size());
+	uint64_t top = 0;
+
+	for (size_t k = 0; k < bound.size(); ++k) {
+		uint64_t d = (uint64_t) da[k] + db[k];
+		top = std::max(top, d);
+		bound[k] = (uint32_t) std::min<uint64_t>(d, 0xffffffffULL);
+	}
+
+	unsigned nb = bits_for(top);
+
+	if (nb > pa->bits) {
+		Polynomial wa = pa->repack(pa->vars, nb), wb = pb->repack(pb->vars, nb);
+		ta = std::move(wa);
+		tb = std::move(wb);
+		pa = &ta;
+		pb = &tb;
+	}
+
+	// Kronecker substitution: when the product's bounding box is not much
+	// larger than the number of term products, multiply into a flat array
+	// indexed by the substituted exponent instead of merging through a heap
+	uint64_t box = 1;
+	uint64_t work = (uint64_t) pa->size() * pb->size();
+	bool dense = 1;
+
+	for (uint32_t d : bound) {
+		if (__builtin_mul_overflow(box, (uint64_t) d + 1, &box) || box > (1ULL << 24)) {
+			dense = 0;
+			break;
+		}
+	}
+
+	try {
+		if (dense && box <= 4 * work)
+			return mul_dense(*pa, *pb, bound, box);
+
+		return mul_heap(*pa, *pb);
+	} catch (const std::runtime_error &) {
+		coefficient_overflow();
+	}
+}
+
+// Johnson's heap multiplication with Monagan-Pearce chaining: the heap holds
+// at most one entry per row of the smaller operand, and row i+1 only enters
+// once (i, 0) has been consumed. Products come out in descending order so
+// like terms are combined as they are popped.
+Polynomial Polynomial::mul_heap(const Polynomial &x, const Polynomial &y) {
+	const Polynomial &a = (x.size() <= y.size()) ? x : y;
+	const Polynomial &b = (x.size() <= y.size()) ? y : x;
+	const size_t W = a.words;
+	const size_t n = a.size(), m = b.size();
+
+	Polynomial r;
+	r.vars = a.vars;
+	r.layout(a.bits);
+
+	std::vector<size_t> col(n, 0);
+	std::vector<uint64_t> key(n * W);
+	std::vector<size_t> heap;
+	std::vector<uint64_t> cur(W);
+
+	heap.reserve(n);
+
+	auto set_key = [&](size_t i) {
+		const uint64_t *ea = a.mono(i), *eb = b.mono(col[i]);
+
+		for (size_t w = 0; w < W; ++w)
+			key[i * W + w] = ea[w] + eb[w];
+	};
+
+	auto lower = [&](size_t i, size_t j) {
+		return a.cmp(&key[i * W], &key[j * W]) < 0;
+	};
+
+	set_key(0);
+	heap.push_back(0);
+
+	while (!heap.empty()) {
+		std::copy(&key[heap.front() * W], &key[heap.front() * W] + W, cur.begin());
+
+		Rational acc(0, 1);
+
+		while (!heap.empty() && a.cmp(&key[heap.front() * W], cur.data()) == 0) {
+			std::pop_heap(heap.begin(), heap.end(), lower);
+			size_t i = heap.back();
+			heap.pop_back();
+
+			acc = acc + a.coeffs[i] * b.coeffs[col[i]];
+
+			if (col[i] == 0 && i + 1 < n) {
+				col[i + 1] = 0;
+				set_key(i + 1);
+				heap.push_back(i + 1);
+				std::push_heap(heap.begin(), heap.end(), lower);
+			}
+
+			if (++col[i] < m) {
+				set_key(i);
+				heap.push_back(i);
+				std::push_heap(heap.begin(), heap.end(), lower);
+			}
+		}
+
+		if (!acc.is_zero())
+			r.push_term(cur.data(), acc);
+	}
+
+	return r;
+}
+
+Polynomial Polynomial::mul_dense(const Polynomial &a,
+								 const Polynomial &b,
+								 const std::vector<uint32_t> &bound,
+								 uint64_t size) {
+	const size_t nv = a.vars.size();
+
+	// vars[0] gets the largest stride, so descending index is descending lex
+	std::vector<uint64_t> stride(nv, 1);
+
+	for (size_t k = nv; k-- > 1;)
+		stride[k - 1] = stride[k] * ((uint64_t) bound[k] + 1);
+
+	auto kron = [&](const Polynomial &p, size_t t) {
+		uint64_t idx = 0;
+
+		for (size_t k = 0; k < nv; ++k)
+			idx += p.get_exp(p.mono(t), k) * stride[k];
+
+		return idx;
+	};
+
+	std::vector<uint64_t> ib(b.size());
+
+	for (size_t j = 0; j < b.size(); ++j)
+		ib[j] = kron(b, j);
+
+	std::vector<Rational> acc(size, Rational(0, 1));
+
+	for (size_t i = 0; i < a.size(); ++i) {
+		uint64_t ia = kron(a, i);
+
+		for (size_t j = 0; j < b.size(); ++j)
+			acc[ia + ib[j]] = acc[ia + ib[j]] + a.coeffs[i] * b.coeffs[j];
+	}
+
+	Polynomial r;
+	r.vars = a.vars;
+	r.layout(a.bits);
+
+	std::vector<uint64_t> m(r.words);
+
+	for (uint64_t idx = size; idx-- > 0;) {
+		if (acc[idx].is_zero())
+			continue;
+
+		std::fill(m.begin(), m.end(), 0);
+		uint64_t rest = idx;
+
+		for (size_t k = 0; k < nv; ++k) {
+			r.set_exp(m.data(), k, (uint32_t) (rest / stride[k]));
+			rest %= stride[k];
+		}
+
+		r.push_term(m.data(), acc[idx]);
+	}
+
+	return r;
+}
+
+bool Polynomial::operator==(const Polynomial &other) const {
+	Polynomial ta, tb;
+	const Polynomial *pa, *pb;
+	align(*this, other, 8, ta, tb, pa, pb);
+
+	if (pa->size() != pb->size())
+		return 0;
+
+	for (size_t t = 0; t < pa->size(); ++t) {
+		// both are in lowest terms; Rational's != cross-multiplies and can overflow
+		if (pa->cmp(pa->mono(t), pb->mono(t)) != 0 || pa->coeffs[t].pair() != pb->coeffs[t].pair())
+			return 0;
+	}
+
+	return 1;
+}
+
+bool Polynomial::operator!=(const Polynomial &other) const {
+	return !(*this == other);
+}
+
+Polynomial Polynomial::pow(uint32_t e) const {
+	Polynomial r = constant(Rational(1, 1));
+	Polynomial b = *this;
+
+	for (; e; e >>= 1) {
+		if (e & 1)
+			r = r * b;
+
+		if (e > 1)
+			b = b * b;
+	}
+
+	return r;
+}
+
+std::string Polynomial::univariate_var(const Polynomial &a, const Polynomial &b) {
+	std::vector<std::string> merged;
+	std::set_union(a.vars.begin(), a.vars.end(),
+				   b.vars.begin(), b.vars.end(),
+				   std::back_inserter(merged));
+
+	if (merged.size() > 1) {
+		throw std::runtime_error("polynomial is not univariate.");
+	}
+
+	return merged.empty() ? "" : merged[0];
+}
+
+std::vector<Rational> Polynomial::dense() const {
+	if (this->is_zero())
+		return {};
+
+	size_t deg = vars.empty() ? 0 : this->get_exp(this->mono(0), 0);
+	std::vector<Rational> c(deg + 1, Rational(0, 1));
+
+	for (size_t t = 0; t < this->size(); ++t)
+		c[vars.empty() ? 0 : this->get_exp(this->mono(t), 0)] = coeffs[t];
+
+	return c;
+}
+
+Polynomial Polynomial::from_dense(const std::string &var, const std::vector<Rational> &c) {
+	if (var.empty())
+		return constant(c.empty() ? Rational(0, 1) : c[0]);
+
+	Polynomial p({ var });
+	p.layout(bits_for(c.empty() ? 0 : c.size() - 1));
+
+	std::vector<uint64_t> m(p.words);
+
+	for (size_t k = c.size(); k-- > 0;) {
+		if (c[k].is_zero())
+			continue;
+
+		m[0] = 0;
+		p.set_exp(m.data(), 0, (uint32_t) k);
+		p.push_term(m.data(), c[k]);
+	}
+
+	return p;
+}
+
+void Polynomial::divide(const Polynomial &a,
+						const Polynomial &b,
+						Polynomial &q,
+						Polynomial &r) {
+	std::string var = univariate_var(a, b);
+
+	if (b.is_zero()) {
+		throw std::runtime_error("DIV BY ZERO.");
+	}
+
+	std::vector<Rational> num = a.dense(), den = b.dense();
+	size_t n = (num.size() >= den.size()) ? num.size() - den.size() + 1 : 0;
+	std::vector<Rational> quot(n, Rational(0, 1));
+	Rational lead = den.back();
+
+	for (size_t k = n; k-- > 0;) {
+		Rational c = num[k + den.size() - 1] / lead;
+		quot[k] = c;
+
+		if (c.is_zero())
+			continue;
+
+		for (size_t j = 0; j < den.size(); ++j)
+			num[k + j] = num[k + j] - c * den[j];
+	}
+
+	if (num.size() > den.size() - 1)
+		num.erase(num.begin() + (den.size() - 1), num.end());
+
+	q = from_dense(var, quot);
+	r = from_dense(var, num);
+}
+
+// dense image mod p; false if p divides a denominator
+bool Polynomial::reduce(uint64_t p, std::vector<uint64_t> &out) const {
+	std::vector<Rational> c = this->dense();
+	out.assign(c.size(), 0);
+
+	for (size_t k = 0; k < c.size(); ++k) {
+		int64_t n = c[k].numerator() % (int64_t) p;
+		uint64_t d = (uint64_t) (c[k].denominator() % (int64_t) p);
+
+		if (!d)
+			return 0;
+
+		uint64_t un = (uint64_t) ((n < 0) ? n + (int64_t) p : n);
+		out[k] = un * utils::mod_inv(d, p) % p;
+	}
+
+	while (!out.empty() && !out.back())
+		out.pop_back();
+
+	return 1;
+}
+
+// monic gcd over Z/p by the Euclidean algorithm
+std::vector<uint64_t> Polynomial::gcd_mod(std::vector<uint64_t> a, std::vector<uint64_t> b, uint64_t p) {
+	while (!b.empty()) {
+		uint64_t inv = utils::mod_inv(b.back(), p);
+
+		while (a.size() >= b.size()) {
+			uint64_t c = a.back() * inv % p;
+			size_t shift = a.size() - b.size();
+
+			for (size_t j = 0; j < b.size(); ++j)
+				a[shift + j] = (a[shift + j] + p - c * b[j] % p) % p;
+
+			while (!a.empty() && !a.back())
+				a.pop_back();
+		}
+
+		a.swap(b);
+	}
+
+	if (!a.empty()) {
+		uint64_t inv = utils::mod_inv(a.back(), p);
+
+		for (auto &x : a)
+			x = x * inv % p;
+	}
+
+	return a;
+}
+
+// Unsigned integers of any size for the CRT modulus and residues: 32-bit
+// digits, least significant first, no leading zero digits; zero is empty.
+static void big_trim(Polynomial::Digits &a) {
+	while (!a.empty() && !a.back())
+		a.pop_back();
+}
+
+static int big_cmp(const Polynomial::Digits &a, const Polynomial::Digits &b) {
+	if (a.size() != b.size())
+		return a.size() < b.size() ? -1 : 1;
+
+	for (size_t j = a.size(); j-- > 0;) {
+		if (a[j] != b[j])
+			return a[j] < b[j] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static void big_add(Polynomial::Digits &a, const Polynomial::Digits &b) {
+	uint64_t carry = 0;
+
+	if (a.size() < b.size())
+		a.resize(b.size(), 0);
+
+	for (size_t j = 0; j < a.size(); ++j) {
+		carry += (uint64_t) a[j] + (j < b.size() ? b[j] : 0);
+		a[j] = (uint32_t) carry;
+		carry >>= 32;
+	}
+
+	if (carry)
+		a.push_back((uint32_t) carry);
+}
+
+// a -= b, for a >= b
+static void big_sub(Polynomial::Digits &a, const Polynomial::Digits &b) {
+	int64_t borrow = 0;
+
+	for (size_t j = 0; j < a.size(); ++j) {
+		borrow += (int64_t) a[j] - (j < b.size() ? b[j] : 0);
+		a[j] = (uint32_t) borrow;
+		borrow >>= 32;
+	}
+
+	big_trim(a);
+}
+
+static Polynomial::Digits big_mul(const Polynomial::Digits &a, const Polynomial::Digits &b) {
+	Polynomial::Digits c(a.size() + b.size(), 0);
+
+	for (size_t i = 0; i < a.size(); ++i) {
+		uint64_t carry = 0;
+
+		for (size_t j = 0; j < b.size(); ++j) {
+			carry += (uint64_t) a[i] * b[j] + c[i + j];
+			c[i + j] = (uint32_t) carry;
+			carry >>= 32;
+		}
+
+		c[i + b.size()] = (uint32_t) carry;
+	}
+
+	big_trim(c);
+	return c;
+}
+
+static Polynomial::Digits big_small(uint64_t v) {
+	Polynomial::Digits a = { (uint32_t) v, (uint32_t) (v >> 32) };
+	big_trim(a);
+	return a;
+}
+
+// a mod p, for p below 2^32
+static uint64_t big_mod(const Polynomial::Digits &a, uint64_t p) {
+	uint64_t r = 0;
+
+	for (size_t j = a.size(); j-- > 0;)
+		r = ((r << 32) | a[j]) % p;
+
+	return r;
+}
+
+static size_t big_bits(const Polynomial::Digits &a) {
+	if (a.empty())
+		return 0;
+
+	return 32 * a.size() - __builtin_clz(a.back());
+}
+
+static void big_shift(Polynomial::Digits &a, size_t bits, bool left) {
+	Polynomial::Digits out;
+	size_t words = bits / 32, rest = bits % 32;
+
+	if (left) {
+		out.assign(a.size() + words + 1, 0);
+
+		for (size_t j = 0; j < a.size(); ++j) {
+			out[j + words] |= a[j] << rest;
+
+			if (rest)
+				out[j + words + 1] |= a[j] >> (32 - rest);
+		}
+	} else {
+		for (size_t j = words; j < a.size(); ++j) {
+			uint32_t hi = (rest && j + 1 < a.size()) ? a[j + 1] << (32 - rest) : 0;
+			out.push_back((a[j] >> rest) | hi);
+		}
+	}
+
+	big_trim(out);
+	a.swap(out);
+}
+
+// a = q*b + r by shift and subtract, one step per quotient bit; the
+// quotients in the Euclidean algorithm are mostly a few bits
+static void big_divide(const Polynomial::Digits &a,
+					   const Polynomial::Digits &b,
+					   Polynomial::Digits &q,
+					   Polynomial::Digits &r) {
+	q.clear();
+	r = a;
+
+	if (big_cmp(a, b) < 0)
+		return;
+
+	size_t k = big_bits(a) - big_bits(b);
+	Polynomial::Digits d = b;
+	big_shift(d, k, 1);
+	q.assign(k / 32 + 1, 0);
+
+	for (size_t j = k + 1; j-- > 0;) {
+		if (big_cmp(r, d) >= 0) {
+			big_sub(r, d);
+			q[j / 32] |= 1u << (j % 32);
+		}
+
+		big_shift(d, 1, 0);
+	}
+
+	big_trim(q);
+}
+
+static bool big_int64(const Polynomial::Digits &a, int64_t &out) {
+	if (a.size() > 2 || (a.size() == 2 && (a[1] >> 31)))
+		return 0;
+
+	uint64_t v = 0;
+
+	for (size_t j = a.size(); j-- > 0;)
+		v = (v << 32) | a[j];
+
+	out = (int64_t) v;
+	return 1;
+}
+
+// Wang's rational reconstruction: n/d = u mod m with |n|, d <= sqrt(m/2).
+// The remainders shrink from m, the cofactors grow from 1 and alternate in
+// sign, so only their magnitudes are kept.
+bool Polynomial::rational_reconstruct(const Digits &u, const Digits &m, Rational &out) {
+	// 2*x^2 <= m, that is x <= sqrt(m/2)
+	auto within = [&](const Digits &x) {
+		Digits s = big_mul(x, x);
+		big_add(s, s);
+		return big_cmp(s, m) <= 0;
+	};
+
+	Digits r0 = m, r1 = u, t0, t1 = { 1 }, q, r2;
+	bool negative = 0;
+
+	while (!within(r1)) {
+		big_divide(r0, r1, q, r2);
+
+		Digits t2 = big_mul(q, t1);
+		big_add(t2, t0);
+
+		r0.swap(r1);
+		r1.swap(r2);
+		t0.swap(t1);
+		t1.swap(t2);
+		negative = !negative;
+	}
+
+	int64_t n, d;
+
+	if (t1.empty() || !within(t1) || !big_int64(r1, n) || !big_int64(t1, d))
+		return 0;
+
+	if (utils::gcd(n, d) != 1)
+		return 0;
+
+	out = Rational(negative ? -n : n, d);
+	return 1;
+}
+
+// The gcd is computed modulo 31-bit primes; primes that divide a
+// denominator or drop a leading coefficient are skipped, and an image of
+// too high degree is unlucky and discarded. Images of the lowest degree
+// seen are combined by CRT into a modulus of any size, and after each
+// prime the coefficients are recovered by rational reconstruction. Once
+// two moduli give the same coefficients, they are checked by trial
+// division; only the coefficients themselves must fit in 64 bits.
+Polynomial Polynomial::gcd(const Polynomial &a, const Polynomial &b) {
+	std::string var = univariate_var(a, b);
+
+	auto monic = [](const Polynomial &p) {
+		return p * (Rational(1, 1) / p.leading_coefficient());
+	};
+
+	if (a.is_zero() && b.is_zero())
+		return Polynomial();
+
+	if (a.is_zero())
+		return monic(b);
+
+	if (b.is_zero())
+		return monic(a);
+
+	if (a.is_constant() || b.is_constant())
+		return constant(Rational(1, 1));
+
+	static const uint64_t primes[] = {
+		2147483647, 2147483629, 2147483587, 2147483579,
+		2147483563, 2147483549, 2147483543, 2147483497,
+		2147483489, 2147483477, 2147483423, 2147483399,
+		2147483353, 2147483323, 2147483269, 2147483249
+	};
+
+	size_t deg_a = a.dense().size(), deg_b = b.dense().size();
+	size_t deg = SIZE_MAX;
+	Digits m;
+	std::vector<Digits> acc;
+	// coefficients reconstructed from the previous modulus
+	std::vector<Rational> last;
+
+	for (uint64_t p : primes) {
+		std::vector<uint64_t> ra, rb;
+
+		if (!a.reduce(p, ra) || !b.reduce(p, rb))
+			continue;
+
+		if (ra.size() != deg_a || rb.size() != deg_b)
+			continue;
+
+		std::vector<uint64_t> g = gcd_mod(ra, rb, p);
+
+		if (g.size() == 1)
+			return constant(Rational(1, 1));
+
+		if (g.size() - 1 > deg)
+			continue;
+
+		if (g.size() - 1 < deg) {
+			deg = g.size() - 1;
+			m = big_small(p);
+			acc.clear();
+			last.clear();
+
+			for (uint64_t x : g)
+				acc.push_back(big_small(x));
+		} else {
+			uint64_t inv = utils::mod_inv(big_mod(m, p), p);
+
+			for (size_t j = 0; j < acc.size(); ++j) {
+				uint64_t t = (g[j] + p - big_mod(acc[j], p)) % p * inv % p;
+				big_add(acc[j], big_mul(m, big_small(t)));
+			}
+
+			m = big_mul(m, big_small(p));
+		}
+
+		std::vector<Rational> c;
+
+		for (const auto &x : acc) {
+			Rational r(0, 1);
+
+			if (!rational_reconstruct(x, m, r))
+				break;
+
+			c.push_back(r);
+		}
+
+		if (c.size() != acc.size()) {
+			last.clear();
+			continue;
+		}
+
+		bool same = (c.size() == last.size());
+
+		for (size_t j = 0; same && j < c.size(); ++j)
+			same = (c[j].pair() == last[j].pair());
+
+		if (!same) {
+			last = c;
+			continue;
+		}
+
+		Polynomial cand = from_dense(var, c);
+
+		try {
+			Polynomial q, r;
+
+			divide(a, cand, q, r);
+
+			if (!r.is_zero())
+				continue;
+
+			divide(b, cand, q, r);
+
+			if (!r.is_zero())
+				continue;
+		} catch (const std::runtime_error &) {
+			continue;
+		}
+
+		return cand;
+	}
+
+	throw std::runtime_error("gcd: coefficients exceed 64-bit range.");
+}
+
+size_t Polynomial::size() const {
+	return coeffs.size();
+}
+
+bool Polynomial::is_zero() const {
+	return coeffs.empty();
+}
+
+bool Polynomial::is_constant() const {
+	return this->total_degree() == 0;
+}
+
+const std::vector<std::string>& Polynomial::variables() const {
+	return vars;
+}
+
+const Rational& Polynomial::coeff(size_t t) const {
+	return coeffs.at(t);
+}
+
+std::vector<uint32_t> Polynomial::exponents(size_t t) const {
+	std::vector<uint32_t> e(vars.size());
+
+	for (size_t k = 0; k < vars.size(); ++k)
+		e[k] = this->get_exp(this->mono(t), k);
+
+	return e;
+}
+
+std::vector<uint32_t> Polynomial::degrees() const {
+	std::vector<uint32_t> d(vars.size(), 0);
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		for (size_t k = 0; k < vars.size(); ++k)
+			d[k] = std::max(d[k], this->get_exp(this->mono(t), k));
+	}
+
+	return d;
+}
+
+uint32_t Polynomial::degree(const std::string &var) const {
+	auto it = std::lower_bound(vars.begin(), vars.end(), var);
+
+	if (it == vars.end() || *it != var)
+		return 0;
+
+	return this->degrees()[it - vars.begin()];
+}
+
+uint32_t Polynomial::total_degree() const {
+	uint32_t best = 0;
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		uint32_t d = 0;
+
+		for (size_t k = 0; k < vars.size(); ++k)
+			d += this->get_exp(this->mono(t), k);
+
+		best = std::max(best, d);
+	}
+
+	return best;
+}
+
+Rational Polynomial::leading_coefficient() const {
+	if (this->is_zero())
+		return Rational(0, 1);
+
+	return coeffs[0];
+}
+
+Rational Polynomial::evaluate(const std::unordered_map<std::string, Rational> &at) const {
+	std::vector<Rational> x;
+
+	for (const auto &v : vars) {
+		auto it = at.find(v);
+
+		if (it == at.end()) {
+			throw std::runtime_error("var: {" + v + "} not found in evaluation context.");
+		}
+
+		x.push_back(it->second);
+	}
+
+	Rational sum(0, 1);
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		Rational term = coeffs[t];
+
+		for (size_t k = 0; k < vars.size(); ++k) {
+			Rational p(1, 1);
+			uint32_t e = this->get_exp(this->mono(t), k);
+
+			if (e && !math_utils::exact_pow(x[k], e, p)) {
+				throw std::runtime_error("can't evaluate polynomial.");
+			}
+
+			term = term * p;
+		}
+
+		sum = sum + term;
+	}
+
+	return sum;
+}
+
+double Polynomial::evaluate(const std::unordered_map<std::string, double> &at) const {
+	std::vector<double> x;
+
+	for (const auto &v : vars) {
+		auto it = at.find(v);
+
+		if (it == at.end()) {
+			throw std::runtime_error("var: {" + v + "} not found in evaluation context.");
+		}
+
+		x.push_back(it->second);
+	}
+
+	double sum = 0;
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		double term = coeffs[t].val();
+
+		for (size_t k = 0; k < vars.size(); ++k)
+			term *= std::pow(x[k], (double) this->get_exp(this->mono(t), k));
+
+		sum += term;
+	}
+
+	return sum;
+}
+
+std::unordered_map<std::string, int> Polynomial::classify(const eDAG &dag, const std::string &id) {
+	std::unordered_map<std::string, int> kind;
+	classify(dag, id, kind);
+
+	return kind;
+}
+
+void Polynomial::classify(const eDAG &dag,
+						  const std::string &id,
+						  std::unordered_map<std::string, int> &kind) {
+	std::stack<std::pair<std::string, bool>> work;
+
+	work.push({ id, 0 });
+
+	while (!work.empty()) {
+		auto [nid, expanded] = work.top();
+		work.pop();
+
+		if (kind.find(nid) != kind.end())
+			continue;
+
+		auto node = dag.get_node(nid);
+
+		if (!node) {
+			throw std::runtime_error("node not found: " + nid);
+		}
+
+		if (node->type == NodeType::VARIABLE) {
+			kind[nid] = 1;
+			continue;
+		}
+
+		if (node->type == NodeType::CONSTANT) {
+			Rational c(0, 1);
+			kind[nid] = dag.const_value(nid, c) ? 2 : 0;
+			continue;
+		}
+
+		auto itc = dag.pool->find_children(nid);
+
+		if (!itc) {
+			kind[nid] = 0;
+			continue;
+		}
+
+		const auto &children = *itc;
+
+		if (!expanded) {
+			work.push({ nid, 1 });
+
+			for (const auto &c : children) {
+				if (kind.find(c) == kind.end())
+					work.push({ c, 0 });
+			}
+
+			continue;
+		}
+
+		int k = 0;
+
+		switch (node->op) {
+			case OPType::ADD:
+			case OPType::SUBTRACT:
+			case OPType::MULTIPLY:
+			case OPType::NEGATE: {
+				k = 2;
+
+				for (const auto &c : children) {
+					int kc = kind.at(c);
+
+					if (!kc) {
+						k = 0;
+						break;
+					}
+
+					k = std::min(k, kc);
+				}
+
+				break;
+			}
+			case OPType::DIVIDE: {
+				// only division by a constant keeps it a polynomial
+				if (children.size() == 2 && kind.at(children[1]) == 2)
+					k = kind.at(children[0]);
+
+				break;
+			}
+			case OPType::POWER: {
+				Rational e(0, 1);
+
+				if (children.size() == 2 &&
+					dag.const_value(children[1], e) &&
+					e.is_int() && e.numerator() >= 0)
+					k = kind.at(children[0]);
+
+				break;
+			}
+			default:
+				break;
+		}
+
+		kind[nid] = k;
+	}
+}
+
+Polynomial Polynomial::convert(const eDAG &dag,
+							   const std::string &id,
+							   const std::unordered_map<std::string, int> &kinds) {
+	auto kit = kinds.find(id);
+
+	if (kit == kinds.end() || !kit->second) {
+		throw std::runtime_error("not a polynomial: " + id);
+	}
+
+	// shared nodes are converted once
+	std::unordered_map<std::string, Polynomial> memo;
+	std::stack<std::pair<std::string, bool>> work;
+
+	work.push({ id, 0 });
+
+	while (!work.empty()) {
+		auto [nid, expanded] = work.top();
+		work.pop();
+
+		if (memo.find(nid) != memo.end())
+			continue;
+
+		auto node = dag.get_node(nid);
+
+		if (node->type == NodeType::VARIABLE) {
+			memo[nid] = variable(node->symbol());
+			continue;
+		}
+
+		if (node->type == NodeType::CONSTANT) {
+			Rational c(0, 1);
+			dag.const_value(nid, c);
+			memo[nid] = constant(c);
+			continue;
+		}
+
+		const auto &children = dag.pool->children(nid);
+
+		if (!expanded) {
+			work.push({ nid, 1 });
+
+			for (const auto &c : children) {
+				if (memo.find(c) == memo.end())
+					work.push({ c, 0 });
+			}
+
+			continue;
+		}
+
+		Polynomial p;
+
+		switch (node->op) {
+			case OPType::ADD: {
+				for (const auto &c : children)
+					p = p + memo.at(c);
+				break;
+			}
+			case OPType::MULTIPLY: {
+				p = constant(Rational(1, 1));
+
+				for (const auto &c : children)
+					p = p * memo.at(c);
+				break;
+			}
+			case OPType::SUBTRACT:
+				p = memo.at(children[0]) - memo.at(children[1]);
+				break;
+			case OPType::NEGATE:
+				p = -memo.at(children[0]);
+				break;
+			case OPType::DIVIDE: {
+				const Polynomial &d = memo.at(children[1]);
+
+				if (d.is_zero()) {
+					throw std::runtime_error("DIV BY ZERO.");
+				}
+
+				p = memo.at(children[0]) * (Rational(1, 1) / d.coeffs[0]);
+				break;
+			}
+			case OPType::POWER: {
+				Rational e(0, 1);
+				dag.const_value(children[1], e);
+
+				if (e.numerator() > 0xffffffffLL) {
+					throw std::runtime_error("polynomial exponent overflow.");
+				}
+
+				p = memo.at(children[0]).pow((uint32_t) e.numerator());
+				break;
+			}
+			default:
+				throw std::runtime_error("not a polynomial: " + nid);
+		}
+
+		memo[nid] = std::move(p);
+	}
+
+	return memo.at(id);
+}
+
+bool Polynomial::is_polynomial(const eDAG &dag, const std::string &id) {
+	return classify(dag, id).at(id) != 0;
+}
+
+Polynomial Polynomial::from_edag(const eDAG &dag, const std::string &id) {
+	return convert(dag, id, classify(dag, id));
+}
+
+Polynomial Polynomial::from_edag(const eDAG &dag) {
+	if (dag.get_root().empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	return from_edag(dag, dag.get_root());
+}
+
+std::string Polynomial::to_edag(eDAG &dag) const {
+	if (this->is_zero())
+		return dag.intern_const(Rational(0, 1));
+
+	auto op_node = [&](OPType op, const std::vector<std::string> &children) {
+		return dag.intern_op_node(op,
+								  math_utils::op_to_string(op),
+								  math_utils::get_op_precedence(op),
+								  0,
+								  children);
+	};
+
+	std::vector<std::string> var_ids;
+
+	for (const auto &v : vars)
+		var_ids.push_back(dag.intern_leaf(NodeType::VARIABLE, v, 0));
+
+	std::vector<std::string> terms;
+
+	for (size_t t = 0; t < this->size(); ++t) {
+		std::vector<std::string> factors;
+
+		if (coeffs[t] != Rational(1, 1))
+			factors.push_back(dag.intern_const(coeffs[t]));
+
+		for (size_t k = 0; k < vars.size(); ++k) {
+			uint32_t e = this->get_exp(this->mono(t), k);
+
+			if (e == 1) {
+				factors.push_back(var_ids[k]);
+			} else if (e > 1) {
+				factors.push_back(op_node(OPType::POWER,
+										  { var_ids[k], dag.intern_const(Rational((int64_t) e, 1)) }));
+			}
+		}
+
+		if (factors.empty()) {
+			terms.push_back(dag.intern_const(Rational(1, 1)));
+		} else if (factors.size() == 1) {
+			terms.push_back(factors[0]);
+		} else {
+			terms.push_back(op_node(OPType::MULTIPLY, factors));
+		}
+	}
+
+	if (terms.size() == 1)
+		return terms[0];
+
+	return op_node(OPType::ADD, terms);
+}
+
+eDAG Polynomial::to_edag() const {
+	eDAG out;
+	out.root = this->to_edag(out);
+	return out;
+}
+
+eDAG Polynomial::expand(const eDAG &dag) {
+	if (dag.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	auto kinds = classify(dag, dag.root);
+
+	eDAG out = dag;
+
+	std::unordered_map<std::string, std::string> memo;
+	std::stack<std::pair<std::string, bool>> work;
+
+	work.push({ dag.root, 0 });
+
+	while (!work.empty()) {
+		auto [id, expanded] = work.top();
+		work.pop();
+
+		if (memo.find(id) != memo.end())
+			continue;
+
+		const auto &node = dag.pool->node(id);
+
+		if (node->is_leaf()) {
+			memo[id] = out.intern_leaf(node->type, node->symbol(), node->value);
+			continue;
+		}
+
+		// maximal polynomial subgraph: expand it as a whole
+		if (kinds.at(id)) {
+			memo[id] = convert(dag, id, kinds).to_edag(out);
+			continue;
+		}
+
+		const auto &children = dag.pool->children(id);
+
+		if (!expanded) {
+			work.push({ id, 1 });
+
+			for (const auto &c : children) {
+				if (memo.find(c) == memo.end())
+					work.push({ c, 0 });
+			}
+
+			continue;
+		}
+
+		std::vector<std::string> mapped;
+
+		for (const auto &c : children)
+			mapped.push_back(memo.at(c));
+
+		memo[id] = out.intern_op_node(node->op,
+									  node->symbol(),
+									  node->precedence,
+									  node->is_unary,
+									  mapped);
+	}
+
+	out.root = memo.at(dag.root);
+	return out;
+}
+
+eDAG eDAG::factor_rationals() const {
+	if (root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	eDAG out = *this;
+
+	// kinds of the nodes seen so far; nodes are immutable, so nested
+	// quotients reuse them instead of classifying their operands again
+	std::unordered_map<std::string, int> kinds;
+
+	auto cancel = [&](const std::string &n, const std::string &d) -> std::string {
+		Polynomial::classify(out, n, kinds);
+		Polynomial::classify(out, d, kinds);
+
+		if (!kinds.at(n) || !kinds.at(d))
+			return "";
+
+		Polynomial pn = Polynomial::convert(out, n, kinds), pd = Polynomial::convert(out, d, kinds);
+		Polynomial g = Polynomial::gcd(pn, pd);
+
+		if (g.total_degree() == 0)
+			return "";
+
+		Polynomial qn, qd, rem;
+		Polynomial::divide(pn, g, qn, rem);
+		Polynomial::divide(pd, g, qd, rem);
+
+		// make the denominator monic
+		Rational lc = Rational(1, 1) / qd.leading_coefficient();
+		qn = qn * lc;
+		qd = qd * lc;
+
+		if (qd.is_constant())
+			return qn.to_edag(out);
+
+		return out.intern_op_node(OPType::DIVIDE,
+								  "/",
+								  math_utils::get_op_precedence(OPType::DIVIDE),
+								  0,
+								  { qn.to_edag(out), qd.to_edag(out) });
+	};
+
+	std::unordered_map<std::string, std::string> memo;
+
+	for (const auto &id : this->post_order(root)) {
+		const auto &node = pool->node(id);
+
+		if (node->is_leaf()) {
+			memo[id] = out.intern_leaf(node->type, node->symbol(), node->value);
+			continue;
+		}
+
+		std::vector<std::string> mapped;
+
+		for (const auto &c : pool->children(id))
+			mapped.push_back(memo.at(c));
+
+		std::string r;
+
+		if (node->op == OPType::DIVIDE && mapped.size() == 2) {
+			try {
+				r = cancel(mapped[0], mapped[1]);
+			} catch (const std::runtime_error &) {
+				// multivariate or out of range: leave the quotient alone
+				r.clear();
+			}
+		}
+
+		if (r.empty()) {
+			r = out.intern_op_node(node->op,
+								   node->symbol(),
+								   node->precedence,
+								   node->is_unary,
+								   mapped);
+		}
+
+		memo[id] = r;
+	}
+
+	out.root = memo.at(root);
+
+	return out;
+}
+
+std::ostream& operator<<(std::ostream &os, const Polynomial &p) {
+	if (p.is_zero())
+		return os << "0";
+
+	for (size_t t = 0; t < p.size(); ++t) {
+		if (t)
+			os << " + ";
+
+		os << p.coeffs[t];
+
+		for (size_t k = 0; k < p.vars.size(); ++k) {
+			uint32_t e = p.get_exp(p.mono(t), k);
+
+			if (e)
+				os << "*" << p.vars[k];
+
+			if (e > 1)
+				os << "^" << e;
+		}
+	}
+
+	return os;
+}
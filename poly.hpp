@@ -0,0 +1,150 @@
+// Sparse multivariate polynomials with Rational coefficients
+#ifndef POLY_HPP
+#define POLY_HPP
+
+#include "edag.hpp"
+#include "rat.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Terms live in flat arrays sorted in descending lex order. A monomial is its
+// exponent vector packed into 64-bit words, with the field width picked from
+// the degree bound, so up to 8 variables of degree < 256 (or 4 of degree
+// < 65536) fit in one word and monomial multiply/compare are word add/compare.
+//
+// Exponents are limited to 32 bits and coefficients to int64 numerators and
+// denominators. Arithmetic whose result leaves that range throws
+// "polynomial coefficient overflow.", so expanding a large product can fail
+// where the factored form evaluates fine.
+class Polynomial {
+	friend class eDAG;
+
+	public:
+		// unsigned integer of any size, 32-bit digits least significant
+		// first, for the CRT modulus in gcd
+		using Digits = std::vector<uint32_t>;
+
+	private:
+		// sorted, vars[0] is the most significant in the term order
+		std::vector<std::string> vars;
+		unsigned bits;
+		size_t words;
+		std::vector<uint64_t> exps;
+		std::vector<Rational> coeffs;
+
+		void layout(unsigned b);
+		const uint64_t* mono(size_t t) const;
+		uint32_t get_exp(const uint64_t *m, size_t k) const;
+		void set_exp(uint64_t *m, size_t k, uint32_t e) const;
+		int cmp(const uint64_t *a, const uint64_t *b) const;
+		void push_term(const uint64_t *m, const Rational &c);
+
+		Polynomial repack(const std::vector<std::string> &to, unsigned b) const;
+
+		static unsigned bits_for(uint64_t deg);
+
+		// bring a and b onto the same variables and field width, copying only
+		// the operands that need it
+		static void align(const Polynomial &a,
+						  const Polynomial &b,
+						  unsigned min_bits,
+						  Polynomial &ta,
+						  Polynomial &tb,
+						  const Polynomial *&pa,
+						  const Polynomial *&pb);
+
+		static Polynomial mul_heap(const Polynomial &a, const Polynomial &b);
+		static Polynomial mul_dense(const Polynomial &a,
+									const Polynomial &b,
+									const std::vector<uint32_t> &bound,
+									uint64_t size);
+
+		// univariate helpers: dense coefficients indexed by degree
+		static std::string univariate_var(const Polynomial &a, const Polynomial &b);
+		std::vector<Rational> dense() const;
+		static Polynomial from_dense(const std::string &var, const std::vector<Rational> &c);
+		bool reduce(uint64_t p, std::vector<uint64_t> &out) const;
+		static std::vector<uint64_t> gcd_mod(std::vector<uint64_t> a, std::vector<uint64_t> b, uint64_t p);
+		static bool rational_reconstruct(const Digits &u, const Digits &m, Rational &out);
+
+		// 0: not a polynomial, 1: polynomial, 2: polynomial without variables
+		static std::unordered_map<std::string, int> classify(const eDAG &dag, const std::string &id);
+		// the same into kinds, skipping nodes already there
+		static void classify(const eDAG &dag,
+							 const std::string &id,
+							 std::unordered_map<std::string, int> &kinds);
+		static Polynomial convert(const eDAG &dag,
+								  const std::string &id,
+								  const std::unordered_map<std::string, int> &kinds);
+	public:
+		Polynomial();
+		explicit Polynomial(const std::vector<std::string> &vars);
+
+		static Polynomial constant(const Rational &c);
+		static Polynomial variable(const std::string &name);
+
+		Polynomial operator+(const Polynomial &other) const;
+		Polynomial operator-(const Polynomial &other) const;
+		Polynomial operator*(const Polynomial &other) const;
+		Polynomial operator*(const Rational &c) const;
+		Polynomial operator-() const;
+
+		bool operator==(const Polynomial &other) const;
+		bool operator!=(const Polynomial &other) const;
+
+		Polynomial pow(uint32_t e) const;
+
+		// univariate long division over Q: a = q*b + r
+		static void divide(const Polynomial &a,
+						   const Polynomial &b,
+						   Polynomial &q,
+						   Polynomial &r);
+
+		// monic gcd of univariate polynomials, computed modulo word-size
+		// primes and lifted back with CRT and rational reconstruction;
+		// throws if its coefficients do not fit in 64 bits
+		static Polynomial gcd(const Polynomial &a, const Polynomial &b);
+
+		// number of terms
+		size_t size() const;
+
+		bool is_zero() const;
+
+		bool is_constant() const;
+
+		const std::vector<std::string>& variables() const;
+
+		// term t, in descending lex order
+		const Rational& coeff(size_t t) const;
+		std::vector<uint32_t> exponents(size_t t) const;
+
+		// max exponent of each variable
+		std::vector<uint32_t> degrees() const;
+		uint32_t degree(const std::string &var) const;
+		uint32_t total_degree() const;
+
+		Rational leading_coefficient() const;
+
+		Rational evaluate(const std::unordered_map<std::string, Rational> &at) const;
+		double evaluate(const std::unordered_map<std::string, double> &at) const;
+
+		// polynomial detection over the DAG
+		static bool is_polynomial(const eDAG &dag, const std::string &id);
+
+		static Polynomial from_edag(const eDAG &dag, const std::string &id);
+		static Polynomial from_edag(const eDAG &dag);
+
+		// intern into dag, returns the node id
+		std::string to_edag(eDAG &dag) const;
+		eDAG to_edag() const;
+
+		// expand every maximal polynomial subgraph, keep the rest of the DAG
+		static eDAG expand(const eDAG &dag);
+
+		friend std::ostream& operator<<(std::ostream &os, const Polynomial &p);
+};
+
+#include "poly.cpp"
+
+#endif
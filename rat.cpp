@@ -1,6 +1,7 @@
 #include "rat.hpp"
 #include <string>
 #include <algorithm>
+#include <stdexcept>
 
 void Rational::normalize() {
 	int64_t gcd = utils::gcd(std::abs(num), std::abs(den));
@@ -35,10 +36,32 @@ Rational::Rational(const std::string &copy) {
 	}
 
 	size_t split = s.find('/');
+	size_t dot = s.find('.');
 
-	if (split == std::string::npos) {
+	if (split == std::string::npos && dot != std::string::npos) {
+		// decimal literal: 1.25 -> 125/100
+		std::string digits = s.substr(0, dot) + s.substr(dot + 1);
+		int64_t scale = 1;
+
+		for (size_t j = dot + 1; j < s.length(); ++j) {
+			if (__builtin_mul_overflow(scale, (int64_t) 10, &scale)) {
+				throw std::out_of_range("decimal literal too long.");
+			}
+		}
+
+		this->num = (int64_t) std::stoll(digits.empty() ? "0" : digits);
+		this->den = scale;
+
+		if (neg)
+			this->num *= -1;
+
+		this->normalize();
+	} else if (split == std::string::npos) {
 		this->num = (int64_t) std::stoll(s);
 		this->den = 1;
+
+		if (neg)
+			this->num *= -1;
 	} else {
 		this->num = (int64_t) std::stoll(s.substr(0, split));
 		this->den = (int64_t) std::stoll(s.substr(split+1));
@@ -59,20 +82,20 @@ Rational::Rational(double d) {
 	this->normalize();
 }
 
-// a/b + c/d
-// ad/bd + bc/bd
-// (ad + bc)/bd
+// a/b + c/d over the lcm of the denominators, g = gcd(b, d):
+// (a(d/g) + c(b/g)) / (b(d/g))
 Rational Rational::operator+(const Rational &other) const {
 	int64_t a = this->num,
 			b = this->den,
 			c = other.numerator(),
 			d = other.denominator();
 
+	int64_t g = utils::gcd(b, d);
 	int64_t n1, n2, n3, d1;
 
-	if (__builtin_mul_overflow(a, d, &n1) ||
-		__builtin_mul_overflow(b, c, &n2) ||
-		__builtin_mul_overflow(b, d, &d1)) {
+	if (__builtin_mul_overflow(a, d / g, &n1) ||
+		__builtin_mul_overflow(c, b / g, &n2) ||
+		__builtin_mul_overflow(b, d / g, &d1)) {
 		throw std::runtime_error("MUL overflow.");
 	}
 
@@ -83,20 +106,20 @@ Rational Rational::operator+(const Rational &other) const {
 	return Rational{n3, d1};
 }
 
-// a/b - c/d
-// ad/bd - bc/bd
-// (ad - bc)/bd
+// a/b - c/d over the lcm of the denominators, g = gcd(b, d):
+// (a(d/g) - c(b/g)) / (b(d/g))
 Rational Rational::operator-(const Rational &other) const {
 	int64_t a = this->num,
 			b = this->den,
 			c = other.numerator(),
 			d = other.denominator();
 
+	int64_t g = utils::gcd(b, d);
 	int64_t n1, n2, n3, d1;
 
-	if (__builtin_mul_overflow(a, d, &n1) ||
-		__builtin_mul_overflow(b, c, &n2) ||
-		__builtin_mul_overflow(b, d, &d1)) {
+	if (__builtin_mul_overflow(a, d / g, &n1) ||
+		__builtin_mul_overflow(c, b / g, &n2) ||
+		__builtin_mul_overflow(b, d / g, &d1)) {
 		throw std::runtime_error("MUL overflow.");
 	}
 
@@ -104,16 +127,29 @@ Rational Rational::operator-(const Rational &other) const {
 		throw std::runtime_error("SUB overflow.");
 	}
 
-
 	return Rational{n3, d1};
 }
 
+// a/b * c/d, with a against d and c against b reduced first so a product
+// that fits is not lost to an intermediate one that doesn't
 Rational Rational::operator*(const Rational &other) const {
 	int64_t a = this->num,
 			b = this->den,
 			c = other.numerator(),
 			d = other.denominator();
 
+	int64_t g1 = utils::gcd(std::abs(a), d), g2 = utils::gcd(std::abs(c), b);
+
+	if (g1 > 1) {
+		a /= g1;
+		d /= g1;
+	}
+
+	if (g2 > 1) {
+		c /= g2;
+		b /= g2;
+	}
+
 	int64_t n1, d1;
 
 	if (__builtin_mul_overflow(a, c, &n1) ||
@@ -124,7 +160,7 @@ Rational Rational::operator*(const Rational &other) const {
 	return Rational{n1, d1};
 }
 
-// a/b / (c/d)
+// a/b / (c/d), reduced like operator*
 Rational Rational::operator/(const Rational &other) const {
 	if (other.is_zero()) {
 		throw std::runtime_error("can't divide by zero.");
@@ -135,6 +171,18 @@ Rational Rational::operator/(const Rational &other) const {
 			c = other.numerator(),
 			d = other.denominator();
 
+	int64_t g1 = utils::gcd(std::abs(a), std::abs(c)), g2 = utils::gcd(d, b);
+
+	if (g1 > 1) {
+		a /= g1;
+		c /= g1;
+	}
+
+	if (g2 > 1) {
+		d /= g2;
+		b /= g2;
+	}
+
 	int64_t n1, d1;
 
 	if (__builtin_mul_overflow(a, d, &n1) ||
@@ -147,7 +195,13 @@ Rational Rational::operator/(const Rational &other) const {
 
 // Unary minus: -a/b = -a/b
 Rational Rational::operator-() const {
-	return Rational(-this->num, this->den);
+	int64_t n;
+
+	if (__builtin_sub_overflow((int64_t) 0, this->num, &n)) {
+		throw std::runtime_error("NEGATE overflow.");
+	}
+
+	return Rational(n, this->den);
 }
 
 bool Rational::operator==(const Rational &other) const {
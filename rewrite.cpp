@@ -0,0 +1,689 @@
+#include "rewrite.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stack>
+
+Rewriter::Rewriter() : trie(1) {}
+
+Rewriter::Pattern Rewriter::to_pattern(const eDAG &dag, const std::string &id) {
+	const auto &node = dag.pool->node(id);
+
+	Pattern p{node->type,
+			  node->op,
+			  node->symbol(),
+			  node->value,
+			  node->precedence,
+			  node->is_unary,
+			  {}};
+
+	auto kids = dag.pool->find_children(id);
+
+	if (node->is_op() && kids) {
+		for (const auto &c : *kids) {
+			p.children.push_back(to_pattern(dag, c));
+		}
+	}
+
+	return p;
+}
+
+// every ordering of ADD/MULTIPLY operands, so matching stays a plain descent.
+// With top unset the operands of p itself keep their order.
+std::vector<Rewriter::Pattern> Rewriter::permutations(const Pattern &p, bool top) {
+	if (p.type != NodeType::OPERATION) {
+		return { p };
+	}
+
+	std::vector<std::vector<Pattern>> combos = { {} };
+
+	for (const auto &c : p.children) {
+		std::vector<std::vector<Pattern>> next;
+
+		for (const auto &v : permutations(c)) {
+			for (const auto &combo : combos) {
+				next.push_back(combo);
+				next.back().push_back(v);
+			}
+		}
+
+		combos.swap(next);
+	}
+
+	std::vector<Pattern> out;
+	bool comm = top && (p.op == OPType::ADD || p.op == OPType::MULTIPLY);
+
+	for (const auto &combo : combos) {
+		std::vector<size_t> idx(combo.size());
+
+		for (size_t j = 0; j < idx.size(); ++j)
+			idx[j] = j;
+
+		do {
+			Pattern q = p;
+			q.children.clear();
+
+			for (size_t j : idx)
+				q.children.push_back(combo[j]);
+
+			out.push_back(q);
+
+			if (out.size() > 720) {
+				throw std::runtime_error("rule pattern has too many commutative orderings.");
+			}
+		} while (comm && std::next_permutation(idx.begin(), idx.end()));
+	}
+
+	return out;
+}
+
+uint64_t Rewriter::op_key(OPType op, size_t arity) {
+	return (static_cast<uint64_t>(op) << 32) | static_cast<uint64_t>(arity);
+}
+
+std::string Rewriter::const_key(const Number &v) {
+	if (v.is_rational()) {
+		Rational r = v.to_rational();
+		return std::to_string(r.numerator()) + "/" + std::to_string(r.denominator());
+	} else if (v.is_int()) {
+		return std::to_string(v.as_int()) + "/1";
+	}
+
+	// integral doubles share the rational key so 0.0 still matches "0"
+	double d = v.to_double();
+
+	if (std::isfinite(d) && d == std::floor(d) && std::abs(d) < 9e15) {
+		return std::to_string(static_cast<int64_t>(d)) + "/1";
+	}
+
+	std::ostringstream os;
+	os << "d:" << std::setprecision(17) << d;
+	return os.str();
+}
+
+void Rewriter::insert(const Pattern &p, size_t rule, size_t variant) {
+	std::vector<const Pattern*> pending = { &p };
+	size_t at = 0;
+
+	while (!pending.empty()) {
+		const Pattern *q = pending.back();
+		pending.pop_back();
+
+		size_t next = 0;
+
+		if (q->type == NodeType::VARIABLE) {
+			if (!trie[at].star) {
+				trie[at].star = trie.size();
+				trie.emplace_back();
+			}
+
+			next = trie[at].star;
+		} else if (q->type == NodeType::CONSTANT) {
+			std::string k = const_key(q->value);
+			auto it = trie[at].consts.find(k);
+
+			if (it == trie[at].consts.end()) {
+				next = trie.size();
+				trie[at].consts[k] = next;
+				trie.emplace_back();
+			} else {
+				next = it->second;
+			}
+		} else {
+			uint64_t k = op_key(q->op, q->children.size());
+			auto it = trie[at].ops.find(k);
+
+			if (it == trie[at].ops.end()) {
+				next = trie.size();
+				trie[at].ops[k] = next;
+				trie.emplace_back();
+			} else {
+				next = it->second;
+			}
+
+			for (auto c = q->children.rbegin(); c != q->children.rend(); ++c)
+				pending.push_back(&*c);
+		}
+
+		at = next;
+	}
+
+	trie[at].entries.push_back({ rule, variant });
+}
+
+// walk the trie along the preorder of the pending subterms; a wildcard edge
+// skips a whole subterm. pending is restored before returning.
+void Rewriter::collect(size_t at,
+					   std::vector<std::string> &pending,
+					   const eDAG &dag,
+					   std::vector<std::pair<size_t, size_t>> &out) const {
+	const DTNode &t = trie[at];
+
+	if (pending.empty()) {
+		out.insert(out.end(), t.entries.begin(), t.entries.end());
+		return;
+	}
+
+	std::string id = pending.back();
+	pending.pop_back();
+
+	if (t.star)
+		this->collect(t.star, pending, dag, out);
+
+	const auto &node = dag.pool->node(id);
+
+	if (node->type == NodeType::CONSTANT) {
+		auto it = t.consts.find(const_key(node->value));
+
+		if (it != t.consts.end())
+			this->collect(it->second, pending, dag, out);
+	} else if (node->is_op()) {
+		auto itc = dag.pool->find_children(id);
+
+		if (itc) {
+			const auto &children = *itc;
+			auto it = t.ops.find(op_key(node->op, children.size()));
+
+			if (it != t.ops.end()) {
+				size_t mark = pending.size();
+				pending.insert(pending.end(), children.rbegin(), children.rend());
+				this->collect(it->second, pending, dag, out);
+				pending.resize(mark);
+			}
+		}
+	}
+
+	pending.push_back(id);
+}
+
+bool Rewriter::match(const Pattern &p,
+					 const std::string &id,
+					 const eDAG &dag,
+					 Bindings &b,
+					 std::vector<const std::string*> *trail) const {
+	if (p.type == NodeType::VARIABLE) {
+		auto it = b.find(p.symbol);
+
+		if (it != b.end())
+			return it->second == id;
+
+		b[p.symbol] = id;
+
+		if (trail)
+			trail->push_back(&p.symbol);
+
+		return 1;
+	}
+
+	const auto &node = dag.pool->node(id);
+
+	if (p.type == NodeType::CONSTANT) {
+		return node->type == NodeType::CONSTANT &&
+			   const_key(node->value) == const_key(p.value);
+	}
+
+	if (!node->is_op() || node->op != p.op)
+		return 0;
+
+	auto itc = dag.pool->find_children(id);
+
+	if (!itc || itc->size() != p.children.size())
+		return 0;
+
+	for (size_t j = 0; j < p.children.size(); ++j) {
+		if (!this->match(p.children[j], (*itc)[j], dag, b, trail))
+			return 0;
+	}
+
+	return 1;
+}
+
+Rewriter::Operands::Operands(const std::vector<std::string> &ids, const eDAG &dag) : ids(ids) {
+	for (size_t i = 0; i < ids.size(); ++i) {
+		const auto &node = dag.pool->node(ids[i]);
+
+		if (node->type == NodeType::CONSTANT) {
+			consts[const_key(node->value)].push_back(i);
+		} else if (node->is_op()) {
+			auto itc = dag.pool->find_children(ids[i]);
+
+			if (itc)
+				ops[op_key(node->op, itc->size())].push_back(i);
+		}
+
+		same[ids[i]].push_back(i);
+		all.push_back(i);
+	}
+}
+
+Rewriter::Nested Rewriter::nested(const Pattern &p) {
+	// occurrences of each wildcard anywhere in p
+	std::unordered_map<std::string, size_t> seen;
+	std::vector<const Pattern*> pending = { &p };
+
+	while (!pending.empty()) {
+		const Pattern *q = pending.back();
+		pending.pop_back();
+
+		if (q->type == NodeType::VARIABLE)
+			++seen[q->symbol];
+
+		for (const auto &c : q->children)
+			pending.push_back(&c);
+	}
+
+	auto rank = [&](const Pattern &c) {
+		if (c.type == NodeType::CONSTANT)
+			return 0;
+
+		if (c.type != NodeType::VARIABLE)
+			return 1;
+
+		return seen[c.symbol] > 1 ? 2 : 3;
+	};
+
+	Nested q{p, {}, 0};
+
+	for (int r = 0; r <= 3; ++r) {
+		if (r == 3)
+			q.tail = q.order.size();
+
+		for (size_t j = 0; j < p.children.size(); ++j) {
+			if (rank(p.children[j]) == r)
+				q.order.push_back(j);
+		}
+	}
+
+	return q;
+}
+
+bool Rewriter::match_some(const Nested &q,
+						  size_t j,
+						  const Operands &operands,
+						  std::vector<size_t> &used,
+						  std::vector<char> &taken,
+						  const eDAG &dag,
+						  Bindings &b,
+						  std::vector<const std::string*> &trail) const {
+	if (j == q.order.size())
+		return 1;
+
+	// distinct fresh wildcards: the first operands left over will do
+	if (j >= q.tail) {
+		size_t mark = used.size();
+
+		for (size_t i = 0; i < taken.size() && j < q.order.size(); ++i) {
+			if (taken[i])
+				continue;
+
+			const Pattern &c = q.p.children[q.order[j++]];
+			b[c.symbol] = operands.ids[i];
+			trail.push_back(&c.symbol);
+			taken[i] = 1;
+			used.push_back(i);
+		}
+
+		if (j == q.order.size())
+			return 1;
+
+		for (size_t k = mark; k < used.size(); ++k)
+			taken[used[k]] = 0;
+
+		used.resize(mark);
+		return 0;
+	}
+
+	const Pattern &c = q.p.children[q.order[j]];
+	const std::vector<size_t> *candidates = &operands.all;
+
+	auto among = [&](const auto &index, const auto &key) {
+		static const std::vector<size_t> none;
+		auto it = index.find(key);
+		return it == index.end() ? &none : &it->second;
+	};
+
+	if (c.type == NodeType::CONSTANT) {
+		candidates = among(operands.consts, const_key(c.value));
+	} else if (c.type != NodeType::VARIABLE) {
+		candidates = among(operands.ops, op_key(c.op, c.children.size()));
+	} else {
+		auto it = b.find(c.symbol);
+
+		if (it != b.end())
+			candidates = among(operands.same, it->second);
+	}
+
+	for (size_t i : *candidates) {
+		if (taken[i])
+			continue;
+
+		size_t mark = trail.size();
+
+		if (this->match(c, operands.ids[i], dag, b, &trail)) {
+			taken[i] = 1;
+			used.push_back(i);
+
+			if (this->match_some(q, j + 1, operands, used, taken, dag, b, trail))
+				return 1;
+
+			used.pop_back();
+			taken[i] = 0;
+		}
+
+		// undo the wildcards this attempt bound
+		for (size_t k = mark; k < trail.size(); ++k)
+			b.erase(*trail[k]);
+
+		trail.resize(mark);
+	}
+
+	return 0;
+}
+
+std::string Rewriter::build(const Pattern &p, const Bindings &b, eDAG &dag) const {
+	if (p.type == NodeType::VARIABLE)
+		return b.at(p.symbol);
+
+	if (p.type == NodeType::CONSTANT)
+		return dag.intern_leaf(NodeType::CONSTANT, p.symbol, p.value);
+
+	std::vector<std::string> children;
+
+	for (const auto &c : p.children)
+		children.push_back(this->build(c, b, dag));
+
+	return dag.intern_op_node(p.op, p.symbol, p.precedence, p.is_unary, children);
+}
+
+std::string Rewriter::apply(OPType op,
+							const std::vector<std::string> &children,
+							eDAG &dag,
+							RewriteStats &stats) const {
+	auto it = trie[0].ops.find(op_key(op, children.size()));
+
+	if (it != trie[0].ops.end()) {
+		std::vector<std::string> pending(children.rbegin(), children.rend());
+		std::vector<std::pair<size_t, size_t>> found;
+
+		this->collect(it->second, pending, dag, found);
+
+		// earlier rules win
+		std::sort(found.begin(), found.end());
+
+		for (const auto &[r, v] : found) {
+			const Rule &rule = rules[r];
+			const Pattern &p = rule.variants[v];
+			Bindings b;
+			bool ok = 1;
+
+			++stats.candidates;
+
+			for (size_t j = 0; ok && j < children.size(); ++j)
+				ok = this->match(p.children[j], children[j], dag, b);
+
+			if (!ok || (rule.guard && !rule.guard(dag, b)))
+				continue;
+
+			++stats.rewrites;
+			++stats.hits[r];
+
+			return this->build(rule.rhs, b, dag);
+		}
+	}
+
+	// a narrower + or * rule applied to some of the operands; the others
+	// are kept and the replacement takes the place of the first one used
+	auto itn = nary.find(static_cast<int>(op));
+
+	if (itn == nary.end())
+		return "";
+
+	Operands operands(children, dag);
+	std::vector<char> taken(children.size(), 0);
+
+	for (size_t r : itn->second) {
+		const Rule &rule = rules[r];
+
+		if (rule.lhs.children.size() >= children.size())
+			continue;
+
+		for (const auto &p : rule.nested) {
+			Bindings b;
+			std::vector<size_t> used;
+			std::vector<const std::string*> trail;
+
+			++stats.candidates;
+
+			bool ok = this->match_some(p, 0, operands, used, taken, dag, b, trail);
+
+			for (size_t i : used)
+				taken[i] = 0;
+
+			if (!ok ||
+				(rule.guard && !rule.guard(dag, b)))
+				continue;
+
+			++stats.rewrites;
+			++stats.hits[r];
+
+			std::string rep = this->build(rule.rhs, b, dag);
+			size_t first = *std::min_element(used.begin(), used.end());
+			std::vector<std::string> rest;
+
+			for (size_t i = 0; i < children.size(); ++i) {
+				if (i == first)
+					rest.push_back(rep);
+				else if (std::find(used.begin(), used.end(), i) == used.end())
+					rest.push_back(children[i]);
+			}
+
+			return dag.intern_op_node(op,
+									  rule.lhs.symbol,
+									  rule.lhs.precedence,
+									  rule.lhs.is_unary,
+									  rest);
+		}
+	}
+
+	return "";
+}
+
+// one bottom-up pass: children are rebuilt before their parents, and each
+// rebuilt node is rewritten at the top before it is interned in out
+std::string Rewriter::rebuild(const eDAG &src, eDAG &out, RewriteStats &stats) const {
+	std::unordered_map<std::string, std::string> memo;
+	std::stack<std::pair<std::string, bool>> work;
+
+	work.push({ src.root, 0 });
+
+	while (!work.empty()) {
+		auto [id, expanded] = work.top();
+		work.pop();
+
+		if (memo.find(id) != memo.end())
+			continue;
+
+		const auto &node = src.pool->node(id);
+
+		if (node->is_leaf()) {
+			++stats.visited;
+			memo[id] = out.intern_leaf(node->type, node->symbol(), node->value);
+			continue;
+		}
+
+		auto itc = src.pool->find_children(id);
+
+		if (!itc) {
+			throw std::runtime_error("operation node without operands: " + id);
+		}
+
+		const auto &children = *itc;
+
+		if (!expanded) {
+			work.push({ id, 1 });
+
+			for (auto c = children.rbegin(); c != children.rend(); ++c) {
+				if (memo.find(*c) == memo.end())
+					work.push({ *c, 0 });
+			}
+
+			continue;
+		}
+
+		++stats.visited;
+
+		std::vector<std::string> mapped;
+
+		for (const auto &c : children)
+			mapped.push_back(memo.at(c));
+
+		std::string r = this->apply(node->op, mapped, out, stats);
+
+		if (r.empty()) {
+			r = out.intern_op_node(node->op,
+								   node->symbol(),
+								   node->precedence,
+								   node->is_unary,
+								   mapped);
+		} else {
+			// the replacement may expose another redex at the top
+			for (int k = 0; k < 8; ++k) {
+				const auto &top = out.pool->node(r);
+				auto itr = out.pool->find_children(r);
+
+				if (!top->is_op() || !itr)
+					break;
+
+				std::vector<std::string> kids(itr->begin(), itr->end());
+				std::string s = this->apply(top->op, kids, out, stats);
+
+				if (s.empty())
+					break;
+
+				r = s;
+			}
+		}
+
+		memo[id] = r;
+	}
+
+	return memo.at(src.root);
+}
+
+size_t Rewriter::add_rule(const std::string &lhs,
+						  const std::string &rhs,
+						  Guard guard) {
+	eDAG l, r;
+	l.parse(lhs);
+	r.parse(rhs);
+
+	Rule rule{to_pattern(l, l.root), to_pattern(r, r.root), guard, {}, {}};
+
+	if (rule.lhs.type != NodeType::OPERATION) {
+		throw std::runtime_error("rule pattern must be an operation: " + lhs);
+	}
+
+	auto bound = l.get_vars();
+
+	for (const auto &v : r.get_vars()) {
+		if (std::find(bound.begin(), bound.end(), v) == bound.end()) {
+			throw std::runtime_error("unbound variable in rule: " + v);
+		}
+	}
+
+	rule.variants = permutations(rule.lhs);
+
+	size_t id = rules.size();
+	bool comm = (rule.lhs.op == OPType::ADD || rule.lhs.op == OPType::MULTIPLY);
+
+	if (comm) {
+		for (const auto &p : permutations(rule.lhs, 0))
+			rule.nested.push_back(nested(p));
+
+		nary[static_cast<int>(rule.lhs.op)].push_back(id);
+	}
+
+	rules.push_back(std::move(rule));
+
+	for (size_t j = 0; j < rules[id].variants.size(); ++j)
+		this->insert(rules[id].variants[j], id, j);
+
+	return id;
+}
+
+size_t Rewriter::size() const {
+	return rules.size();
+}
+
+eDAG Rewriter::rewrite(const eDAG &expr,
+					   RewriteStats *stats,
+					   size_t max_passes) const {
+	if (expr.root.empty()) {
+		throw std::runtime_error("no expression parsed.");
+	}
+
+	RewriteStats local;
+	RewriteStats &s = stats ? *stats : local;
+
+	if (s.hits.size() < rules.size())
+		s.hits.resize(rules.size(), 0);
+
+	eDAG cur = expr;
+
+	for (size_t pass = 0; pass < max_passes; ++pass) {
+		// share the pool: only rewritten nodes are interned
+		eDAG out = cur;
+		size_t before = s.rewrites;
+
+		out.root = this->rebuild(cur, out, s);
+		cur = std::move(out);
+		++s.passes;
+
+		if (s.rewrites == before)
+			break;
+	}
+
+	return cur;
+}
+
+const Rewriter& Rewriter::defaults() {
+	static const Rewriter rw = [] {
+		Rewriter r;
+
+		auto nonzero = [](const eDAG &dag, const Bindings &b) {
+			auto node = dag.get_node(b.at("x"));
+			return !(node->type == NodeType::CONSTANT &&
+					 const_key(node->value) == "0/1");
+		};
+
+		r.add_rule("x + 0", "x");
+		r.add_rule("x - 0", "x");
+		r.add_rule("0 - x", "-x");
+		r.add_rule("x - x", "0");
+		r.add_rule("x * 1", "x");
+		r.add_rule("x * 0", "0");
+		r.add_rule("x / 1", "x");
+		r.add_rule("0 / x", "0", nonzero);
+		r.add_rule("x ^ 1", "x");
+		r.add_rule("x ^ 0", "1", nonzero);
+		r.add_rule("1 ^ x", "1");
+		r.add_rule("-(-x)", "x");
+		r.add_rule("sin(0)", "0");
+		r.add_rule("cos(0)", "1");
+		r.add_rule("tan(0)", "0");
+		r.add_rule("log(1)", "0");
+		r.add_rule("exp(0)", "1");
+		r.add_rule("sqrt(0)", "0");
+		r.add_rule("sqrt(1)", "1");
+		r.add_rule("abs(0)", "0");
+		r.add_rule("log(exp(x))", "x");
+
+		return r;
+	}();
+
+	return rw;
+}
+
+eDAG eDAG::simplified() const {
+	return Rewriter::defaults().rewrite(*this);
+}
@@ -0,0 +1,154 @@
+// Pattern-directed rewriting over eDAG
+#ifndef REWRITE_HPP
+#define REWRITE_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+struct RewriteStats {
+	size_t passes = 0;
+	size_t visited = 0;
+	size_t candidates = 0;
+	size_t rewrites = 0;
+
+	// successful rewrites per rule, indexed by rule id
+	std::vector<size_t> hits;
+};
+
+// Rules are written as expressions: "x * 1" -> "x". Every variable in a
+// pattern is a wildcard; a variable used twice must bind the same node.
+// All rules are compiled into one discrimination tree keyed by op/arity,
+// so each node is matched against every candidate rule in a single descent.
+// A rule whose top is + or * also matches a wider sum or product: its
+// operands are picked from the node's in any order, and the rest are kept
+// beside the replacement ("x * 0" rewrites 2*x*0 to 0*x, then to 0).
+class Rewriter {
+	public:
+		// wildcard name -> node id in the expression being rewritten
+		using Bindings = std::unordered_map<std::string, std::string>;
+		using Guard = std::function<bool(const eDAG&, const Bindings&)>;
+
+	private:
+		struct Pattern {
+			NodeType type;
+			OPType op;
+			std::string symbol;
+			Number value;
+			int precedence;
+			bool is_unary;
+			std::vector<Pattern> children;
+		};
+
+		// a rule lhs for matching inside a wider + or *: its top operands
+		// are tried in order, constants and operators first, so a literal
+		// that is missing fails at once
+		struct Nested {
+			Pattern p;
+			std::vector<size_t> order;
+			// order[tail..] are wildcards used nowhere else in p, which any
+			// operands left over match without backtracking
+			size_t tail = 0;
+		};
+
+		// operands of a + or * node, by what a pattern operand can match
+		struct Operands {
+			const std::vector<std::string> &ids;
+			std::unordered_map<std::string, std::vector<size_t>> consts;
+			std::unordered_map<uint64_t, std::vector<size_t>> ops;
+			// node id -> positions, for wildcards already bound
+			std::unordered_map<std::string, std::vector<size_t>> same;
+			std::vector<size_t> all;
+
+			Operands(const std::vector<std::string> &ids, const eDAG &dag);
+		};
+
+		struct Rule {
+			Pattern lhs;
+			Pattern rhs;
+			Guard guard;
+			// lhs with commutative operands permuted, one per trie path
+			std::vector<Pattern> variants;
+			// lhs with only the operands below the top permuted, for
+			// matching inside a wider + or *
+			std::vector<Nested> nested;
+		};
+
+		struct DTNode {
+			std::unordered_map<uint64_t, size_t> ops;
+			std::unordered_map<std::string, size_t> consts;
+			size_t star = 0;
+			// (rule, variant) pairs whose path ends here
+			std::vector<std::pair<size_t, size_t>> entries;
+		};
+
+		std::vector<Rule> rules;
+		std::vector<DTNode> trie;
+		// rules with a + or * on top, by op, in rule order
+		std::unordered_map<int, std::vector<size_t>> nary;
+
+		static Pattern to_pattern(const eDAG &dag, const std::string &id);
+		static std::vector<Pattern> permutations(const Pattern &p, bool top = 1);
+		static uint64_t op_key(OPType op, size_t arity);
+		static std::string const_key(const Number &v);
+		static Nested nested(const Pattern &p);
+
+		void insert(const Pattern &p, size_t rule, size_t variant);
+
+		void collect(size_t at,
+					 std::vector<std::string> &pending,
+					 const eDAG &dag,
+					 std::vector<std::pair<size_t, size_t>> &out) const;
+
+		// wildcards bound here are appended to trail, if given, so a
+		// failed attempt can be undone
+		bool match(const Pattern &p,
+				   const std::string &id,
+				   const eDAG &dag,
+				   Bindings &b,
+				   std::vector<const std::string*> *trail = nullptr) const;
+
+		// match the operands of q.p, from order[j] on, against distinct
+		// operands; used lists the positions taken, taken flags them
+		bool match_some(const Nested &q,
+						size_t j,
+						const Operands &operands,
+						std::vector<size_t> &used,
+						std::vector<char> &taken,
+						const eDAG &dag,
+						Bindings &b,
+						std::vector<const std::string*> &trail) const;
+
+		std::string build(const Pattern &p, const Bindings &b, eDAG &dag) const;
+
+		// try every candidate rule against op(children); returns "" on no match
+		std::string apply(OPType op,
+						  const std::vector<std::string> &children,
+						  eDAG &dag,
+						  RewriteStats &stats) const;
+
+		std::string rebuild(const eDAG &src, eDAG &out, RewriteStats &stats) const;
+	public:
+		Rewriter();
+
+		// add rule lhs -> rhs, returns the rule id
+		size_t add_rule(const std::string &lhs,
+						const std::string &rhs,
+						Guard guard = nullptr);
+
+		size_t size() const;
+
+		// rewrite bottom-up until no rule applies or max_passes is hit
+		eDAG rewrite(const eDAG &expr,
+					 RewriteStats *stats = nullptr,
+					 size_t max_passes = 16) const;
+
+		// identities from the README (x+0, x*1, sin(0), log(exp(x)), ...)
+		static const Rewriter& defaults();
+};
+
+#include "rewrite.cpp"
+
+#endif
@@ -0,0 +1,630 @@
+#include "store.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char STORE_MAGIC[8] = { 'C', 'A', 'S', 'S', 'T', 'O', 'R', 'E' };
+
+void eStore::write(const std::string &path, const std::vector<eDAG> &exprs) {
+	// one pool, so nodes are shared across expressions too
+	eDAG all;
+	std::vector<std::string> roots;
+
+	for (const auto &e : exprs) {
+		if (e.root.empty()) {
+			throw std::runtime_error("no expression parsed.");
+		}
+
+		roots.push_back(all.import_node(e, e.root));
+	}
+
+	std::vector<std::string> order;
+	std::unordered_map<std::string, uint32_t> index;
+	std::vector<Root> root_recs;
+
+	for (const auto &r : roots) {
+		std::vector<std::string> sub = all.post_order(r);
+
+		for (const auto &id : sub) {
+			if (index.emplace(id, (uint32_t) order.size()).second)
+				order.push_back(id);
+		}
+
+		if (order.size() >= UINT32_MAX) {
+			throw std::runtime_error("store: too many nodes.");
+		}
+
+		root_recs.push_back({ index.at(r), (uint32_t) sub.size() });
+	}
+
+	// variables sorted by name, then the builtin constants
+	std::vector<std::string> names, builtins;
+
+	for (const auto &id : order) {
+		const auto &node = all.pool->node(id);
+
+		if (node->type != NodeType::VARIABLE)
+			continue;
+
+		const std::string &s = node->symbol();
+		bool builtin = (s == "pi" || s == "PI" || s == "e" || s == "tau" || s == "TAU");
+		(builtin ? builtins : names).push_back(s);
+	}
+
+	std::sort(names.begin(), names.end());
+	size_t nvars = names.size();
+	names.insert(names.end(), builtins.begin(), builtins.end());
+
+	std::unordered_map<std::string, uint32_t> name_index;
+	std::vector<uint32_t> name_start = { 0 };
+	std::string name_bytes;
+
+	for (const auto &s : names) {
+		name_index.emplace(s, (uint32_t) name_index.size());
+		name_bytes += s;
+		name_start.push_back((uint32_t) name_bytes.size());
+	}
+
+	std::vector<Node> node_recs;
+	std::vector<uint32_t> start = { 0 }, child;
+	std::vector<Const> consts;
+
+	node_recs.reserve(order.size());
+	start.reserve(order.size() + 1);
+
+	for (const auto &id : order) {
+		const auto &node = all.pool->node(id);
+		Node rec = { (uint8_t) node->type, 0, 0, 0 };
+
+		if (node->type == NodeType::VARIABLE) {
+			rec.arg = name_index.at(node->symbol());
+		} else if (node->type == NodeType::CONSTANT) {
+			Const c;
+
+			if (node->value.is_exact()) {
+				Rational r = node->value.to_rational();
+				c = { r.numerator(), r.denominator() };
+			} else {
+				double d = node->value.to_double();
+				std::memcpy(&c.num, &d, sizeof(d));
+				c.den = 0;
+			}
+
+			rec.arg = (uint32_t) consts.size();
+			consts.push_back(c);
+		} else if (node->type == NodeType::OPERATION && node->op != OPType::UNKNOWN) {
+			rec.op = (uint8_t) node->op;
+
+			for (const auto &c : all.pool->children(id))
+				child.push_back(index.at(c));
+
+			if (child.size() >= UINT32_MAX) {
+				throw std::runtime_error("store: too many edges.");
+			}
+		} else {
+			throw std::runtime_error("store: unsupported node: " + node->to_string());
+		}
+
+		node_recs.push_back(rec);
+		start.push_back((uint32_t) child.size());
+	}
+
+	// sections follow the header, each 8-byte aligned
+	Header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+	h.version = 1;
+	h.byte_order = 0x01020304;
+	h.nodes = node_recs.size();
+	h.edges = child.size();
+	h.consts = consts.size();
+	h.names = names.size();
+	h.name_bytes = name_bytes.size();
+	h.vars = nvars;
+	h.roots = root_recs.size();
+
+	uint64_t at = sizeof(Header);
+
+	auto place = [&at](uint64_t bytes) {
+		uint64_t off = at;
+		at = (at + bytes + 7) & ~(uint64_t) 7;
+		return off;
+	};
+
+	h.node_off = place(node_recs.size() * sizeof(Node));
+	h.start_off = place(start.size() * sizeof(uint32_t));
+	h.child_off = place(child.size() * sizeof(uint32_t));
+	h.const_off = place(consts.size() * sizeof(Const));
+	h.name_start_off = place(name_start.size() * sizeof(uint32_t));
+	h.name_off = place(name_bytes.size());
+	h.root_off = place(root_recs.size() * sizeof(Root));
+	h.file_size = at;
+
+	// write under a private name, then rename into place, so readers never
+	// map a half-written file
+	std::string tmp = path + "." + std::to_string(::getpid()) + ".tmp";
+
+	{
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		uint64_t pos = 0;
+
+		auto put = [&](uint64_t off, const void *data, uint64_t bytes) {
+			static const char zero[8] = {};
+
+			out.write(zero, off - pos);
+			out.write(static_cast<const char *>(data), bytes);
+			pos = off + bytes;
+		};
+
+		put(0, &h, sizeof(h));
+		put(h.node_off, node_recs.data(), node_recs.size() * sizeof(Node));
+		put(h.start_off, start.data(), start.size() * sizeof(uint32_t));
+		put(h.child_off, child.data(), child.size() * sizeof(uint32_t));
+		put(h.const_off, consts.data(), consts.size() * sizeof(Const));
+		put(h.name_start_off, name_start.data(), name_start.size() * sizeof(uint32_t));
+		put(h.name_off, name_bytes.data(), name_bytes.size());
+		put(h.root_off, root_recs.data(), root_recs.size() * sizeof(Root));
+		put(h.file_size, nullptr, 0);
+
+		if (!out) {
+			std::remove(tmp.c_str());
+			throw std::runtime_error("store: can't write " + tmp);
+		}
+	}
+
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		std::remove(tmp.c_str());
+		throw std::runtime_error("store: can't rename " + tmp + " to " + path);
+	}
+}
+
+eStore::eStore(const std::string &path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+
+	if (fd < 0) {
+		throw std::runtime_error("store: can't open " + path);
+	}
+
+	struct stat st;
+
+	if (::fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+		::close(fd);
+		throw std::runtime_error("store: not a store file: " + path);
+	}
+
+	this->length = st.st_size;
+	void *p = ::mmap(nullptr, this->length, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (p == MAP_FAILED) {
+		throw std::runtime_error("store: can't map " + path);
+	}
+
+	size_t len = this->length;
+	this->map = std::shared_ptr<const char>(static_cast<const char *>(p),
+											[len](const char *q) { ::munmap((void *) q, len); });
+
+	const char *base = this->map.get();
+	this->head = reinterpret_cast<const Header *>(base);
+	const Header &h = *this->head;
+
+	if (std::memcmp(h.magic, STORE_MAGIC, sizeof(h.magic)) != 0 || h.byte_order != 0x01020304) {
+		throw std::runtime_error("store: not a store file: " + path);
+	}
+
+	if (h.version != 1) {
+		throw std::runtime_error("store: unsupported version " + std::to_string(h.version) + ".");
+	}
+
+	// sections inside the file and aligned; counts below 2^32 keep the
+	// products from overflowing
+	auto fits = [&](uint64_t off, uint64_t count, uint64_t size) {
+		return count < UINT32_MAX && off % 8 == 0 && off <= this->length && count * size <= this->length - off;
+	};
+
+	if (h.file_size != this->length ||
+		!fits(h.node_off, h.nodes, sizeof(Node)) ||
+		!fits(h.start_off, h.nodes + 1, sizeof(uint32_t)) ||
+		!fits(h.child_off, h.edges, sizeof(uint32_t)) ||
+		!fits(h.const_off, h.consts, sizeof(Const)) ||
+		!fits(h.name_start_off, h.names + 1, sizeof(uint32_t)) ||
+		!fits(h.name_off, h.name_bytes, 1) ||
+		!fits(h.root_off, h.roots, sizeof(Root)) ||
+		h.vars > h.names) {
+		throw std::runtime_error("store: corrupt header in " + path);
+	}
+
+	this->node_at = reinterpret_cast<const Node *>(base + h.node_off);
+	this->start_at = reinterpret_cast<const uint32_t *>(base + h.start_off);
+	this->child_at = reinterpret_cast<const uint32_t *>(base + h.child_off);
+	this->const_at = reinterpret_cast<const Const *>(base + h.const_off);
+	this->name_start = reinterpret_cast<const uint32_t *>(base + h.name_start_off);
+	this->name_bytes = base + h.name_off;
+	this->root_at = reinterpret_cast<const Root *>(base + h.root_off);
+
+	for (uint32_t k = 0; k < h.vars; ++k)
+		this->vars.push_back(this->name(k));
+}
+
+bool eStore::verify() const {
+	const Header &h = *this->head;
+
+	for (uint64_t k = 0; k < h.names; ++k) {
+		if (this->name_start[k] > this->name_start[k + 1])
+			return 0;
+	}
+
+	if (this->name_start[0] != 0 || this->name_start[h.names] > h.name_bytes)
+		return 0;
+
+	if (this->start_at[0] != 0 || this->start_at[h.nodes] != h.edges)
+		return 0;
+
+	for (uint64_t n = 0; n < h.nodes; ++n) {
+		const Node &rec = this->node_at[n];
+
+		if (this->start_at[n] > this->start_at[n + 1])
+			return 0;
+
+		bool leaf = (this->start_at[n] == this->start_at[n + 1]);
+
+		switch ((NodeType) rec.type) {
+			case NodeType::VARIABLE:
+				if (rec.arg >= h.names || !leaf)
+					return 0;
+				break;
+			case NodeType::CONSTANT:
+				if (rec.arg >= h.consts || !leaf)
+					return 0;
+				break;
+			case NodeType::OPERATION: {
+				if (rec.op >= (uint8_t) OPType::UNKNOWN || leaf)
+					return 0;
+
+				// eval reads exactly this many operands
+				uint32_t m = this->start_at[n + 1] - this->start_at[n];
+				OPType op = (OPType) rec.op;
+
+				if (op == OPType::POWER && m != 2)
+					return 0;
+
+				if (op >= OPType::NEGATE && m != 1)
+					return 0;
+				break;
+			}
+			default:
+				return 0;
+		}
+
+		for (uint32_t j = this->start_at[n]; j < this->start_at[n + 1]; ++j) {
+			if (this->child_at[j] >= n)
+				return 0;
+		}
+	}
+
+	// eval sizes its table from the recorded DAG size, so it must be the
+	// number of nodes reachable from the root. Children were checked above,
+	// so the walk stays in range; seen[n] holds the last root that reached n.
+	std::vector<uint64_t> seen(h.nodes, 0);
+	std::vector<uint32_t> work;
+
+	for (uint64_t k = 0; k < h.roots; ++k) {
+		if (this->root_at[k].node >= h.nodes)
+			return 0;
+
+		uint64_t count = 0;
+		work.assign(1, this->root_at[k].node);
+		seen[this->root_at[k].node] = k + 1;
+
+		while (!work.empty()) {
+			uint32_t n = work.back();
+			work.pop_back();
+			++count;
+
+			for (uint32_t j = this->start_at[n]; j < this->start_at[n + 1]; ++j) {
+				uint32_t c = this->child_at[j];
+
+				if (seen[c] != k + 1) {
+					seen[c] = k + 1;
+					work.push_back(c);
+				}
+			}
+		}
+
+		if (count != this->root_at[k].size)
+			return 0;
+	}
+
+	return 1;
+}
+
+size_t eStore::size() const {
+	return this->head->roots;
+}
+
+size_t eStore::nodes() const {
+	return this->head->nodes;
+}
+
+uint32_t eStore::root(size_t k) const {
+	if (k >= this->head->roots) {
+		throw std::runtime_error("store: no expression " + std::to_string(k) + ".");
+	}
+
+	return this->root_at[k].node;
+}
+
+size_t eStore::dag_size(size_t k) const {
+	this->root(k);
+	return this->root_at[k].size;
+}
+
+NodeType eStore::type(uint32_t n) const {
+	return (NodeType) this->node_at[n].type;
+}
+
+OPType eStore::op(uint32_t n) const {
+	return (OPType) this->node_at[n].op;
+}
+
+std::pair<const uint32_t*, size_t> eStore::children(uint32_t n) const {
+	return { this->child_at + this->start_at[n], this->start_at[n + 1] - this->start_at[n] };
+}
+
+std::string_view eStore::name(uint32_t k) const {
+	return std::string_view(this->name_bytes + this->name_start[k], this->name_start[k + 1] - this->name_start[k]);
+}
+
+std::string_view eStore::symbol(uint32_t n) const {
+	switch (this->type(n)) {
+		case NodeType::VARIABLE:
+			return this->name(this->node_at[n].arg);
+		case NodeType::OPERATION:
+			switch (this->op(n)) {
+				case OPType::ADD: return "+";
+				case OPType::SUBTRACT: return "-";
+				case OPType::MULTIPLY: return "*";
+				case OPType::DIVIDE: return "/";
+				case OPType::POWER: return "^";
+				case OPType::NEGATE: return "-";
+				case OPType::SIN: return "sin";
+				case OPType::COS: return "cos";
+				case OPType::TAN: return "tan";
+				case OPType::LOG: return "log";
+				case OPType::EXP: return "exp";
+				case OPType::SQRT: return "sqrt";
+				case OPType::ABS: return "abs";
+				default: return "";
+			}
+		default:
+			return "";
+	}
+}
+
+Number eStore::value(uint32_t n) const {
+	if (this->type(n) != NodeType::CONSTANT) {
+		throw std::runtime_error("store: node " + std::to_string(n) + " is not a constant.");
+	}
+
+	const Const &c = this->const_at[this->node_at[n].arg];
+
+	if (c.den == 0) {
+		double d;
+		std::memcpy(&d, &c.num, sizeof(d));
+		return Number(d);
+	}
+
+	if (c.den == 1)
+		return Number(c.num);
+
+	return Number(Rational(c.num, c.den));
+}
+
+const std::vector<std::string_view>& eStore::variables() const {
+	return this->vars;
+}
+
+double eStore::leaf(uint32_t n, const double *x) const {
+	const Node &rec = this->node_at[n];
+
+	if (rec.type == (uint8_t) NodeType::CONSTANT) {
+		const Const &c = this->const_at[rec.arg];
+
+		if (c.den == 0) {
+			double d;
+			std::memcpy(&d, &c.num, sizeof(d));
+			return d;
+		}
+
+		return (double) c.num / c.den;
+	}
+
+	if (rec.arg < this->vars.size())
+		return x[rec.arg];
+
+	std::string_view s = this->name(rec.arg);
+
+	if (s == "pi" || s == "PI")
+		return M_PI;
+	else if (s == "e")
+		return std::exp(1);
+
+	return 2 * M_PI;
+}
+
+// Depth-first from the root with an explicit stack. Values are memoized in
+// an open-addressing table sized from the root's DAG size, so shared nodes
+// are computed once and memory is proportional to the expression, not to
+// the store.
+double eStore::eval(size_t k, const double *x) const {
+	uint32_t r = this->root(k);
+
+	size_t cap = 16;
+	int shift = 60;
+
+	while (cap < 2 * (size_t) this->root_at[k].size) {
+		cap <<= 1;
+		--shift;
+	}
+
+	std::vector<uint32_t> keys(cap, UINT32_MAX);
+	std::vector<double> vals(cap);
+
+	// the size comes from the file: if more nodes turn up than it allows,
+	// the store is corrupt, and a full table would make slot() probe forever
+	size_t filled = 0;
+
+	auto slot = [&](uint32_t n) {
+		size_t s = (size_t) (((uint64_t) n * 0x9E3779B97F4A7C15ULL) >> shift);
+
+		while (keys[s] != UINT32_MAX && keys[s] != n)
+			s = (s + 1) & (cap - 1);
+
+		return s;
+	};
+
+	auto fill = [&](size_t s, uint32_t n) {
+		if (++filled > this->root_at[k].size) {
+			throw std::runtime_error("store: expression " + std::to_string(k) + " has more nodes than recorded.");
+		}
+
+		keys[s] = n;
+	};
+
+	std::vector<uint32_t> work = { r };
+	std::vector<double> a;
+
+	while (!work.empty()) {
+		uint32_t n = work.back();
+		size_t s = slot(n);
+
+		if (keys[s] == n) {
+			work.pop_back();
+			continue;
+		}
+
+		auto [kids, m] = this->children(n);
+
+		if (m == 0) {
+			fill(s, n);
+			vals[s] = this->leaf(n, x);
+			work.pop_back();
+			continue;
+		}
+
+		bool ready = 1;
+
+		for (size_t j = 0; j < m; ++j) {
+			if (keys[slot(kids[j])] != kids[j]) {
+				work.push_back(kids[j]);
+				ready = 0;
+			}
+		}
+
+		if (!ready)
+			continue;
+
+		a.resize(m);
+
+		for (size_t j = 0; j < m; ++j)
+			a[j] = vals[slot(kids[j])];
+
+		double v;
+
+		switch (this->op(n)) {
+			case OPType::ADD:
+				v = a[0];
+				for (size_t j = 1; j < m; ++j)
+					v += a[j];
+				break;
+			case OPType::SUBTRACT:
+				v = a[0];
+				for (size_t j = 1; j < m; ++j)
+					v -= a[j];
+				break;
+			case OPType::MULTIPLY:
+				v = a[0];
+				for (size_t j = 1; j < m; ++j)
+					v *= a[j];
+				break;
+			case OPType::DIVIDE:
+				v = a[0];
+				for (size_t j = 1; j < m; ++j)
+					v /= a[j];
+				break;
+			case OPType::POWER: v = std::pow(a[0], a[1]); break;
+			case OPType::NEGATE: v = -a[0]; break;
+			case OPType::SIN: v = std::sin(a[0]); break;
+			case OPType::COS: v = std::cos(a[0]); break;
+			case OPType::TAN: v = std::tan(a[0]); break;
+			case OPType::LOG: v = std::log(a[0]); break;
+			case OPType::EXP: v = std::exp(a[0]); break;
+			case OPType::SQRT: v = std::sqrt(a[0]); break;
+			case OPType::ABS: v = std::fabs(a[0]); break;
+			default:
+				throw std::runtime_error("store: unsupported op in node " + std::to_string(n) + ".");
+		}
+
+		// children inserted since may have taken s
+		s = slot(n);
+		fill(s, n);
+		vals[s] = v;
+		work.pop_back();
+	}
+
+	return vals[slot(r)];
+}
+
+double eStore::eval(size_t k, const std::unordered_map<std::string, double> &at) const {
+	std::vector<double> x(this->vars.size());
+	// variables of the library that at leaves out
+	std::vector<bool> missing(this->vars.size(), 0);
+	bool any = 0;
+
+	for (size_t j = 0; j < this->vars.size(); ++j) {
+		auto it = at.find(std::string(this->vars[j]));
+
+		if (it == at.end()) {
+			x[j] = NAN;
+			missing[j] = 1;
+			any = 1;
+			continue;
+		}
+
+		x[j] = it->second;
+	}
+
+	// only the variables expression k uses must be bound
+	if (any) {
+		std::vector<uint32_t> work = { this->root(k) };
+		std::unordered_set<uint32_t> seen = { work[0] };
+
+		while (!work.empty()) {
+			uint32_t n = work.back();
+			work.pop_back();
+
+			const Node &rec = this->node_at[n];
+
+			if (rec.type == (uint8_t) NodeType::VARIABLE && rec.arg < missing.size() && missing[rec.arg]) {
+				throw std::runtime_error("var: {" + std::string(this->vars[rec.arg]) + "} not found in evaluation context.");
+			}
+
+			auto [kids, m] = this->children(n);
+
+			for (size_t j = 0; j < m; ++j) {
+				if (seen.insert(kids[j]).second)
+					work.push_back(kids[j]);
+			}
+		}
+	}
+
+	return this->eval(k, x.data());
+}
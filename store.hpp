@@ -0,0 +1,117 @@
+// Read-only memory-mapped expression store
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include "edag.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+
+// A library of expressions in one file laid out for use in place: a flat
+// node array in topological order, children in CSR form, a constant pool
+// and the variable names. Opening maps the file read-only, so startup
+// costs an mmap, and processes opening the same file share its pages in
+// the page cache. Nodes are hash-consed across the whole library.
+//
+// Nodes are numbered 0 .. nodes() - 1 with children before parents.
+// Evaluation is in double precision, as in JIT: exact rationals become
+// the nearest double and division by zero gives inf or nan. pi, e and tau
+// are constants, as in eval(). A sum or product shared with an earlier
+// expression keeps that expression's operand order, so results may differ
+// from eval() on the original in the last bits.
+class eStore {
+	public:
+		// on-disk records, native byte order
+		struct Node {
+			uint8_t type;   // NodeType
+			uint8_t op;     // OPType, for operations
+			uint16_t pad;
+			uint32_t arg;   // name for variables, pool index for constants
+		};
+
+		struct Const {
+			int64_t num;
+			// 0: num holds the bits of a double
+			int64_t den;
+		};
+
+		struct Root {
+			uint32_t node;
+			// nodes reachable from it
+			uint32_t size;
+		};
+
+		// write exprs to path, replacing it atomically; expression k of the
+		// store is exprs[k]
+		static void write(const std::string &path, const std::vector<eDAG> &exprs);
+
+		// map path; checks the header, not the nodes (see verify())
+		explicit eStore(const std::string &path);
+
+		// every index in range, every child before its parent, every
+		// operator with the operands eval reads and every root with the
+		// DAG size it was written with. Reads
+		// the whole file, so run it once after deploying a store rather
+		// than on each start.
+		bool verify() const;
+
+		// number of expressions
+		size_t size() const;
+		size_t nodes() const;
+
+		uint32_t root(size_t k) const;
+		// nodes reachable from root(k)
+		size_t dag_size(size_t k) const;
+
+		NodeType type(uint32_t n) const;
+		OPType op(uint32_t n) const;
+		// children of n: pointer to the first and count
+		std::pair<const uint32_t*, size_t> children(uint32_t n) const;
+		// name of a variable or op string of an operation; "" for constants
+		std::string_view symbol(uint32_t n) const;
+		Number value(uint32_t n) const;
+
+		// argument order of eval, sorted by name, without pi, e and tau
+		const std::vector<std::string_view>& variables() const;
+
+		// expression k with x[i] the value of variables()[i]
+		double eval(size_t k, const double *x) const;
+		// throws if at leaves out a variable that expression k uses;
+		// other variables of the store need not be bound
+		double eval(size_t k, const std::unordered_map<std::string, double> &at) const;
+	private:
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			// 0x01020304 as written, to reject files of the other byte order
+			uint32_t byte_order;
+			uint64_t file_size;
+			uint64_t nodes, edges, consts, names, name_bytes, vars, roots;
+			// section offsets from the start of the file
+			uint64_t node_off, start_off, child_off, const_off, name_start_off, name_off, root_off;
+		};
+
+		std::shared_ptr<const char> map;
+		size_t length = 0;
+		const Header *head = nullptr;
+		const Node *node_at = nullptr;
+		// children of n are child_at[start_at[n] .. start_at[n + 1]]
+		const uint32_t *start_at = nullptr;
+		const uint32_t *child_at = nullptr;
+		const Const *const_at = nullptr;
+		// names: the variables, sorted, then pi, e and tau as used
+		const uint32_t *name_start = nullptr;
+		const char *name_bytes = nullptr;
+		const Root *root_at = nullptr;
+		std::vector<std::string_view> vars;
+
+		std::string_view name(uint32_t k) const;
+		double leaf(uint32_t n, const double *x) const;
+};
+
+#include "store.cpp"
+
+#endif
@@ -0,0 +1,157 @@
+// Stress run for deep expressions: make stress [DEPTH=n] [BUDGET=s]
+//
+// Every operation runs at DEPTH / 10 and at DEPTH, 10^6 by default, with
+// the default 8 MB stack; a recursive walk overflows the stack long before
+// that depth. An operation fails if the deeper run takes more than
+// max_ratio times as long as the shallower one: linear work gives about
+// 10, quadratic work 100. It also fails if it takes longer than BUDGET
+// seconds, 60 by default. Measured on one core at -O2, 5 GB of RAM: the
+// slowest steps at 10^6 are parse of the continued fraction (25 s) and
+// canonicalize of the chain (24 s); the rest take 3 to 13 s. The ratios
+// from 10^5 are 10.6 to 14.8; from 10^4 they reach 27, as the hash tables
+// outgrow the cache. Peak RSS is about 3 GB, mostly string node ids and
+// their hash tables.
+#include "edag.hpp"
+#include "codegen.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+static double budget = 60.0;
+
+// allowed growth of an operation's time when the depth grows 10x
+static const double max_ratio = 30.0;
+
+// shorter times are taken as this, so timer noise on tiny inputs can't
+// make the ratio
+static const double min_time = 0.01;
+
+// operation -> seconds, for the run in progress
+static std::vector<std::pair<std::string, double>> times;
+
+static void timed(const std::string &what, const std::function<void()> &f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+	times.emplace_back(what, took.count());
+	std::cout << "  " << what << ": " << took.count() << " s" << std::endl;
+}
+
+// 1/(2+1/(2+...1/(2+x)))
+static std::string continued_fraction(size_t depth) {
+	std::string s;
+	s.reserve(depth * 8 + 8);
+
+	for (size_t k = 0; k < depth; ++k)
+		s += "1/(2+";
+
+	s += "x";
+	s.append(depth, ')');
+	return s;
+}
+
+// ((((x+1)*y+1)*y+1)...), alternating so interning can't flatten it
+static std::string chain(size_t depth) {
+	std::string s;
+	s.reserve(depth * 8 + 8);
+	s.append(depth, '(');
+	s += "x";
+
+	for (size_t k = 0; k < depth; ++k)
+		s += (k % 2) ? "*y)" : "+1)";
+
+	return s;
+}
+
+// sin(cos(sin(...(x)))), one operand per level
+static std::string calls(size_t depth) {
+	std::string s;
+	s.reserve(depth * 5 + 8);
+
+	for (size_t k = 0; k < depth; ++k)
+		s += (k % 2) ? "cos(" : "sin(";
+
+	s += "x";
+	s.append(depth, ')');
+	return s;
+}
+
+static void run(size_t depth) {
+	std::unordered_map<std::string, std::variant<int64_t, Rational, double>> at = {
+		{ "x", 0.5 }, { "y", 0.25 }
+	};
+
+	std::cout << "depth " << depth << std::endl;
+
+	{
+		std::string text = continued_fraction(depth);
+		eDAG t;
+
+		timed("continued fraction: parse", [&] { t.parse(text); });
+		timed("continued fraction: eval", [&] { t.eval(at); });
+		timed("continued fraction: is_rational_expression", [&] { t.is_rational_expression(t.get_root()); });
+		timed("continued fraction: has_cycle", [&] { t.get_graph().has_cycle(); });
+		timed("continued fraction: topological_sort", [&] { t.get_graph().topological_sort(); });
+	}
+
+	{
+		std::string text = chain(depth);
+		eDAG t;
+
+		timed("(...)+1 and (...)*y chain: parse", [&] { t.parse(text); });
+		timed("(...)+1 and (...)*y chain: eval", [&] { t.eval(at); });
+		timed("(...)+1 and (...)*y chain: canonicalize", [&] { t.canonicalize(); });
+		timed("(...)+1 and (...)*y chain: has_cycle", [&] { t.get_graph().has_cycle(); });
+	}
+
+	{
+		std::string text = calls(depth);
+		eDAG t;
+
+		timed("sin(cos(...(x))) chain: parse", [&] { t.parse(text); });
+		timed("sin(cos(...(x))) chain: CodeGen::generate", [&] { CodeGen::generate(t); });
+	}
+}
+
+int main(int argc, char **argv) {
+	size_t depth = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+	if (argc > 2)
+		budget = std::strtod(argv[2], nullptr);
+
+	std::cout << "budget " << budget << " s per operation, at most "
+			  << max_ratio << "x slower at 10x the depth" << std::endl;
+
+	run(depth / 10);
+	auto small = std::move(times);
+	times.clear();
+	run(depth);
+
+	int failures = 0;
+
+	std::cout << "depth " << depth / 10 << " -> " << depth << std::endl;
+
+	for (size_t k = 0; k < times.size(); ++k) {
+		double ratio = std::max(times[k].second, min_time) / std::max(small[k].second, min_time);
+		bool ok = ratio <= max_ratio && times[k].second <= budget;
+
+		if (!ok)
+			++failures;
+
+		std::cout << (ok ? "  ok    " : "  SLOW  ") << times[k].first << ": "
+				  << small[k].second << " s -> " << times[k].second << " s, " << ratio << "x" << std::endl;
+	}
+
+	if (failures) {
+		std::cout << failures << " operation(s) over budget" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
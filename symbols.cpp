@@ -0,0 +1,104 @@
+#include "symbols.hpp"
+#include <mutex>
+#include <stdexcept>
+
+Symbols& Symbols::table() {
+	static Symbols t;
+	return t;
+}
+
+uint32_t Symbols::intern(const std::string &name) {
+	Symbols &t = table();
+
+	{
+		std::shared_lock<std::shared_mutex> lock(t.mutex);
+		auto it = t.index.find(name);
+
+		if (it != t.index.end())
+			return it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(t.mutex);
+
+	// another thread may have interned it meanwhile
+	auto it = t.index.find(name);
+
+	if (it != t.index.end())
+		return it->second;
+
+	if (t.names.size() >= t.max || t.names.size() >= none)
+		throw std::runtime_error("symbol table full (" + std::to_string(t.names.size()) + " names).");
+
+	uint32_t id = (uint32_t) t.names.size();
+	t.names.push_back(name);
+	t.index.emplace(std::string_view(t.names.back()), id);
+
+	return id;
+}
+
+uint32_t Symbols::find(const std::string &name) {
+	Symbols &t = table();
+	std::shared_lock<std::shared_mutex> lock(t.mutex);
+	auto it = t.index.find(name);
+
+	return (it != t.index.end()) ? it->second : none;
+}
+
+const std::string& Symbols::name(uint32_t id) {
+	Symbols &t = table();
+	std::shared_lock<std::shared_mutex> lock(t.mutex);
+
+	if (id >= t.names.size())
+		throw std::out_of_range("unknown symbol id.");
+
+	return t.names[id];
+}
+
+size_t Symbols::size() {
+	Symbols &t = table();
+	std::shared_lock<std::shared_mutex> lock(t.mutex);
+	return t.names.size();
+}
+
+void Symbols::set_limit(size_t n) {
+	Symbols &t = table();
+	std::unique_lock<std::shared_mutex> lock(t.mutex);
+	t.max = n;
+}
+
+size_t Symbols::limit() {
+	Symbols &t = table();
+	std::shared_lock<std::shared_mutex> lock(t.mutex);
+	return t.max;
+}
+
+// never destroyed: nodes of static pools release their text at exit
+Literals& Literals::table() {
+	static Literals *t = new Literals;
+	return *t;
+}
+
+const std::string* Literals::acquire(const std::string &text) {
+	Literals &t = table();
+	std::lock_guard<std::mutex> lock(t.mutex);
+
+	// node-based: the key does not move when the table grows
+	auto it = t.counts.emplace(text, 0).first;
+	++it->second;
+	return &it->first;
+}
+
+void Literals::release(const std::string *text) {
+	Literals &t = table();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	auto it = t.counts.find(*text);
+
+	if (it != t.counts.end() && --it->second == 0)
+		t.counts.erase(it);
+}
+
+size_t Literals::size() {
+	Literals &t = table();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	return t.counts.size();
+}
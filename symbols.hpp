@@ -0,0 +1,68 @@
+// Process-wide table of variable, function and operator names
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+// Names map to dense ids from 0 and are never removed, so an id and the
+// reference returned by name() stay valid for the life of the process.
+// Equal names share one id across all eDAGs and threads.
+//
+// Only variable, function and operator names are interned, not constants,
+// so the table grows with the number of distinct names a process has seen,
+// and ePool::collect() does not shrink it. A process that parses untrusted
+// formulas should keep the limit: past it intern() throws instead of
+// growing the table.
+class Symbols {
+	private:
+		// deque: growing it does not move the names the index points at
+		std::deque<std::string> names;
+		std::unordered_map<std::string_view, uint32_t> index;
+		size_t max = 1 << 20;
+		mutable std::shared_mutex mutex;
+
+		static Symbols& table();
+	public:
+		static constexpr uint32_t none = UINT32_MAX;
+
+		static uint32_t intern(const std::string &name);
+
+		// none if the name was never interned
+		static uint32_t find(const std::string &name);
+
+		static const std::string& name(uint32_t id);
+
+		static size_t size();
+
+		// most names the table will hold, 2^20 by default; lowering it
+		// below size() only stops further growth
+		static void set_limit(size_t n);
+		static size_t limit();
+};
+
+// Literal text of constants ("0.5", "3.14"), shared by the nodes that spell
+// a literal the same way. Each node holds one reference, taken by acquire()
+// and dropped by release(); the text is freed with the last one, so the
+// table holds only the literals of live nodes.
+class Literals {
+	private:
+		std::unordered_map<std::string, size_t> counts;
+		std::mutex mutex;
+
+		static Literals& table();
+	public:
+		// the returned string stays valid until the matching release()
+		static const std::string* acquire(const std::string &text);
+		static void release(const std::string *text);
+
+		// distinct literals held
+		static size_t size();
+};
+
+#endif
@@ -54,4 +54,37 @@ namespace utils {
 
 		return std::make_pair(left_num, left_den);
 	}
+
+	uint64_t mod_pow(uint64_t b, uint64_t e, uint64_t m) {
+		uint64_t r = 1 % m;
+
+		b %= m;
+
+		while (e) {
+			if (e & 1)
+				r = r * b % m;
+
+			b = b * b % m;
+			e >>= 1;
+		}
+
+		return r;
+	}
+
+	// m must be prime
+	uint64_t mod_inv(uint64_t a, uint64_t m) {
+		return mod_pow(a, m - 2, m);
+	}
+
+	uint64_t fnv1a(const void *data, size_t n) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		uint64_t h = 14695981039346656037ULL;
+
+		for (size_t j = 0; j < n; ++j) {
+			h ^= p[j];
+			h *= 1099511628211ULL;
+		}
+
+		return h;
+	}
 }
@@ -2,6 +2,7 @@
 #define UTILS_HPP
 
 #include <stdint.h>
+#include <stddef.h>
 #include <iostream>
 #include <utility>
 
@@ -9,6 +10,14 @@ namespace utils {
 	int64_t gcd(int64_t a, int64_t b);
 
 	std::pair<int64_t, int64_t> stern_brocot(double d, double eps = 1e-10);
+
+	// modular arithmetic for moduli below 2^32
+	uint64_t mod_pow(uint64_t b, uint64_t e, uint64_t m);
+
+	uint64_t mod_inv(uint64_t a, uint64_t m);
+
+	// 64-bit FNV-1a hash of n bytes, for cache keys and checksums
+	uint64_t fnv1a(const void *data, size_t n);
 }
 
 #endif